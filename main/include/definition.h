@@ -17,6 +17,7 @@
 
 #define WS2812_ARRAY_COUNT      16
 #define WS2812_REFRESH_TIME_MS  100
+#define WS2812_FRAME_TIME_MS    20      // render frame period while effect (color loop) is running
 #define LED_PWM_FREQUENCY       100
 #define LED_PWM_DUTY_MAX        150
 #define LED_PWM_DUTY_MIN        40
@@ -24,6 +25,18 @@
 
 #define TASK_STACK_DEPTH        4096
 #define TASK_PRIORITY_WS2812    2
+#define TASK_PRIORITY_MEMORY    1
+#define TASK_PRIORITY_LOGGER    1
+#define TASK_PRIORITY_DEVICE    1       // same as CONFIG_CHIP_TASK_PRIORITY, queueing an attribute change does not preempt CHIP task
+
+#define DEVICE_ATTRIBUTE_QUEUE_LENGTH   32  // pending attribute changes (PRE_UPDATE) handed from CHIP task to device worker
+#define DEVICE_ATTRIBUTE_OVERFLOW_MAX   16  // distinct attributes coalesced while the queue is full (CHIP task never waits)
+#define DEVICE_COMMIT_WINDOW_MS         10  // staged changes are committed when no further change arrives within the window
+#define DEVICE_COMMIT_WINDOW_MAX_MS     50  // upper bound of commit delay while changes keep coming (ex: level transition)
+#define DEVICE_REPORT_INTERVAL_MS       1000    // attribute report interval while the device animates the value (quieter reporting)
+
+#define MEMORY_FLUSH_DELAY_MS       2000    // debounce time of nvs write-behind
+#define MEMORY_FLUSH_MAX_DELAY_MS   10000   // upper bound of write-behind delay while changes keep coming
 
 /**
  * 0 = on/off
@@ -32,6 +45,26 @@
  */
 #define LIGHT_TYPE  2
 
+/**
+ * Matter bridge mode
+ * 0 = single light endpoint (LIGHT_TYPE)
+ * 1 = aggregator endpoint + BRIDGE_ENDPOINT_COUNT bridged dimmable lights, pixels are split evenly into segments
+ *     (endpoints beyond the pixel count have an empty segment, more than 14 endpoints require
+ *      CONFIG_ESP_MATTER_MAX_DYNAMIC_ENDPOINT_COUNT >= BRIDGE_ENDPOINT_COUNT + 2)
+ */
+#define BRIDGE_MODE             0
+#define BRIDGE_ENDPOINT_COUNT   8
+#define WS2812_SEGMENT_MAX      MAX(BRIDGE_ENDPOINT_COUNT, 1)  // pixel segments (endpoint -> pixel range) of the strip
+
+/**
+ * endpoint id -> device lookup table (attribute callback), ids outside the table are searched linearly
+ */
+#if BRIDGE_MODE
+#define DEVICE_ENDPOINT_INDEX_SIZE  (BRIDGE_ENDPOINT_COUNT + 8)
+#else
+#define DEVICE_ENDPOINT_INDEX_SIZE  8
+#endif
+
 /**
  * 0 = Hue and Saturation
  * 1 = X and Y
@@ -39,4 +72,42 @@
  */
 #define COLOR_MODE  0
 
+/**
+ * LED chip type (timing, reset length, channel order)
+ * 0 = WS2812B (GRB)
+ * 1 = SK6812 RGBW (GRBW)
+ * 2 = WS2811 (RGB)
+ * 3 = APA106 (RGB)
+ */
+#define LED_CHIP_TYPE   0
+
+/**
+ * WS2812 framebuffer format
+ * 0 = native (wire order of LED chip, 3 or 4 bytes/pixel, zero-copy)
+ * 1 = palette indexed (1 byte/pixel + 256 entry palette)
+ */
+#define WS2812_FRAMEBUFFER_FORMAT   0
+
+/**
+ * Log output format
+ * 0 = text (formatted by logger drain task)
+ * 1 = binary frame (formatted on host, scripts/decode_binlog.py)
+ */
+#define LOG_OUTPUT_FORMAT   0
+
+/**
+ * Log rate limit (token bucket per call site, messages/sec, 0 = unlimited)
+ * HOT = matter attribute change and led driver logs (device*, ws2812 modules)
+ */
+#define LOG_RATE_LIMIT_DEFAULT          0
+#define LOG_RATE_LIMIT_BURST_DEFAULT    10
+#define LOG_RATE_LIMIT_HOT              2
+#define LOG_RATE_LIMIT_BURST_HOT        5
+
+/**
+ * Log records kept in RTC memory across reset (power of 2, 0 = disabled)
+ * dumped at next boot with the reset reason
+ */
+#define LOG_CRASH_RING_SIZE     2048
+
 #endif
\ No newline at end of file
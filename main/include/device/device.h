@@ -3,9 +3,177 @@
 #define _DEVICE_H_
 
 #include <stdint.h>
+#include <stddef.h>
+#include <array>
 #include "definition.h"
+#include "device_state.h"
+#include "report_policy.h"
 #include <esp_matter.h>
 #include <esp_matter_core.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+
+/**
+ * @brief (cluster, attribute) -> state field, staged work and attribute change handler of device class T
+ * staged (DEVICE_STAGED_xxx) and handler (optional) are applied only when the field value has changed,
+ * always: applied for every write (command parameter such as ColorLoopStartEnhancedHue)
+ */
+template <typename T>
+struct matter_attribute_entry_t
+{
+    uint32_t cluster_id;
+    uint32_t attribute_id;
+    const char *cluster_name;
+    const char *attribute_name;
+    eStateField field;
+    uint32_t staged;
+    void (*handler)(T *device, esp_matter_attr_val_t *value);
+    bool always;
+};
+
+#define MATTER_ATTRIBUTE(cluster, attribute) \
+    chip::app::Clusters::cluster::Id, \
+    chip::app::Clusters::cluster::Attributes::attribute::Id, \
+    #cluster, \
+    #attribute
+
+/**
+ * @brief hardware/persistence work staged by attribute handlers, applied once per commit
+ * (ex: MoveToHueAndSaturation = CurrentHue + CurrentSaturation -> one color change)
+ */
+#define DEVICE_STAGED_BRIGHTNESS    (1 << 0)
+#define DEVICE_STAGED_COLOR_HS      (1 << 1)
+#define DEVICE_STAGED_COLOR_XY      (1 << 2)
+#define DEVICE_STAGED_COLOR_LOOP    (1 << 3)
+#define DEVICE_STAGED_SAVE_STATE    (1 << 4)
+#define DEVICE_STAGED_COLOR_CT      (1 << 5)
+// the last color mode of the commit wins (see stage_change)
+#define DEVICE_STAGED_COLOR_MASK    (DEVICE_STAGED_COLOR_HS | DEVICE_STAGED_COLOR_XY | DEVICE_STAGED_COLOR_CT)
+
+#define MATTER_ATTRIBUTE_BATCH_MAX  8
+
+/**
+ * @brief state field -> attribute, written together by matter_publish_attributes
+ */
+typedef struct matter_attribute_batch_item_t
+{
+    uint32_t cluster_id;
+    uint32_t attribute_id;
+    eStateField field;
+} matter_attribute_batch_item_t;
+
+/**
+ * @brief publish pending on CHIP task (one slot per device, no allocation)
+ * values are taken when the items are added, a later publish of the same attribute replaces the value
+ */
+typedef struct matter_publish_batch_t
+{
+    size_t count;
+    struct {
+        uint32_t cluster_id;
+        uint32_t attribute_id;
+        esp_matter_attr_val_t value;
+    } items[MATTER_ATTRIBUTE_BATCH_MAX];
+} matter_publish_batch_t;
+
+template <typename T, size_t N>
+using matter_attribute_table_t = std::array<matter_attribute_entry_t<T>, N>;
+
+constexpr uint64_t matter_attribute_key(uint32_t cluster_id, uint32_t attribute_id)
+{
+    return ((uint64_t)cluster_id << 32) | attribute_id;
+}
+
+/**
+ * @brief device class declares its entries in any order, table is sorted at compile time
+ * ex) static constexpr auto table = make_matter_attribute_table<CDeviceXXX>({ {MATTER_ATTRIBUTE(OnOff, OnOff), eStateField::OnOff, DEVICE_STAGED_BRIGHTNESS, nullptr}, ... });
+ */
+template <typename T, typename E>
+constexpr T sort_matter_attribute_entries(const E &entries, size_t N)
+{
+    T table{};
+    for (size_t i = 0; i < N; i++) {
+        // insertion sort
+        size_t j = i;
+        uint64_t key = matter_attribute_key(entries[i].cluster_id, entries[i].attribute_id);
+        while (j > 0 && matter_attribute_key(table[j - 1].cluster_id, table[j - 1].attribute_id) > key) {
+            table[j] = table[j - 1];
+            j--;
+        }
+        table[j] = entries[i];
+    }
+    return table;
+}
+
+template <typename T, size_t N>
+constexpr matter_attribute_table_t<T, N> make_matter_attribute_table(const matter_attribute_entry_t<T> (&entries)[N])
+{
+    return sort_matter_attribute_entries<matter_attribute_table_t<T, N>>(entries, N);
+}
+
+template <typename T, size_t N>
+constexpr matter_attribute_table_t<T, N> make_matter_attribute_table(const std::array<matter_attribute_entry_t<T>, N> &entries)
+{
+    return sort_matter_attribute_entries<matter_attribute_table_t<T, N>>(entries, N);
+}
+
+/**
+ * @brief joins the entries (or batch items) declared by several feature classes at compile time
+ */
+template <typename E, size_t N>
+constexpr std::array<E, N> join_arrays(const std::array<E, N> &a)
+{
+    return a;
+}
+
+template <typename E, size_t N, size_t M, typename... Rest>
+constexpr auto join_arrays(const std::array<E, N> &a, const std::array<E, M> &b, const Rest&... rest)
+{
+    std::array<E, N + M> joined{};
+    for (size_t i = 0; i < N; i++) {
+        joined[i] = a[i];
+    }
+    for (size_t i = 0; i < M; i++) {
+        joined[N + i] = b[i];
+    }
+    return join_arrays(joined, rest...);
+}
+
+template <typename T, size_t N>
+constexpr bool matter_attribute_table_is_unique(const matter_attribute_table_t<T, N> &table)
+{
+    for (size_t i = 1; i < N; i++) {
+        if (matter_attribute_key(table[i - 1].cluster_id, table[i - 1].attribute_id) == matter_attribute_key(table[i].cluster_id, table[i].attribute_id)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief binary search (table sorted by make_matter_attribute_table)
+ */
+template <typename T, size_t N>
+const matter_attribute_entry_t<T>* find_matter_attribute_entry(const matter_attribute_table_t<T, N> &table, uint32_t cluster_id, uint32_t attribute_id)
+{
+    uint64_t key = matter_attribute_key(cluster_id, attribute_id);
+    size_t low = 0;
+    size_t high = N;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        uint64_t key_mid = matter_attribute_key(table[mid].cluster_id, table[mid].attribute_id);
+        if (key_mid == key) {
+            return &table[mid];
+        } else if (key_mid < key) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return nullptr;
+}
 
 class CDevice
 {
@@ -16,10 +184,116 @@ public:
 protected:
     esp_matter::endpoint_t *m_endpoint;
     uint16_t m_endpoint_id;
-    bool m_state_onoff;
-    uint8_t m_state_brightness;
-    uint8_t m_state_hue;
-    uint8_t m_state_saturation;
+    CDeviceState m_state;
+
+    /**
+     * @brief attribute write of the device in progress (esp_matter calls PRE_UPDATE callback in the writing task)
+     */
+    struct publish_context_t {
+        uint32_t cluster_id;
+        uint32_t attribute_id;
+        uint32_t generation;
+        TaskHandle_t task;
+    };
+    publish_context_t m_publishing;
+    SemaphoreHandle_t m_publish_mutex;
+    matter_publish_batch_t m_publish_batch;
+    bool m_publish_scheduled;           // m_publish_batch is waiting for CHIP task (merged until taken)
+    portMUX_TYPE m_publish_batch_lock;
+
+    uint32_t m_staged_changes;          // DEVICE_STAGED_xxx
+    uint32_t m_stat_staged_count;
+    uint32_t m_stat_commit_count;
+    uint32_t m_stat_batch_count;
+    uint32_t m_stat_batch_write_count;
+    uint32_t m_stat_batch_unchanged_count;
+    uint32_t m_stat_batch_merged_count;
+
+    CReportPolicy m_report_policy;
+    esp_timer_handle_t m_report_timer;  // reports pending values while a transition is running
+
+    /**
+     * @brief handler defers the hardware access to commit_staged_changes()
+     */
+    void stage_change(uint32_t flags);
+    virtual void apply_staged_changes(uint32_t flags);
+
+    void load_state();
+    void save_state();
+    bool matter_get_attribute_value(uint32_t cluster_id, uint32_t attribute_id, esp_matter_attr_val_t *value);
+    /**
+     * @brief write the state field to matter attribute storage (PRE_UPDATE of the write is recognized as echo)
+     */
+    bool matter_publish_attribute(uint32_t cluster_id, uint32_t attribute_id, eStateField field);
+    /**
+     * @brief write several state fields in one pass on CHIP task (no PRE/POST callback, no echo),
+     * only the changed attributes are marked dirty so subscribers get one report
+     */
+    bool matter_publish_attributes(const matter_attribute_batch_item_t *items, size_t count);
+    static void matter_publish_batch_work(intptr_t arg);
+
+    /**
+     * @brief attribute driven by the device (transition, effect), reported by CReportPolicy
+     * begin: reported right away, report: throttled to DEVICE_REPORT_INTERVAL_MS while in transition,
+     * end: final value is reported if the last change was held, update / report rates of the transition are logged
+     */
+    void matter_begin_transition(uint32_t cluster_id, uint32_t attribute_id, eStateField field);
+    void matter_report_attribute(uint32_t cluster_id, uint32_t attribute_id, eStateField field, uint32_t updates = 1);
+    /**
+     * @brief report timer (esp_timer task): values the output stored since the last tick are applied and reported
+     * (output task only stores the value, state and publish are not touched by the realtime task)
+     */
+    virtual void sample_device_values() {}
+    void matter_end_transition(uint32_t cluster_id, uint32_t attribute_id, eStateField field);
+    static void func_report_timer(void *arg);
+    static esp_matter_attr_val_t make_matter_value(eStateField field, uint16_t value);
+    static uint16_t get_matter_value(esp_matter_attr_val_t *value);
+    static void on_state_changed(void *context, eStateField field, uint16_t value, eStateSource source);
+    void matter_log_attribute_change(const char *cluster_name, uint32_t cluster_id, const char *attribute_name, uint32_t attribute_id, esp_matter_attr_val_t *value);
+
+    /**
+     * @brief PRE_UPDATE change -> state store -> staged work / handler of the table entry (value changed)
+     * @param[in] echo_generation generation of the own write (0 = controller write)
+     * @return true handled (or echo of the device's own write)
+     * @return false not in the table
+     */
+    template <typename T, size_t N>
+    bool matter_dispatch_attribute_change(
+        const matter_attribute_table_t<T, N> &table,
+        esp_matter::attribute::callback_type_t type,
+        uint32_t cluster_id,
+        uint32_t attribute_id,
+        esp_matter_attr_val_t *value,
+        uint32_t echo_generation
+    ) {
+        if (type != esp_matter::attribute::callback_type_t::PRE_UPDATE) {
+            return false;
+        }
+        const matter_attribute_entry_t<T> *entry = find_matter_attribute_entry(table, cluster_id, attribute_id);
+        if (!entry) {
+            return false;
+        }
+        if (echo_generation) {
+            if (m_state.confirm_echo(entry->field, echo_generation)) {
+                matter_publish_attribute(cluster_id, attribute_id, entry->field);
+            }
+            return true;
+        }
+        if (value->type == ESP_MATTER_VAL_TYPE_INVALID) {
+            // string/array value (not copied to the device worker), state fields hold scalar values only
+            return false;
+        }
+        matter_log_attribute_change(entry->cluster_name, cluster_id, entry->attribute_name, attribute_id, value);
+        if (m_state.set(entry->field, get_matter_value(value), eStateSource::Matter) || entry->always) {
+            if (entry->staged) {
+                stage_change(entry->staged);
+            }
+            if (entry->handler) {
+                entry->handler(static_cast<T *>(this), value);
+            }
+        }
+        return true;
+    }
 
 public:
     virtual bool matter_add_endpoint();
@@ -31,9 +305,21 @@ public:
         esp_matter::attribute::callback_type_t type,
         uint32_t cluster_id,
         uint32_t attribute_id,
-        esp_matter_attr_val_t *value
+        esp_matter_attr_val_t *value,
+        uint32_t echo_generation
     );
     virtual void matter_update_all_attribute_values();
+    /**
+     * @brief called in attribute update callback (CHIP task or the task writing the attribute)
+     * @return uint32_t generation of the own write, 0 = controller write
+     */
+    uint32_t matter_get_echo_generation(uint32_t cluster_id, uint32_t attribute_id);
+    bool has_staged_changes() { return m_staged_changes != 0; }
+    /**
+     * @brief apply the changes staged since the last commit (called in the task handling attribute changes)
+     */
+    void commit_staged_changes();
+    void print_state_info();
 
 public:
     virtual void toggle_state_action();
@@ -0,0 +1,220 @@
+#pragma once
+#ifndef _DEVICE_LIGHT_H_
+#define _DEVICE_LIGHT_H_
+
+#include <algorithm>
+#include "device.h"
+#include "light_feature.h"
+
+/**
+ * @brief light output: whole strip (pwm brightness + common color of CWS2812Ctrl)
+ */
+class CLightStripOutput
+{
+public:
+    static constexpr bool has_effects = true;   // color loop is rendered by the realtime task
+
+    void attach(uint16_t endpoint_id) {}
+    void set_white();
+    void set_brightness(bool on, uint8_t level);
+    void set_hue_saturation(uint16_t enhanced_hue, uint8_t saturation);
+    void set_xy(uint16_t x, uint16_t y);
+    void set_temperature(uint16_t mireds);
+
+    void start_color_loop(uint8_t direction, uint16_t time_sec, uint16_t start_hue, uint8_t saturation);
+    void set_hue_listener(void (*listener)(void *context, uint16_t hue), void *context);
+    void stop_color_loop();
+    bool is_color_loop_active();
+    uint16_t get_hue();
+};
+
+/**
+ * @brief light output: pixel segment [pixel_start, pixel_start + pixel_count) of the strip (BRIDGE_MODE)
+ * on/off and level are rendered into the pixel color by CWS2812Ctrl (pwm is shared by every segment)
+ */
+class CLightSegmentOutput
+{
+public:
+    CLightSegmentOutput(int pixel_start, int pixel_count);
+
+    static constexpr bool has_effects = false;
+
+    void attach(uint16_t endpoint_id);
+    void set_white();
+    void set_brightness(bool on, uint8_t level);
+    void set_hue_saturation(uint16_t enhanced_hue, uint8_t saturation);
+    void set_xy(uint16_t x, uint16_t y);
+    void set_temperature(uint16_t mireds);
+
+private:
+    int m_pixel_start;
+    int m_pixel_count;
+    int m_segment;      // segment table index of CWS2812Ctrl
+};
+
+/**
+ * @brief code shared by every light composition (compiled once, not per template instance)
+ */
+class CDeviceLightBase : public CDevice
+{
+public:
+    CDeviceLightBase(eLightDeviceType device_type, esp_matter::endpoint_t *parent);
+
+    bool matter_add_endpoint() override;
+
+public:
+    // accessors for the features (see light_feature.h)
+    CDeviceState* get_state() { return &m_state; }
+    void stage(uint32_t flags) { stage_change(flags); }
+    /**
+     * @brief esp_matter attribute storage(non-volatile attribute)에 저장된 값으로 state field를 복원한다
+     */
+    bool matter_restore_attribute(uint32_t cluster_id, uint32_t attribute_id, eStateField field);
+    /**
+     * @brief nvs write of the non-volatile attribute is delayed until the value settles
+     * (CONFIG_ESP_MATTER_DEFERRED_ATTR_PERSISTENCE_TIME_MS), a transition or a hue + saturation pair costs one write
+     */
+    bool matter_defer_persistence(uint32_t cluster_id, uint32_t attribute_id);
+    void matter_check_feature_result(const char *name, esp_err_t ret);
+    /**
+     * @brief value animated by the output (effect), reported by CReportPolicy (see CDevice::matter_begin_transition)
+     */
+    void begin_transition(uint32_t cluster_id, uint32_t attribute_id, eStateField field) { matter_begin_transition(cluster_id, attribute_id, field); }
+    void report_attribute(uint32_t cluster_id, uint32_t attribute_id, eStateField field, uint32_t updates = 1) { matter_report_attribute(cluster_id, attribute_id, field, updates); }
+    void end_transition(uint32_t cluster_id, uint32_t attribute_id, eStateField field) { matter_end_transition(cluster_id, attribute_id, field); }
+
+protected:
+    eLightDeviceType m_device_type;
+    esp_matter::endpoint_t *m_endpoint_parent;  // aggregator of the bridged light (nullptr = root node)
+
+    esp_matter::cluster_t* matter_get_color_control_cluster();
+    void matter_set_color_capabilities(uint32_t color_features);
+    uint8_t matter_get_color_mode();
+};
+
+/**
+ * @brief light device composed of features (CLightFeatureXXX) at compile time
+ * - attribute table, publish items and endpoint device type are resolved from the features at compile time
+ * - attribute change / commit calls every feature hook directly (fold expression, inlined), no virtual dispatch
+ * - TOutput: CLightStripOutput (whole strip) or CLightSegmentOutput (bridged light)
+ */
+template <typename TOutput, typename... TFeatures>
+class CDeviceLight : public CDeviceLightBase, public TFeatures...
+{
+public:
+    typedef TOutput output_t;
+
+    static constexpr eLightDeviceType device_type = std::max({eLightDeviceType::OnOff, TFeatures::device_type...});
+    static constexpr uint32_t color_features = (TFeatures::color_features | ... | 0);
+    static constexpr uint32_t staged_colors = (TFeatures::staged_color | ... | 0);
+    static constexpr bool saves_state = (TFeatures::saves_state || ...);
+
+    // checked when the composition is instantiated (every typedef below, see device_light.cpp)
+    static_assert(matter_attribute_table_is_unique(make_matter_attribute_table(join_arrays(TFeatures::template entries<CDeviceLight>()...))), "duplicated attribute entry");
+    static_assert(join_arrays(TFeatures::publish_items()...).size() <= MATTER_ATTRIBUTE_BATCH_MAX, "too many attributes for one batch");
+
+    CDeviceLight() : CDeviceLightBase(device_type, nullptr) {
+        initialize();
+    }
+
+    CDeviceLight(esp_matter::endpoint_t *parent, int pixel_start, int pixel_count)
+        : CDeviceLightBase(device_type, parent), m_output(pixel_start, pixel_count) {
+        initialize();
+    }
+
+    bool matter_init_endpoint() override {
+        m_output.attach(m_endpoint_id);
+
+        if constexpr (color_features != 0) {
+            esp_matter::cluster_t *cluster = matter_get_color_control_cluster();
+            (TFeatures::add_features(this, cluster), ...);
+            matter_set_color_capabilities(color_features);
+        }
+
+        (TFeatures::defer_persistence(this), ...);
+
+        uint32_t flags = DEVICE_STAGED_BRIGHTNESS;
+        (TFeatures::restore(this, &flags), ...);
+        if constexpr (staged_colors != 0) {
+            // ColorMode 0: hue & saturation, 1: xy, 2: color temperature
+            int color_mode = matter_get_color_mode();
+            uint32_t staged_color = ((TFeatures::color_mode == color_mode ? TFeatures::staged_color : 0) | ... | 0);
+            flags |= staged_color ? staged_color : (staged_colors & -staged_colors);
+        }
+        apply_staged_changes(flags);
+
+        matter_update_all_attribute_values();
+
+        return true;
+    }
+
+    void matter_on_change_attribute_value(
+        esp_matter::attribute::callback_type_t type,
+        uint32_t cluster_id,
+        uint32_t attribute_id,
+        esp_matter_attr_val_t *value,
+        uint32_t echo_generation
+    ) override {
+        static constexpr auto table = make_matter_attribute_table(join_arrays(TFeatures::template entries<CDeviceLight>()...));
+
+        matter_dispatch_attribute_change(table, type, cluster_id, attribute_id, value, echo_generation);
+    }
+
+    void matter_update_all_attribute_values() override {
+        static constexpr auto items = join_arrays(TFeatures::publish_items()...);
+
+        matter_publish_attributes(items.data(), items.size());
+    }
+
+    void sample_device_values() override {
+        (TFeatures::sample(this), ...);
+    }
+
+    void toggle_state_action() override {
+        m_state.set(eStateField::OnOff, !m_state.get_bool(eStateField::OnOff), eStateSource::Device);
+        apply_brightness();
+        matter_update_all_attribute_values();
+    }
+
+public:
+    TOutput* get_output() { return &m_output; }
+
+private:
+    TOutput m_output;
+
+    void initialize() {
+        if constexpr (device_type == eLightDeviceType::OnOff) {
+            m_state.set(eStateField::Level, CLightFeatureOnOff::fixed_level, eStateSource::Restore);
+        }
+        if constexpr (color_features == 0) {
+            m_output.set_white();
+        }
+        if constexpr (saves_state) {
+            load_state();
+        }
+    }
+
+    void apply_brightness() {
+        m_output.set_brightness(m_state.get_bool(eStateField::OnOff), (uint8_t)m_state.get(eStateField::Level));
+    }
+
+    void apply_staged_changes(uint32_t flags) override {
+        if (flags & DEVICE_STAGED_BRIGHTNESS) {
+            apply_brightness();
+        }
+        (TFeatures::apply_effect(this, &flags), ...);
+        (TFeatures::apply(this, flags), ...);
+
+        CDevice::apply_staged_changes(flags);
+    }
+};
+
+/**
+ * @brief light devices (LIGHT_TYPE, BRIDGE_MODE)
+ */
+typedef CDeviceLight<CLightStripOutput, CLightFeatureOnOff> CDeviceOnOffLight;
+typedef CDeviceLight<CLightStripOutput, CLightFeatureOnOff, CLightFeatureLevel> CDeviceLevelControlLight;
+typedef CDeviceLight<CLightStripOutput, CLightFeatureOnOff, CLightFeatureLevel, CLightFeatureColorLoop, CLightFeatureHS, CLightFeatureXY, CLightFeatureCT> CDeviceColorControlLight;
+typedef CDeviceLight<CLightSegmentOutput, CLightFeatureOnOff, CLightFeatureLevel> CDeviceBridgedLight;
+
+#endif
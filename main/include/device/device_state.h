@@ -0,0 +1,123 @@
+#pragma once
+#ifndef _DEVICE_STATE_H_
+#define _DEVICE_STATE_H_
+
+#include <stdint.h>
+#ifdef UNIT_TEST
+#include <mutex>
+#else
+#include "freertos/FreeRTOS.h"
+#endif
+
+#define STATE_LISTENER_MAX  4
+
+enum class eStateField : uint8_t {
+    OnOff = 0,
+    Level,
+    Hue,
+    EnhancedHue,
+    Saturation,
+    X,
+    Y,
+    ColorTemperature,
+    ColorLoopActive,
+    ColorLoopDirection,
+    ColorLoopTime,
+    ColorLoopStartHue,
+    Count,
+};
+
+enum class eStateSource : uint8_t {
+    Device = 0,     // local control (button, effect, derived value)
+    Matter,         // attribute change from a controller
+    Restore,        // boot (attribute storage, light state record)
+};
+
+enum class eStateType : uint8_t {
+    Bool = 0,
+    Uint8,
+    Uint16,
+};
+
+#define STATE_FIELD_COUNT   ((int)eStateField::Count)
+
+/**
+ * @brief called after a field value has changed (outside of the store lock)
+ */
+typedef void (*state_listener_t)(void *context, eStateField field, uint16_t value, eStateSource source);
+
+/**
+ * @brief single copy of the device state (matter attribute view)
+ * - every field has a generation counter, increased only when the value really changes
+ *   (writing the same value is not a change: no listener call, no hardware access)
+ * - own attribute update of the device (publish) is recognized by the generation it carried,
+ *   not by per-attribute flags (see confirm_echo)
+ */
+class CDeviceState
+{
+public:
+    CDeviceState();
+    virtual ~CDeviceState();
+
+public:
+    uint16_t get(eStateField field);
+    uint16_t get(eStateField field, uint32_t *generation);
+    uint32_t get_generation(eStateField field);
+    bool get_bool(eStateField field) { return get(field) ? true : false; }
+
+    /**
+     * @return true value changed (generation increased, listeners notified)
+     */
+    bool set(eStateField field, uint16_t value, eStateSource source);
+
+    bool add_listener(state_listener_t listener, void *context);
+
+    /**
+     * @brief device is about to write the field to matter attribute storage
+     * @return uint32_t generation carried by the write (echo)
+     */
+    uint32_t mark_published(eStateField field);
+
+    /**
+     * @brief echo of the own write has arrived
+     * @return true field has changed since and no newer write is in flight,
+     *         matter holds a stale value and the field should be published again
+     */
+    bool confirm_echo(eStateField field, uint32_t generation);
+
+    static const char* get_field_name(eStateField field);
+    static eStateType get_field_type(eStateField field);
+    void print_state_info();
+
+private:
+    struct field_t {
+        uint16_t value;
+        uint32_t generation;
+        uint32_t published_generation;
+    };
+    field_t m_fields[STATE_FIELD_COUNT];
+
+    struct listener_t {
+        state_listener_t func;
+        void *context;
+    };
+    listener_t m_listeners[STATE_LISTENER_MAX];
+    int m_listener_count;
+
+#ifdef UNIT_TEST
+    std::mutex m_mutex;
+#else
+    portMUX_TYPE m_lock;
+#endif
+
+    // statistics
+    uint32_t m_change_count;
+    uint32_t m_unchanged_count;     // write of the same value (hardware access avoided)
+    uint32_t m_echo_count;
+    uint32_t m_stale_echo_count;
+
+    void lock();
+    void unlock();
+};
+
+#endif
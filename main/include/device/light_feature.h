@@ -0,0 +1,444 @@
+#pragma once
+#ifndef _LIGHT_FEATURE_H_
+#define _LIGHT_FEATURE_H_
+
+#include "device.h"
+#include <esp_matter_feature.h>
+#include <atomic>
+
+/**
+ * @brief device type of the light endpoint, the highest one required by the features is created
+ */
+enum class eLightDeviceType : uint8_t {
+    OnOff = 0,      // on_off_light
+    Dimmable,       // dimmable_light
+    Color,          // extended_color_light
+};
+
+/**
+ * @brief feature of CDeviceLight (composed at compile time, no virtual call)
+ * every hook has an empty default here, a feature hides only the hooks it needs
+ * - L: CDeviceLight<...> instance type, the feature accesses the light through its public accessors
+ * - color_mode: value of the ColorMode attribute selected by the feature (-1 = not a color mode)
+ * - color_features: bits of the ColorControl feature map (3.2.5. Features)
+ */
+class CLightFeature
+{
+public:
+    static constexpr eLightDeviceType device_type = eLightDeviceType::OnOff;
+    static constexpr uint32_t color_features = 0;
+    static constexpr int color_mode = -1;
+    static constexpr uint32_t staged_color = 0;
+    static constexpr bool saves_state = false;  // restored from light state record (see CDevice::load_state)
+
+    template <typename L>
+    static constexpr std::array<matter_attribute_entry_t<L>, 0> entries() { return {}; }
+    static constexpr std::array<matter_attribute_batch_item_t, 0> publish_items() { return {}; }
+
+    template <typename L>
+    static void add_features(L *light, esp_matter::cluster_t *cluster) {}
+    template <typename L>
+    static void restore(L *light, uint32_t *flags) {}
+    /**
+     * @brief attributes changed step by step (transition) or in pairs (hue + saturation, x + y)
+     * are written to nvs once after the change settles (see CDeviceLightBase::matter_defer_persistence)
+     */
+    template <typename L>
+    static void defer_persistence(L *light) {}
+    /**
+     * @brief called before apply() of every feature, may add staged flags (ex: color loop stop -> hue/saturation)
+     */
+    template <typename L>
+    static void apply_effect(L *light, uint32_t *flags) {}
+    template <typename L>
+    static void apply(L *light, uint32_t flags) {}
+    /**
+     * @brief report timer tick while a transition is running (esp_timer task, see CDevice::sample_device_values)
+     */
+    template <typename L>
+    static void sample(L *light) {}
+};
+
+class CLightFeatureOnOff : public CLightFeature
+{
+public:
+    static constexpr uint8_t fixed_level = 100;     // brightness of the light without LevelControl
+
+    template <typename L>
+    static constexpr std::array<matter_attribute_entry_t<L>, 1> entries() {
+        return {{
+            {MATTER_ATTRIBUTE(OnOff, OnOff), eStateField::OnOff, DEVICE_STAGED_BRIGHTNESS, nullptr},
+        }};
+    }
+    static constexpr std::array<matter_attribute_batch_item_t, 1> publish_items() {
+        return {{
+            {chip::app::Clusters::OnOff::Id, chip::app::Clusters::OnOff::Attributes::OnOff::Id, eStateField::OnOff},
+        }};
+    }
+
+    template <typename L>
+    static void restore(L *light, uint32_t *flags) {
+        light->matter_restore_attribute(chip::app::Clusters::OnOff::Id, chip::app::Clusters::OnOff::Attributes::OnOff::Id, eStateField::OnOff);
+    }
+};
+
+class CLightFeatureLevel : public CLightFeature
+{
+public:
+    static constexpr eLightDeviceType device_type = eLightDeviceType::Dimmable;
+
+    template <typename L>
+    static constexpr std::array<matter_attribute_entry_t<L>, 1> entries() {
+        return {{
+            {MATTER_ATTRIBUTE(LevelControl, CurrentLevel), eStateField::Level, DEVICE_STAGED_BRIGHTNESS, nullptr},
+        }};
+    }
+    static constexpr std::array<matter_attribute_batch_item_t, 1> publish_items() {
+        return {{
+            {chip::app::Clusters::LevelControl::Id, chip::app::Clusters::LevelControl::Attributes::CurrentLevel::Id, eStateField::Level},
+        }};
+    }
+
+    template <typename L>
+    static void defer_persistence(L *light) {
+        light->matter_defer_persistence(chip::app::Clusters::LevelControl::Id, chip::app::Clusters::LevelControl::Attributes::CurrentLevel::Id);
+    }
+
+    template <typename L>
+    static void restore(L *light, uint32_t *flags) {
+        light->matter_restore_attribute(chip::app::Clusters::LevelControl::Id, chip::app::Clusters::LevelControl::Attributes::CurrentLevel::Id, eStateField::Level);
+        if (!light->get_state()->get(eStateField::Level)) {
+            light->get_state()->set(eStateField::Level, 1, eStateSource::Restore);
+        }
+    }
+};
+
+/**
+ * @brief hue/saturation + enhanced hue (HS, EHUE)
+ */
+class CLightFeatureHS : public CLightFeature
+{
+public:
+    static constexpr eLightDeviceType device_type = eLightDeviceType::Color;
+    static constexpr uint32_t color_features = (1 << 0) | (1 << 1);
+    static constexpr int color_mode = 0;
+    static constexpr uint32_t staged_color = DEVICE_STAGED_COLOR_HS;
+
+    template <typename L>
+    static constexpr std::array<matter_attribute_entry_t<L>, 3> entries() {
+        return {{
+            {MATTER_ATTRIBUTE(ColorControl, CurrentHue), eStateField::Hue, 0, &CLightFeatureHS::on_change_current_hue<L>},
+            {MATTER_ATTRIBUTE(ColorControl, EnhancedCurrentHue), eStateField::EnhancedHue, DEVICE_STAGED_COLOR_HS, &CLightFeatureHS::on_change_enhanced_current_hue<L>},
+            {MATTER_ATTRIBUTE(ColorControl, CurrentSaturation), eStateField::Saturation, DEVICE_STAGED_COLOR_HS, nullptr},
+        }};
+    }
+    static constexpr std::array<matter_attribute_batch_item_t, 3> publish_items() {
+        return {{
+            {chip::app::Clusters::ColorControl::Id, chip::app::Clusters::ColorControl::Attributes::CurrentHue::Id, eStateField::Hue},
+            {chip::app::Clusters::ColorControl::Id, chip::app::Clusters::ColorControl::Attributes::EnhancedCurrentHue::Id, eStateField::EnhancedHue},
+            {chip::app::Clusters::ColorControl::Id, chip::app::Clusters::ColorControl::Attributes::CurrentSaturation::Id, eStateField::Saturation},
+        }};
+    }
+
+    template <typename L>
+    static void add_features(L *light, esp_matter::cluster_t *cluster) {
+        esp_matter::cluster::color_control::feature::hue_saturation::config_t cfg;
+        cfg.current_hue = (uint8_t)light->get_state()->get(eStateField::Hue);
+        cfg.current_saturation = (uint8_t)light->get_state()->get(eStateField::Saturation);
+        light->matter_check_feature_result("hue_saturation", esp_matter::cluster::color_control::feature::hue_saturation::add(cluster, &cfg));
+
+        // enhanced current hue (16-bit hue)
+        esp_matter::cluster::color_control::feature::enhanced_hue::config_t cfg_ehue;
+        cfg_ehue.enhanced_current_hue = light->get_state()->get(eStateField::EnhancedHue);
+        light->matter_check_feature_result("enhanced_hue", esp_matter::cluster::color_control::feature::enhanced_hue::add(cluster, &cfg_ehue));
+    }
+
+    template <typename L>
+    static void defer_persistence(L *light) {
+        light->matter_defer_persistence(chip::app::Clusters::ColorControl::Id, chip::app::Clusters::ColorControl::Attributes::CurrentHue::Id);
+        light->matter_defer_persistence(chip::app::Clusters::ColorControl::Id, chip::app::Clusters::ColorControl::Attributes::EnhancedCurrentHue::Id);
+        light->matter_defer_persistence(chip::app::Clusters::ColorControl::Id, chip::app::Clusters::ColorControl::Attributes::CurrentSaturation::Id);
+    }
+
+    template <typename L>
+    static void restore(L *light, uint32_t *flags) {
+        CDeviceState *state = light->get_state();
+        light->matter_restore_attribute(chip::app::Clusters::ColorControl::Id, chip::app::Clusters::ColorControl::Attributes::CurrentHue::Id, eStateField::Hue);
+        light->matter_restore_attribute(chip::app::Clusters::ColorControl::Id, chip::app::Clusters::ColorControl::Attributes::EnhancedCurrentHue::Id, eStateField::EnhancedHue);
+        light->matter_restore_attribute(chip::app::Clusters::ColorControl::Id, chip::app::Clusters::ColorControl::Attributes::CurrentSaturation::Id, eStateField::Saturation);
+        uint16_t hue = state->get(eStateField::Hue);
+        if (hue != (state->get(eStateField::EnhancedHue) >> 8)) {
+            // last hue was set by 8-bit hue command
+            state->set(eStateField::EnhancedHue, (uint16_t)((uint32_t)hue * 65536 / 254), eStateSource::Restore);
+        }
+    }
+
+    template <typename L>
+    static void apply(L *light, uint32_t flags) {
+        // color loop 동작 중에는 hue를 realtime task가 직접 렌더링한다
+        CDeviceState *state = light->get_state();
+        if ((flags & DEVICE_STAGED_COLOR_HS) && !state->get_bool(eStateField::ColorLoopActive)) {
+            // one color change (one frame) for hue + saturation
+            light->get_output()->set_hue_saturation(state->get(eStateField::EnhancedHue), (uint8_t)state->get(eStateField::Saturation));
+        }
+    }
+
+private:
+    bool m_hue_updated_by_enhanced = false;
+
+    template <typename L>
+    static void on_change_current_hue(L *light, esp_matter_attr_val_t *value) {
+        /**
+        * enhanced hue 명령은 CurrentHue를 EnhancedCurrentHue의 상위 8비트로 함께 갱신한다
+        * 이 경우 16-bit 정밀도를 유지하기 위해 EnhancedCurrentHue 값을 그대로 사용한다
+        */
+        CLightFeatureHS *feature = light;
+        uint16_t hue = value->val.u8;
+        if (!feature->m_hue_updated_by_enhanced || hue != (light->get_state()->get(eStateField::EnhancedHue) >> 8)) {
+            feature->m_hue_updated_by_enhanced = false;
+            uint16_t enhanced_hue = (uint16_t)((uint32_t)hue * 65536 / 254);
+            if (light->get_state()->set(eStateField::EnhancedHue, enhanced_hue, eStateSource::Device)) {
+                light->stage(DEVICE_STAGED_COLOR_HS);
+            }
+        }
+    }
+
+    template <typename L>
+    static void on_change_enhanced_current_hue(L *light, esp_matter_attr_val_t *value) {
+        CLightFeatureHS *feature = light;
+        feature->m_hue_updated_by_enhanced = true;
+    }
+};
+
+/**
+ * @brief color loop (CL), hue is rendered frame by frame by the realtime task of the output
+ * the loop state is kept in the light state record (restored before the endpoint is created)
+ */
+class CLightFeatureColorLoop : public CLightFeature
+{
+public:
+    static constexpr eLightDeviceType device_type = eLightDeviceType::Color;
+    static constexpr uint32_t color_features = (1 << 2);
+    static constexpr bool saves_state = true;
+
+    template <typename L>
+    static constexpr std::array<matter_attribute_entry_t<L>, 4> entries() {
+        return {{
+            {MATTER_ATTRIBUTE(ColorControl, ColorLoopDirection), eStateField::ColorLoopDirection, DEVICE_STAGED_COLOR_LOOP, nullptr},
+            {MATTER_ATTRIBUTE(ColorControl, ColorLoopTime), eStateField::ColorLoopTime, DEVICE_STAGED_COLOR_LOOP, nullptr},
+            // ColorLoopSet command parameter, the same start hue may be written again
+            {MATTER_ATTRIBUTE(ColorControl, ColorLoopStartEnhancedHue), eStateField::ColorLoopStartHue, 0, &CLightFeatureColorLoop::on_change_start_enhanced_hue<L>, true},
+            {MATTER_ATTRIBUTE(ColorControl, ColorLoopActive), eStateField::ColorLoopActive, DEVICE_STAGED_COLOR_LOOP, nullptr},
+        }};
+    }
+
+    template <typename L>
+    static void add_features(L *light, esp_matter::cluster_t *cluster) {
+        // ColorLoopSet 명령 지원
+        CDeviceState *state = light->get_state();
+        esp_matter::cluster::color_control::feature::color_loop::config_t cfg;
+        cfg.color_loop_active = (uint8_t)state->get(eStateField::ColorLoopActive);
+        cfg.color_loop_direction = (uint8_t)state->get(eStateField::ColorLoopDirection);
+        cfg.color_loop_time = state->get(eStateField::ColorLoopTime);
+        cfg.color_loop_start_enhanced_hue = state->get(eStateField::ColorLoopStartHue);
+        cfg.color_loop_stored_enhanced_hue = 0;
+        light->matter_check_feature_result("color_loop", esp_matter::cluster::color_control::feature::color_loop::add(cluster, &cfg));
+    }
+
+    template <typename L>
+    static void restore(L *light, uint32_t *flags) {
+        if (light->get_state()->get_bool(eStateField::ColorLoopActive)) {
+            *flags |= DEVICE_STAGED_COLOR_LOOP;
+        }
+    }
+
+    template <typename L>
+    static void apply_effect(L *light, uint32_t *flags) {
+        static_assert(L::output_t::has_effects, "output of the light can't render the color loop");
+        if (!(*flags & DEVICE_STAGED_COLOR_LOOP)) {
+            return;
+        }
+
+        CLightFeatureColorLoop *feature = light;
+        CDeviceState *state = light->get_state();
+        auto *output = light->get_output();
+        bool running = output->is_color_loop_active();
+        if (state->get_bool(eStateField::ColorLoopActive)) {
+            /**
+            * 동작 중 direction/time 변경은 현재 hue에서 이어서 진행하고,
+            * 새로 시작하는 경우 ColorLoopSet 명령이 start hue를 지정했을 때만 ColorLoopStartEnhancedHue에서 시작한다
+            */
+            uint16_t start_hue;
+            if (running) {
+                start_hue = output->get_hue();
+            } else {
+                start_hue = state->get(feature->m_start_hue_updated ? eStateField::ColorLoopStartHue : eStateField::EnhancedHue);
+                /**
+                * 루프가 프레임마다 바꾸는 hue는 EnhancedCurrentHue로 보고한다 (quieter reporting)
+                * 시작/종료 시 즉시, 진행 중에는 DEVICE_REPORT_INTERVAL_MS 마다 최대 1회
+                */
+                state->set(eStateField::EnhancedHue, start_hue, eStateSource::Device);
+                feature->m_loop_frames.store(0);
+                output->set_hue_listener(&CLightFeatureColorLoop::on_color_loop_hue<L>, light);
+                light->begin_transition(chip::app::Clusters::ColorControl::Id, chip::app::Clusters::ColorControl::Attributes::EnhancedCurrentHue::Id, eStateField::EnhancedHue);
+            }
+            output->start_color_loop(
+                (uint8_t)state->get(eStateField::ColorLoopDirection),
+                state->get(eStateField::ColorLoopTime),
+                start_hue,
+                (uint8_t)state->get(eStateField::Saturation)
+            );
+        } else if (running) {
+            // 정지 시 서버가 복원한 EnhancedCurrentHue(ColorLoopStoredEnhancedHue)를 적용한다
+            output->stop_color_loop();
+            light->end_transition(chip::app::Clusters::ColorControl::Id, chip::app::Clusters::ColorControl::Attributes::EnhancedCurrentHue::Id, eStateField::EnhancedHue);
+            *flags |= DEVICE_STAGED_COLOR_HS;
+        }
+        feature->m_start_hue_updated = false;
+    }
+
+    /**
+     * @brief hue of the last rendered frame is applied to the state and reported (quieter reporting)
+     */
+    template <typename L>
+    static void sample(L *light) {
+        CLightFeatureColorLoop *feature = light;
+        CDeviceState *state = light->get_state();
+        uint32_t frames = feature->m_loop_frames.exchange(0);
+        // ColorLoopActive is cleared before the server restores EnhancedCurrentHue (stop), the restored value is kept
+        if (!frames || !state->get_bool(eStateField::ColorLoopActive)) {
+            return;
+        }
+        if (state->set(eStateField::EnhancedHue, (uint16_t)feature->m_loop_hue.load(), eStateSource::Device)) {
+            light->report_attribute(chip::app::Clusters::ColorControl::Id, chip::app::Clusters::ColorControl::Attributes::EnhancedCurrentHue::Id, eStateField::EnhancedHue, frames);
+        }
+    }
+
+private:
+    bool m_start_hue_updated = false;
+    std::atomic<uint32_t> m_loop_hue{0};        // hue of the last rendered frame
+    std::atomic<uint32_t> m_loop_frames{0};     // frames rendered since the last sample
+
+    template <typename L>
+    static void on_change_start_enhanced_hue(L *light, esp_matter_attr_val_t *value) {
+        CLightFeatureColorLoop *feature = light;
+        feature->m_start_hue_updated = true;
+    }
+
+    /**
+     * @brief every rendered frame (realtime task of the output), the hue is only stored
+     */
+    template <typename L>
+    static void on_color_loop_hue(void *context, uint16_t hue) {
+        CLightFeatureColorLoop *feature = static_cast<L *>(context);
+        feature->m_loop_hue.store(hue);
+        feature->m_loop_frames.fetch_add(1);
+    }
+};
+
+class CLightFeatureXY : public CLightFeature
+{
+public:
+    static constexpr eLightDeviceType device_type = eLightDeviceType::Color;
+    static constexpr uint32_t color_features = (1 << 3);
+    static constexpr int color_mode = 1;
+    static constexpr uint32_t staged_color = DEVICE_STAGED_COLOR_XY;
+
+    template <typename L>
+    static constexpr std::array<matter_attribute_entry_t<L>, 2> entries() {
+        return {{
+            {MATTER_ATTRIBUTE(ColorControl, CurrentX), eStateField::X, DEVICE_STAGED_COLOR_XY, nullptr},
+            {MATTER_ATTRIBUTE(ColorControl, CurrentY), eStateField::Y, DEVICE_STAGED_COLOR_XY, nullptr},
+        }};
+    }
+    static constexpr std::array<matter_attribute_batch_item_t, 2> publish_items() {
+        return {{
+            {chip::app::Clusters::ColorControl::Id, chip::app::Clusters::ColorControl::Attributes::CurrentX::Id, eStateField::X},
+            {chip::app::Clusters::ColorControl::Id, chip::app::Clusters::ColorControl::Attributes::CurrentY::Id, eStateField::Y},
+        }};
+    }
+
+    template <typename L>
+    static void add_features(L *light, esp_matter::cluster_t *cluster) {
+        esp_matter::cluster::color_control::feature::xy::config_t cfg;
+        cfg.current_x = light->get_state()->get(eStateField::X);
+        cfg.current_y = light->get_state()->get(eStateField::Y);
+        light->matter_check_feature_result("xy", esp_matter::cluster::color_control::feature::xy::add(cluster, &cfg));
+    }
+
+    template <typename L>
+    static void defer_persistence(L *light) {
+        light->matter_defer_persistence(chip::app::Clusters::ColorControl::Id, chip::app::Clusters::ColorControl::Attributes::CurrentX::Id);
+        light->matter_defer_persistence(chip::app::Clusters::ColorControl::Id, chip::app::Clusters::ColorControl::Attributes::CurrentY::Id);
+    }
+
+    template <typename L>
+    static void restore(L *light, uint32_t *flags) {
+        light->matter_restore_attribute(chip::app::Clusters::ColorControl::Id, chip::app::Clusters::ColorControl::Attributes::CurrentX::Id, eStateField::X);
+        light->matter_restore_attribute(chip::app::Clusters::ColorControl::Id, chip::app::Clusters::ColorControl::Attributes::CurrentY::Id, eStateField::Y);
+    }
+
+    template <typename L>
+    static void apply(L *light, uint32_t flags) {
+        CDeviceState *state = light->get_state();
+        if ((flags & DEVICE_STAGED_COLOR_XY) && !state->get_bool(eStateField::ColorLoopActive)) {
+            light->get_output()->set_xy(state->get(eStateField::X), state->get(eStateField::Y));
+        }
+    }
+};
+
+/**
+ * @brief color temperature (CT), rendered as the chromaticity on the planckian locus (see xy_t::from_mireds)
+ */
+class CLightFeatureCT : public CLightFeature
+{
+public:
+    static constexpr eLightDeviceType device_type = eLightDeviceType::Color;
+    static constexpr uint32_t color_features = (1 << 4);
+    static constexpr int color_mode = 2;
+    static constexpr uint32_t staged_color = DEVICE_STAGED_COLOR_CT;
+    static constexpr uint16_t min_mireds = 153;     // 6500K
+    static constexpr uint16_t max_mireds = 500;     // 2000K
+
+    template <typename L>
+    static constexpr std::array<matter_attribute_entry_t<L>, 1> entries() {
+        return {{
+            {MATTER_ATTRIBUTE(ColorControl, ColorTemperatureMireds), eStateField::ColorTemperature, DEVICE_STAGED_COLOR_CT, nullptr},
+        }};
+    }
+    static constexpr std::array<matter_attribute_batch_item_t, 1> publish_items() {
+        return {{
+            {chip::app::Clusters::ColorControl::Id, chip::app::Clusters::ColorControl::Attributes::ColorTemperatureMireds::Id, eStateField::ColorTemperature},
+        }};
+    }
+
+    template <typename L>
+    static void add_features(L *light, esp_matter::cluster_t *cluster) {
+        esp_matter::cluster::color_control::feature::color_temperature::config_t cfg;
+        cfg.color_temperature_mireds = light->get_state()->get(eStateField::ColorTemperature);
+        cfg.color_temp_physical_min_mireds = min_mireds;
+        cfg.color_temp_physical_max_mireds = max_mireds;
+        cfg.couple_color_temp_to_level_min_mireds = min_mireds;
+        light->matter_check_feature_result("color_temperature", esp_matter::cluster::color_control::feature::color_temperature::add(cluster, &cfg));
+    }
+
+    template <typename L>
+    static void defer_persistence(L *light) {
+        light->matter_defer_persistence(chip::app::Clusters::ColorControl::Id, chip::app::Clusters::ColorControl::Attributes::ColorTemperatureMireds::Id);
+    }
+
+    template <typename L>
+    static void restore(L *light, uint32_t *flags) {
+        light->matter_restore_attribute(chip::app::Clusters::ColorControl::Id, chip::app::Clusters::ColorControl::Attributes::ColorTemperatureMireds::Id, eStateField::ColorTemperature);
+    }
+
+    template <typename L>
+    static void apply(L *light, uint32_t flags) {
+        CDeviceState *state = light->get_state();
+        if ((flags & DEVICE_STAGED_COLOR_CT) && !state->get_bool(eStateField::ColorLoopActive)) {
+            light->get_output()->set_temperature(state->get(eStateField::ColorTemperature));
+        }
+    }
+};
+
+#endif
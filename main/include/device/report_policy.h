@@ -0,0 +1,95 @@
+#pragma once
+#ifndef _REPORT_POLICY_H_
+#define _REPORT_POLICY_H_
+
+#include <stdint.h>
+#include "device_state.h"
+#ifdef UNIT_TEST
+#include <mutex>
+#else
+#include "freertos/FreeRTOS.h"
+#endif
+
+/**
+ * @brief reporting of attributes driven by the device (transition, effect)
+ * follows the quieter reporting rule of Matter (ex: CurrentLevel, CurrentHue "Q" quality)
+ * - report when the change starts
+ * - report when the change completes
+ * - while in progress, report at most once per interval (value is held as pending)
+ * fields not in transition are reported right away
+ */
+class CReportPolicy
+{
+public:
+    CReportPolicy();
+    virtual ~CReportPolicy();
+
+public:
+    void set_interval(uint32_t interval_ms) { m_interval_us = (int64_t)interval_ms * 1000; }
+    uint32_t get_interval() { return (uint32_t)(m_interval_us / 1000); }
+
+    /**
+     * @return true report now (start of transition)
+     */
+    bool begin_transition(eStateField field, uint32_t cluster_id, uint32_t attribute_id, int64_t now_us);
+    /**
+     * @return true report now (final value)
+     */
+    bool end_transition(eStateField field, int64_t now_us);
+    bool is_in_transition(eStateField field);
+    bool has_transition();
+
+    /**
+     * @brief device changed the field
+     * @param[in] updates device updates merged into this request (ex: frames sampled by the report timer)
+     * @return true report now, false held as pending (see take_pending)
+     */
+    bool request(eStateField field, int64_t now_us, uint32_t updates = 1);
+
+    /**
+     * @brief pending field whose interval has passed (marked as reported)
+     * @return true cluster_id, attribute_id of the field are filled
+     */
+    bool take_pending(eStateField field, int64_t now_us, uint32_t *cluster_id, uint32_t *attribute_id);
+
+    /**
+     * @brief requested / reported updates per second since the last call (x10)
+     */
+    void get_rates(int64_t now_us, uint32_t *requested_x10, uint32_t *reported_x10);
+    /**
+     * @brief start a new rate window (next get_rates() covers the updates from now on)
+     */
+    void reset_rates(int64_t now_us);
+    uint32_t get_requested_count() { return m_requested_count; }
+    uint32_t get_reported_count() { return m_reported_count; }
+
+private:
+    struct field_t {
+        bool in_transition;
+        bool pending;
+        uint32_t cluster_id;
+        uint32_t attribute_id;
+        int64_t tm_last_report;
+    };
+    field_t m_fields[STATE_FIELD_COUNT];
+    int64_t m_interval_us;
+
+#ifdef UNIT_TEST
+    std::mutex m_mutex;
+#else
+    portMUX_TYPE m_lock;
+#endif
+
+    // statistics
+    uint32_t m_requested_count;
+    uint32_t m_reported_count;
+    uint32_t m_rate_requested_count;    // counts at the last get_rates()
+    uint32_t m_rate_reported_count;
+    int64_t m_tm_rate;
+
+    void lock();
+    void unlock();
+    void mark_reported(field_t *item, int64_t now_us);
+};
+
+#endif
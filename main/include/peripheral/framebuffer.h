@@ -0,0 +1,299 @@
+#ifndef _FRAMEBUFFER_H_
+#define _FRAMEBUFFER_H_
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+#include "definition.h"
+#include "led_chip.h"
+
+typedef enum {
+    FB_FORMAT_NATIVE = 0,   // chip wire order (3 or 4 bytes/pixel), zero-copy to rmt encoder
+    FB_FORMAT_PALETTE = 1,  // 1 byte/pixel + 256 entry palette (expanded to wire order while encoding)
+} eFrameBufferFormat;
+
+#define FB_PALETTE_SIZE     256
+
+template <typename CHIP>
+class CFrameBufferT
+{
+public:
+    CFrameBufferT();
+    virtual ~CFrameBufferT();
+
+public:
+    bool initialize(eFrameBufferFormat format, size_t pixel_count);
+    eFrameBufferFormat get_format();
+    const char* get_format_name();
+    size_t get_pixel_count();
+    size_t get_bytes_per_pixel();
+    size_t get_wire_bytes_per_pixel();
+    size_t get_memory_size();
+
+    bool set_pixel(int index, uint8_t red, uint8_t green, uint8_t blue);
+    bool get_pixel(int index, uint8_t *red, uint8_t *green, uint8_t *blue);
+    void fill(uint8_t red, uint8_t green, uint8_t blue);
+
+    bool set_palette_entry(uint8_t palette_index, uint8_t red, uint8_t green, uint8_t blue);
+    bool set_pixel_palette_index(int index, uint8_t palette_index);
+
+    /**
+     * @brief raw buffer passed to the rmt encoder
+     * NATIVE format: wire order pixel bytes
+     * PALETTE format: palette index per pixel (see get_palette_wire_entry)
+     */
+    const uint8_t* data();
+    size_t data_size();
+    inline const uint8_t* get_palette_wire_entry(uint8_t palette_index) {
+        return &m_palette[palette_index * CHIP::bytes_per_pixel];
+    }
+
+private:
+    eFrameBufferFormat m_format;
+    size_t m_pixel_count;
+    size_t m_bytes_per_pixel;
+    std::vector<uint8_t> m_buffer;
+    std::vector<uint8_t> m_palette;     // chip wire order
+    std::vector<uint16_t> m_palette_refs;   // pixels using the entry, 0 = free (drawing buffer only)
+    uint16_t m_palette_used;            // entries [0, used) have been allocated once
+
+    uint8_t find_palette_index(uint8_t red, uint8_t green, uint8_t blue);
+};
+
+typedef CFrameBufferT<led_chip_t> CFrameBuffer;
+
+template <typename CHIP>
+CFrameBufferT<CHIP>::CFrameBufferT()
+{
+    m_format = FB_FORMAT_NATIVE;
+    m_pixel_count = 0;
+    m_bytes_per_pixel = CHIP::bytes_per_pixel;
+    m_palette_used = 0;
+}
+
+template <typename CHIP>
+CFrameBufferT<CHIP>::~CFrameBufferT()
+{
+}
+
+template <typename CHIP>
+bool CFrameBufferT<CHIP>::initialize(eFrameBufferFormat format, size_t pixel_count)
+{
+    m_format = format;
+    m_pixel_count = pixel_count;
+
+    switch (m_format) {
+    case FB_FORMAT_NATIVE:
+        m_bytes_per_pixel = CHIP::bytes_per_pixel;
+        m_palette.clear();
+        m_palette_refs.clear();
+        break;
+    case FB_FORMAT_PALETTE:
+        if (pixel_count > UINT16_MAX) {
+            return false;
+        }
+        m_bytes_per_pixel = 1;
+        m_palette.assign(FB_PALETTE_SIZE * CHIP::bytes_per_pixel, 0);
+        m_palette_refs.assign(FB_PALETTE_SIZE, 0);
+        m_palette_refs[0] = (uint16_t)pixel_count;
+        break;
+    default:
+        return false;
+    }
+
+    m_buffer.assign(m_pixel_count * m_bytes_per_pixel, 0);
+    m_palette_used = 1;     // palette entry 0 = black
+
+    return true;
+}
+
+template <typename CHIP>
+eFrameBufferFormat CFrameBufferT<CHIP>::get_format()
+{
+    return m_format;
+}
+
+template <typename CHIP>
+const char* CFrameBufferT<CHIP>::get_format_name()
+{
+    switch (m_format) {
+    case FB_FORMAT_NATIVE: return "NATIVE";
+    case FB_FORMAT_PALETTE: return "PALETTE";
+    default: return "?";
+    }
+}
+
+template <typename CHIP>
+size_t CFrameBufferT<CHIP>::get_pixel_count()
+{
+    return m_pixel_count;
+}
+
+template <typename CHIP>
+size_t CFrameBufferT<CHIP>::get_bytes_per_pixel()
+{
+    return m_bytes_per_pixel;
+}
+
+template <typename CHIP>
+size_t CFrameBufferT<CHIP>::get_wire_bytes_per_pixel()
+{
+    return CHIP::bytes_per_pixel;
+}
+
+template <typename CHIP>
+size_t CFrameBufferT<CHIP>::get_memory_size()
+{
+    return m_buffer.size() + m_palette.size();
+}
+
+template <typename CHIP>
+bool CFrameBufferT<CHIP>::set_pixel(int index, uint8_t red, uint8_t green, uint8_t blue)
+{
+    if (index < 0 || (size_t)index >= m_pixel_count) {
+        return false;
+    }
+
+    if (m_format == FB_FORMAT_PALETTE) {
+        // release the old entry first, the last pixel of a color frees its entry for the new color
+        m_palette_refs[m_buffer[index]]--;
+        uint8_t palette_index = find_palette_index(red, green, blue);
+        m_palette_refs[palette_index]++;
+        m_buffer[index] = palette_index;
+    } else {
+        led_chip_pack<CHIP>(&m_buffer[index * CHIP::bytes_per_pixel], red, green, blue);
+    }
+
+    return true;
+}
+
+template <typename CHIP>
+bool CFrameBufferT<CHIP>::get_pixel(int index, uint8_t *red, uint8_t *green, uint8_t *blue)
+{
+    if (index < 0 || (size_t)index >= m_pixel_count) {
+        return false;
+    }
+
+    if (m_format == FB_FORMAT_PALETTE) {
+        led_chip_unpack<CHIP>(get_palette_wire_entry(m_buffer[index]), red, green, blue);
+    } else {
+        led_chip_unpack<CHIP>(&m_buffer[index * CHIP::bytes_per_pixel], red, green, blue);
+    }
+
+    return true;
+}
+
+template <typename CHIP>
+void CFrameBufferT<CHIP>::fill(uint8_t red, uint8_t green, uint8_t blue)
+{
+    if (m_format == FB_FORMAT_PALETTE) {
+        // single color frame uses only one palette entry
+        m_palette_used = 1;
+        std::fill(m_palette_refs.begin(), m_palette_refs.end(), 0);
+        m_palette_refs[0] = (uint16_t)m_pixel_count;
+        set_palette_entry(0, red, green, blue);
+        memset(m_buffer.data(), 0, m_buffer.size());
+        return;
+    }
+
+    uint8_t pixel[CHIP::bytes_per_pixel];
+    led_chip_pack<CHIP>(pixel, red, green, blue);
+    for (size_t i = 0; i < m_pixel_count; i++) {
+        memcpy(&m_buffer[i * CHIP::bytes_per_pixel], pixel, CHIP::bytes_per_pixel);
+    }
+}
+
+template <typename CHIP>
+bool CFrameBufferT<CHIP>::set_palette_entry(uint8_t palette_index, uint8_t red, uint8_t green, uint8_t blue)
+{
+    if (m_format != FB_FORMAT_PALETTE) {
+        return false;
+    }
+
+    led_chip_pack<CHIP>(&m_palette[palette_index * CHIP::bytes_per_pixel], red, green, blue);
+    if (palette_index >= m_palette_used) {
+        m_palette_used = palette_index + 1;
+    }
+
+    return true;
+}
+
+template <typename CHIP>
+bool CFrameBufferT<CHIP>::set_pixel_palette_index(int index, uint8_t palette_index)
+{
+    if (m_format != FB_FORMAT_PALETTE || index < 0 || (size_t)index >= m_pixel_count) {
+        return false;
+    }
+
+    m_palette_refs[m_buffer[index]]--;
+    m_palette_refs[palette_index]++;
+    m_buffer[index] = palette_index;
+    return true;
+}
+
+template <typename CHIP>
+const uint8_t* CFrameBufferT<CHIP>::data()
+{
+    return m_buffer.data();
+}
+
+template <typename CHIP>
+size_t CFrameBufferT<CHIP>::data_size()
+{
+    return m_buffer.size();
+}
+
+template <typename CHIP>
+uint8_t CFrameBufferT<CHIP>::find_palette_index(uint8_t red, uint8_t green, uint8_t blue)
+{
+    uint8_t pixel[CHIP::bytes_per_pixel];
+    led_chip_pack<CHIP>(pixel, red, green, blue);
+
+    // exact match among allocated entries (an unreferenced entry is reused as is)
+    int free_index = -1;
+    for (uint16_t i = 0; i < m_palette_used; i++) {
+        if (!memcmp(&m_palette[i * CHIP::bytes_per_pixel], pixel, CHIP::bytes_per_pixel)) {
+            return (uint8_t)i;
+        }
+        if (free_index < 0 && !m_palette_refs[i]) {
+            free_index = i;
+        }
+    }
+
+    // entry no pixel refers to anymore
+    if (free_index >= 0) {
+        memcpy(&m_palette[free_index * CHIP::bytes_per_pixel], pixel, CHIP::bytes_per_pixel);
+        return (uint8_t)free_index;
+    }
+
+    // allocate new entry
+    if (m_palette_used < FB_PALETTE_SIZE) {
+        uint8_t index = (uint8_t)m_palette_used;
+        memcpy(&m_palette[index * CHIP::bytes_per_pixel], pixel, CHIP::bytes_per_pixel);
+        m_palette_used++;
+        return index;
+    }
+
+    // more than FB_PALETTE_SIZE colors on the strip at once: nearest color (manhattan distance in wire order)
+    uint8_t nearest = 0;
+    int nearest_dist = 0x7FFFFFFF;
+    for (uint16_t i = 0; i < FB_PALETTE_SIZE; i++) {
+        const uint8_t *entry = &m_palette[i * CHIP::bytes_per_pixel];
+        int dist = 0;
+        for (size_t c = 0; c < CHIP::bytes_per_pixel; c++) {
+            dist += abs(entry[c] - pixel[c]);
+        }
+        if (dist < nearest_dist) {
+            nearest_dist = dist;
+            nearest = (uint8_t)i;
+        }
+    }
+
+    return nearest;
+}
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef _LED_CHIP_H_
+#define _LED_CHIP_H_
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "definition.h"
+
+/**
+ * @brief LED chip traits
+ * timing, reset length and wire channel order are fixed at compile time,
+ * so the pixel pack/unpack loop is specialized (branch-free) for each chip.
+ * order[i] = source channel index (0: red, 1: green, 2: blue, 3: white) of i-th wire byte
+ */
+struct led_chip_ws2812b
+{
+    static constexpr const char *name = "WS2812B";
+    static constexpr uint32_t t0h_ns = 300;
+    static constexpr uint32_t t0l_ns = 900;
+    static constexpr uint32_t t1h_ns = 900;
+    static constexpr uint32_t t1l_ns = 300;
+    static constexpr uint32_t reset_us = 300;
+    static constexpr size_t bytes_per_pixel = 3;
+    static constexpr uint8_t order[4] = {1, 0, 2, 3};   // G, R, B
+};
+
+struct led_chip_sk6812_rgbw
+{
+    static constexpr const char *name = "SK6812-RGBW";
+    static constexpr uint32_t t0h_ns = 300;
+    static constexpr uint32_t t0l_ns = 900;
+    static constexpr uint32_t t1h_ns = 600;
+    static constexpr uint32_t t1l_ns = 600;
+    static constexpr uint32_t reset_us = 80;
+    static constexpr size_t bytes_per_pixel = 4;
+    static constexpr uint8_t order[4] = {1, 0, 2, 3};   // G, R, B, W
+};
+
+struct led_chip_ws2811
+{
+    static constexpr const char *name = "WS2811";
+    static constexpr uint32_t t0h_ns = 500;
+    static constexpr uint32_t t0l_ns = 2000;
+    static constexpr uint32_t t1h_ns = 1200;
+    static constexpr uint32_t t1l_ns = 1300;
+    static constexpr uint32_t reset_us = 280;
+    static constexpr size_t bytes_per_pixel = 3;
+    static constexpr uint8_t order[4] = {0, 1, 2, 3};   // R, G, B
+};
+
+struct led_chip_apa106
+{
+    static constexpr const char *name = "APA106";
+    static constexpr uint32_t t0h_ns = 350;
+    static constexpr uint32_t t0l_ns = 1360;
+    static constexpr uint32_t t1h_ns = 1360;
+    static constexpr uint32_t t1l_ns = 350;
+    static constexpr uint32_t reset_us = 50;
+    static constexpr size_t bytes_per_pixel = 3;
+    static constexpr uint8_t order[4] = {0, 1, 2, 3};   // R, G, B
+};
+
+#if LED_CHIP_TYPE == 0
+typedef led_chip_ws2812b led_chip_t;
+#elif LED_CHIP_TYPE == 1
+typedef led_chip_sk6812_rgbw led_chip_t;
+#elif LED_CHIP_TYPE == 2
+typedef led_chip_ws2811 led_chip_t;
+#elif LED_CHIP_TYPE == 3
+typedef led_chip_apa106 led_chip_t;
+#else
+#error "invalid LED_CHIP_TYPE"
+#endif
+
+/**
+ * @brief convert duration to rmt ticks at compile time
+ */
+constexpr uint32_t led_chip_ns_to_ticks(uint32_t duration_ns, uint32_t resolution_hz)
+{
+    return (uint32_t)((uint64_t)duration_ns * resolution_hz / 1000000000ULL);
+}
+
+/**
+ * @brief pack rgb color to chip wire order
+ * common white part is moved to the W channel for 4 bytes/pixel chips
+ */
+template <typename CHIP>
+inline void led_chip_pack(uint8_t *dst, uint8_t red, uint8_t green, uint8_t blue)
+{
+    uint8_t src[4] = {red, green, blue, 0};
+    if constexpr (CHIP::bytes_per_pixel == 4) {
+        uint8_t white = MIN(red, MIN(green, blue));
+        src[0] -= white;
+        src[1] -= white;
+        src[2] -= white;
+        src[3] = white;
+    }
+    for (size_t i = 0; i < CHIP::bytes_per_pixel; i++) {
+        dst[i] = src[CHIP::order[i]];
+    }
+}
+
+/**
+ * @brief unpack chip wire order bytes to rgb color
+ */
+template <typename CHIP>
+inline void led_chip_unpack(const uint8_t *src, uint8_t *red, uint8_t *green, uint8_t *blue)
+{
+    uint8_t dst[4] = {0, 0, 0, 0};
+    for (size_t i = 0; i < CHIP::bytes_per_pixel; i++) {
+        dst[CHIP::order[i]] = src[i];
+    }
+    *red = dst[0] + dst[3];
+    *green = dst[1] + dst[3];
+    *blue = dst[2] + dst[3];
+}
+
+#endif
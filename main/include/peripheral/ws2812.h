@@ -5,10 +5,12 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "driver/rmt_tx.h"
 #include <stdint.h>
 #include <vector>
 #include "definition.h"
+#include "framebuffer.h"
 
 struct rgb_t
 {
@@ -24,104 +26,185 @@ struct hsv_t
 {
     /**
      * @brief 
-     * hue range: [0, 360] degree
-     * saturation range: [0, 100]
-     * value range: [0, 100]
+     * hue range: [0, 65535] (= hue / 65536 * 360 degree, Matter EnhancedCurrentHue encoding)
+     * saturation range: [0, 65535]
+     * value range: [0, 65535]
      */
-    uint32_t hue;           // 색상
-    uint32_t saturation;    // 채도
-    uint32_t value;         // 명도
-    hsv_t(uint32_t h = 0, uint32_t s = 0, uint32_t v = 100) {
-        hue = MIN(360, h);
-        saturation = MIN(100, s);
-        value = MIN(100, v);
+    uint16_t hue;           // 색상
+    uint16_t saturation;    // 채도
+    uint16_t value;         // 명도
+    hsv_t(uint16_t h = 0, uint16_t s = 0, uint16_t v = 65535) {
+        hue = h;
+        saturation = s;
+        value = v;
     }
 
     rgb_t conv2rgb() {
         /**
-         * @brief HSV to RGB conversion formula
+         * @brief HSV to RGB conversion formula (16-bit fixed-point)
          * @ref https://en.wikipedia.org/wiki/HSL_and_HSV
+         * every intermediate value is kept in 16-bit precision,
+         * conversion to 8-bit color happens only at the final step.
          */
         rgb_t rgb;
 
-        /*
-        double Sv = saturation / 100.;
-        double V = value / 100.;
-        double H = hue / 60.;
-        
-        double C = V * Sv;  // Chroma
-        double X = C * (1 - abs(int(H) % 2 - 1));
-
-        double R1, G1, B1;
-        if (H < 1.) {
-            R1 = C; G1 = X; B1 = 0.;
-        } else if (H >= 1. && H < 2.) {
-            R1 = X; G1 = C; B1 = 0.;
-        } else if (H >= 2. && H < 3.) {
-            R1 = 0.; G1 = C; B1 = X;
-        } else if (H >= 3. && H < 4.) {
-            R1 = 0.; G1 = X; B1 = C;
-        } else if (H >= 4. && H < 5.) {
-            R1 = X; G1 = 0.; B1 = C;
-        } else {
-            R1 = C; G1 = 0.; B1 = X;
-        }
-
-        double m = V - C;
-        rgb.r = (uint8_t)((R1 + m) * 255.);
-        rgb.g = (uint8_t)((G1 + m) * 255.);
-        rgb.b = (uint8_t)((B1 + m) * 255.);
-        */
-
-        
-        uint32_t h = hue % 360;
-        uint32_t rgb_max = value * 2.55f;
-        uint32_t rgb_min = rgb_max * (100 - saturation) / 100.0f;
-
-        uint32_t i = h / 60;
-        uint32_t diff = h % 60;
+        uint32_t h = (uint32_t)hue * 6;     // [0, 6 * 65536)
+        uint32_t i = h >> 16;               // hue sector
+        uint32_t diff = h & 0xFFFF;         // position in sector (Q16)
+        uint32_t rgb_max = value;
+        uint32_t rgb_min = rgb_max * (65535 - saturation) / 65535;
 
         // RGB adjustment amount by hue
-        uint32_t rgb_adj = (rgb_max - rgb_min) * diff / 60;
+        uint32_t rgb_adj = ((rgb_max - rgb_min) * diff) >> 16;
 
+        uint32_t r, g, b;
         switch (i) {
         case 0:
-            rgb.r = rgb_max;
-            rgb.g = rgb_min + rgb_adj;
-            rgb.b = rgb_min;
+            r = rgb_max;
+            g = rgb_min + rgb_adj;
+            b = rgb_min;
             break;
         case 1:
-            rgb.r = rgb_max - rgb_adj;
-            rgb.g = rgb_max;
-            rgb.b = rgb_min;
+            r = rgb_max - rgb_adj;
+            g = rgb_max;
+            b = rgb_min;
             break;
         case 2:
-            rgb.r = rgb_min;
-            rgb.g = rgb_max;
-            rgb.b = rgb_min + rgb_adj;
+            r = rgb_min;
+            g = rgb_max;
+            b = rgb_min + rgb_adj;
             break;
         case 3:
-            rgb.r = rgb_min;
-            rgb.g = rgb_max - rgb_adj;
-            rgb.b = rgb_max;
+            r = rgb_min;
+            g = rgb_max - rgb_adj;
+            b = rgb_max;
             break;
         case 4:
-            rgb.r = rgb_min + rgb_adj;
-            rgb.g = rgb_min;
-            rgb.b = rgb_max;
+            r = rgb_min + rgb_adj;
+            g = rgb_min;
+            b = rgb_max;
             break;
         default:
-            rgb.r = rgb_max;
-            rgb.g = rgb_min;
-            rgb.b = rgb_max - rgb_adj;
+            r = rgb_max;
+            g = rgb_min;
+            b = rgb_max - rgb_adj;
             break;
         }
 
+        rgb.r = (uint8_t)((r * 255 + 32767) / 65535);
+        rgb.g = (uint8_t)((g * 255 + 32767) / 65535);
+        rgb.b = (uint8_t)((b * 255 + 32767) / 65535);
+
         return rgb;
     }
 
 };
 
+struct xy_t
+{
+    /**
+     * @brief CIE 1931 chromaticity coordinate (Matter CurrentX, CurrentY encoding)
+     * x range: [0, 65279] (= x * 65536)
+     * y range: [0, 65279] (= y * 65536)
+     */
+    uint16_t x;
+    uint16_t y;
+    xy_t(uint16_t cx = 20493, uint16_t cy = 21561) {
+        // default = D65 white point (0.3127, 0.3290)
+        x = cx;
+        y = cy;
+    }
+
+    rgb_t conv2rgb() {
+        /**
+         * @brief xyY to linear RGB conversion (fixed-point)
+         * @ref http://www.brucelindbloom.com/index.html?Eqn_XYZ_to_RGB.html
+         * luminance(Y) is controlled by pwm brightness, so every XYZ component is scaled by y
+         * (X = x, Y = y, Z = 1 - x - y) and the result is normalized to the maximum channel.
+         * no division by y is required and the whole conversion stays in 32-bit integer range.
+         */
+        rgb_t rgb;
+
+        int32_t X = x;
+        int32_t Y = y;
+        int32_t Z = MAX(0, 65536 - X - Y);
+
+        // sRGB (D65) XYZ -> linear RGB matrix, Q12 fixed-point coefficient (round to nearest)
+        int32_t r =  13273 * X - 6296 * Y - 2042 * Z;
+        int32_t g =  -3970 * X + 7684 * Y +  170 * Z;
+        int32_t b =    228 * X -  836 * Y + 4330 * Z;
+
+        // gamut clamp: out-of-gamut color is desaturated toward white (hue preserved)
+        int32_t min_value = MIN(r, MIN(g, b));
+        if (min_value < 0) {
+            r -= min_value;
+            g -= min_value;
+            b -= min_value;
+        }
+
+        uint32_t ur = (uint32_t)r >> 8;
+        uint32_t ug = (uint32_t)g >> 8;
+        uint32_t ub = (uint32_t)b >> 8;
+        uint32_t max_value = MAX(ur, MAX(ug, ub));
+        if (!max_value) {
+            return rgb;
+        }
+
+        rgb.r = (uint8_t)((ur * 255 + max_value / 2) / max_value);
+        rgb.g = (uint8_t)((ug * 255 + max_value / 2) / max_value);
+        rgb.b = (uint8_t)((ub * 255 + max_value / 2) / max_value);
+
+        return rgb;
+    }
+
+    static xy_t from_mireds(uint16_t mireds) {
+        /**
+         * @brief color temperature (Matter ColorTemperatureMireds) to chromaticity on the planckian locus
+         * @ref Kim et al., "Design of Advanced Color Temperature Control System for HDTV Applications" (cubic spline, 1667K ~ 25000K)
+         */
+        float t = 1000000.f / (float)MAX(mireds, 1);
+        t = MIN(MAX(t, 1667.f), 25000.f);
+        float t2 = t * t;
+        float t3 = t2 * t;
+        float cx, cy;
+        if (t <= 4000.f) {
+            cx = -0.2661239e9f / t3 - 0.2343589e6f / t2 + 0.8776956e3f / t + 0.179910f;
+        } else {
+            cx = -3.0258469e9f / t3 + 2.1070379e6f / t2 + 0.2226347e3f / t + 0.240390f;
+        }
+        float cx2 = cx * cx;
+        float cx3 = cx2 * cx;
+        if (t <= 2222.f) {
+            cy = -1.1063814f * cx3 - 1.34811020f * cx2 + 2.18555832f * cx - 0.20219683f;
+        } else if (t <= 4000.f) {
+            cy = -0.9549476f * cx3 - 1.37418593f * cx2 + 2.09137015f * cx - 0.16748867f;
+        } else {
+            cy = 3.0817580f * cx3 - 5.87338670f * cx2 + 3.75112997f * cx - 0.37001483f;
+        }
+        return xy_t((uint16_t)(cx * 65536.f), (uint16_t)(cy * 65536.f));
+    }
+};
+
+/**
+ * @brief pixel range of the strip controlled by one matter endpoint
+ * rendered into the shared framebuffer by the realtime task (color * level)
+ */
+typedef struct led_segment_t
+{
+    uint16_t endpoint_id;
+    uint16_t pixel_start;
+    uint16_t pixel_count;
+    bool on;
+    uint8_t level;      // 0 ~ 254
+    rgb_t color;        // color at full level
+    bool dirty;
+} led_segment_t;
+
+/**
+ * @brief hue of the rendered color loop frame (called in the realtime task, should only store the value)
+ */
+typedef void (*color_loop_listener_t)(void *context, uint16_t hue);
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -140,35 +223,86 @@ public:
     bool update_color();
     bool clear_color();
 
-    bool set_brightness(uint8_t value, bool save_memory = true, bool verbose = true);
+    bool set_brightness(uint8_t value, bool verbose = true);
     uint8_t get_brightness();
     
     rgb_t get_common_color();
-    bool set_common_color(uint8_t red, uint8_t green, uint8_t blue, bool save_memory = true);
+    bool set_common_color(uint8_t red, uint8_t green, uint8_t blue);
 
     bool set_hue(uint16_t hue, bool update_color = true);
-    bool set_saturation(uint8_t saturation, bool update_color = true);
-    bool set_temperature(uint32_t temperature);
+    bool set_saturation(uint16_t saturation, bool update_color = true);
+    bool set_cie_x(uint16_t x, bool update_color = true);
+    bool set_cie_y(uint16_t y, bool update_color = true);
+    bool set_temperature(uint16_t mireds, bool update_color = true);
+    uint16_t get_hue();
+
+    bool set_color_loop(bool active, uint8_t direction = 1, uint16_t time_sec = 25, uint16_t start_hue = 0);
+    bool is_color_loop_active();
+    void set_color_loop_listener(color_loop_listener_t listener, void *context);
+
+    /**
+     * @return int segment index (-1 = table full)
+     */
+    int add_segment(uint16_t endpoint_id, int pixel_start, int pixel_count);
+    int find_segment(uint16_t endpoint_id);
+    bool set_segment_state(int segment, bool on, uint8_t level);
+    bool set_segment_color(int segment, uint8_t red, uint8_t green, uint8_t blue);
+    /**
+     * @brief segment updates between begin_frame() and end_frame() are sent as one frame
+     */
+    void begin_frame();
+    void end_frame();
 
     bool blink(uint32_t duration_ms = 1000, uint32_t count = 1);
     bool blink_demo();
+    void print_framebuffer_info();
 
 private:
     static CWS2812Ctrl *_instance;
     bool m_initialized;
     uint8_t m_brightness;
+    int m_pwm_duty;                     // applied duty (-1 = unknown)
     rgb_t m_common_color;
+    bool m_common_color_applied;        // framebuffer holds m_common_color and has been queued for transmit
     hsv_t m_hsv_value;
-    std::vector<rgb_t> m_pixel_values;
+    xy_t m_xy_value;
+    /**
+     * written by any task while holding m_framebuffer_mutex, the realtime task holds it from rmt_transmit
+     * to rmt_tx_wait_all_done (rmt reads the buffer zero-copy, drawing never tears a frame in transmission)
+     */
+    CFrameBuffer m_framebuffer;
+    SemaphoreHandle_t m_framebuffer_mutex;
     uint32_t m_blink_duration_ms;
     uint32_t m_blink_count;
     QueueHandle_t m_queue_command;
     TaskHandle_t m_task_handle;
     bool m_keep_task_alive;
+
+    // color loop (rendered by realtime task at frame rate)
+    bool m_color_loop_active;
+    uint8_t m_color_loop_direction;
+    uint16_t m_color_loop_start_hue;
+    uint32_t m_color_loop_step;         // hue step per millisecond (Q16.16)
+    uint32_t m_color_loop_hue_acc;      // current hue (Q16.16)
+    int64_t m_color_loop_tick_us;
+    color_loop_listener_t m_color_loop_listener;
+    void *m_color_loop_listener_context;
+
+    // segments (rendered by realtime task)
+    led_segment_t m_segments[WS2812_SEGMENT_MAX];
+    int m_segment_count;
+    portMUX_TYPE m_segment_lock;
+    int m_frame_depth;
+    bool m_frame_requested;             // frame command queued or held by begin_frame()
     
     bool init_ledc();
     bool init_rmt();
     bool set_pwm_duty(uint32_t duty, bool verbose = true);
+    bool send_command(int command);
+    bool transmit_pixel_values(int timeout_ms);
+    void render_color_loop();
+    bool request_frame();
+    void render_segments();
 
     static void func_command(void *param);
 
@@ -180,6 +314,17 @@ private:
     rmt_encoder_handle_t m_rmt_enc_copy;
     rmt_symbol_word_t m_rmt_reset_code;
     int m_rmt_state;
+    size_t m_rmt_pixel_index;
+
+    // framebuffer encode statistics
+    uint32_t m_stat_frame_count;
+    uint64_t m_stat_encode_cycles;
+    uint64_t m_stat_transmit_us;
+    uint32_t m_stat_transmit_us_max;
+    uint32_t m_stat_skip_duty_count;    // unchanged value, hardware access avoided
+    uint32_t m_stat_skip_color_count;
+    uint32_t m_stat_segment_update_count;
+    uint32_t m_stat_segment_frame_count;
 
 public:
     rmt_channel_handle_t get_rmt_channel();
@@ -189,6 +334,10 @@ public:
     rmt_symbol_word_t get_rmt_reset_code();
     int get_rmt_state();
     void set_rmt_state(int value);
+    size_t get_rmt_pixel_index();
+    void set_rmt_pixel_index(size_t value);
+    CFrameBuffer* get_framebuffer();    // read by the rmt encoder while transmit_pixel_values() holds the mutex
+    void add_rmt_encode_cycles(uint32_t cycles);
 };
 
 inline CWS2812Ctrl* GetWS2812Ctrl() {
@@ -0,0 +1,32 @@
+#ifndef _CRC32_H_
+#define _CRC32_H_
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#ifndef UNIT_TEST
+#include "esp_rom_crc.h"
+#endif
+
+/**
+ * @brief crc32 (reflected, polynomial 0xEDB88320, same as zlib crc32)
+ * rom implementation on target, bitwise fallback on host (UNIT_TEST)
+ */
+inline uint32_t calc_crc32(const void *data, size_t size, uint32_t crc = 0)
+{
+#ifdef UNIT_TEST
+    const uint8_t *ptr = (const uint8_t *)data;
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= ptr[i];
+        for (int b = 0; b < 8; b++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+#else
+    return esp_rom_crc32_le(crc, (const uint8_t *)data, (uint32_t)size);
+#endif
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef _HISTOGRAM_H_
+#define _HISTOGRAM_H_
+#pragma once
+
+#include <stdint.h>
+
+#define HISTOGRAM_BUCKET_COUNT  16
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief duration histogram with power of 2 buckets (us)
+ * bucket 0 = 0 us, bucket n = [2^(n-1), 2^n) us, last bucket holds everything above
+ * add() is a few instructions (no lock), single writer is assumed
+ */
+class CHistogram
+{
+public:
+    CHistogram();
+    virtual ~CHistogram();
+
+public:
+    void add(uint32_t value_us);
+    void reset();
+
+    uint32_t get_count() { return m_count; }
+    uint32_t get_max() { return m_max; }
+    uint32_t get_average();
+    /**
+     * @brief upper bound of the bucket containing the percentile
+     * @param[in] percent 1 ~ 100
+     */
+    uint32_t get_percentile(uint32_t percent);
+
+    /**
+     * @brief ex) "Attribute Callback: 120 times, avg 3 us, max 40 us, p50 < 4 us, p99 < 64 us"
+     *            "  [1-2): 10"
+     *            "  [2-4): 100"
+     *            "  [32-64): 10"
+     */
+    void print(const char *name);
+
+private:
+    uint32_t m_buckets[HISTOGRAM_BUCKET_COUNT];
+    uint32_t m_count;
+    uint32_t m_max;
+    uint64_t m_total;
+
+    static uint32_t get_bucket_index(uint32_t value_us);
+    static uint32_t get_bucket_upper(uint32_t index);
+};
+
+#ifdef __cplusplus
+};
+#endif
+#endif
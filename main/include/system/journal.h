@@ -0,0 +1,88 @@
+#ifndef _JOURNAL_H_
+#define _JOURNAL_H_
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "journal_flash.h"
+
+#define JOURNAL_PARTITION_LABEL     "journal"
+#define JOURNAL_SECTOR_MAGIC        0x4C4E524A  // "JRNL"
+#define JOURNAL_MAX_STATE_SIZE      240
+
+/**
+ * @brief flash layout (every sector)
+ * [sector header][record][record]...[0xFF...]
+ * - sector header is written last (after the snapshot record), sector without valid header is ignored
+ * - first record of a sector is always a snapshot of the whole state
+ * - following records are deltas (changed byte ranges) with increasing sequence number
+ * - when a sector is full, the next sector is erased and starts with a snapshot (compaction)
+ * - record with crc mismatch (torn write) terminates the sector, unclean tail triggers compaction
+ */
+struct __attribute__((packed)) journal_sector_header_t
+{
+    uint32_t magic;
+    uint32_t sector_seq;
+    uint32_t reserved;
+    uint32_t crc;           // crc32 of [magic, sector_seq, reserved]
+};
+
+struct __attribute__((packed)) journal_record_header_t
+{
+    uint8_t type;           // eJournalRecordType (0xFF = erased)
+    uint8_t length;         // payload length
+    uint16_t reserved;
+    uint32_t seq;
+    uint32_t crc;           // crc32 of [type, length, reserved, seq] + payload
+};
+
+typedef enum {
+    JOURNAL_RECORD_SNAPSHOT = 0x01,   // payload = whole state
+    JOURNAL_RECORD_DELTA = 0x02,      // payload = [offset, length, data...] * n
+} eJournalRecordType;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+class CStateJournal
+{
+public:
+    CStateJournal();
+    virtual ~CStateJournal();
+
+public:
+    bool initialize(CJournalFlash *flash);
+    bool load(void *state, size_t size, size_t *read_size);
+    bool append(const void *state, size_t size);
+    bool has_state();
+    void print_journal_info();
+
+private:
+    CJournalFlash *m_flash;
+    size_t m_sector_size;
+    size_t m_sector_count;
+    int m_active_sector;
+    uint32_t m_sector_seq;
+    uint32_t m_record_seq;
+    size_t m_write_offset;      // in active sector
+    std::vector<uint8_t> m_state;   // state on flash
+
+    // statistics
+    uint32_t m_append_count;
+    uint32_t m_compaction_count;
+    uint32_t m_bytes_written;
+
+    bool read_sector_header(int sector, uint32_t *sector_seq);
+    bool scan_sector(int sector, std::vector<uint8_t> *state, uint32_t *last_seq, size_t *end_offset);
+    bool is_erased(size_t offset, size_t size);
+    bool write_record(uint8_t type, const uint8_t *payload, size_t length);
+    bool compact(const uint8_t *state, size_t size);
+    static size_t record_size(size_t length);
+};
+
+#ifdef __cplusplus
+}
+#endif
+#endif
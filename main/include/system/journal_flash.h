@@ -0,0 +1,86 @@
+#ifndef _JOURNAL_FLASH_H_
+#define _JOURNAL_FLASH_H_
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#ifndef UNIT_TEST
+#include "esp_partition.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief raw flash region used by CStateJournal
+ * NOR flash semantics: erase sets every byte to 0xFF, write can only clear bits
+ */
+class CJournalFlash
+{
+public:
+    virtual ~CJournalFlash() {}
+
+public:
+    virtual size_t get_size() = 0;
+    virtual size_t get_sector_size() = 0;
+    virtual bool read(size_t offset, void *out, size_t size) = 0;
+    virtual bool write(size_t offset, const void *data, size_t size) = 0;
+    virtual bool erase_sector(size_t offset) = 0;
+};
+
+#ifndef UNIT_TEST
+/**
+ * @brief flash partition (partitions.csv)
+ */
+class CJournalFlashPartition : public CJournalFlash
+{
+public:
+    CJournalFlashPartition();
+    virtual ~CJournalFlashPartition();
+
+public:
+    bool initialize(const char *label);
+    size_t get_size() override;
+    size_t get_sector_size() override;
+    bool read(size_t offset, void *out, size_t size) override;
+    bool write(size_t offset, const void *data, size_t size) override;
+    bool erase_sector(size_t offset) override;
+
+private:
+    const esp_partition_t *m_partition;
+};
+#else
+/**
+ * @brief file-backed partition image (host unit test)
+ * write_limit simulates power loss: writes stop after the given number of bytes
+ */
+class CJournalFlashFile : public CJournalFlash
+{
+public:
+    CJournalFlashFile();
+    virtual ~CJournalFlashFile();
+
+public:
+    bool initialize(const char *path, size_t size, size_t sector_size = 4096);
+    size_t get_size() override;
+    size_t get_sector_size() override;
+    bool read(size_t offset, void *out, size_t size) override;
+    bool write(size_t offset, const void *data, size_t size) override;
+    bool erase_sector(size_t offset) override;
+
+    void set_write_limit(size_t bytes);
+
+private:
+    std::string m_path;
+    size_t m_size;
+    size_t m_sector_size;
+    size_t m_write_limit;
+};
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,88 @@
+#ifndef _LOG_CRASH_RING_H_
+#define _LOG_CRASH_RING_H_
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define LOG_CRASH_RING_MAGIC    0x474F4C52  // "RLOG"
+
+/**
+ * @brief memory layout (memory survives software reset, ex: RTC_NOINIT)
+ * [header][record][record]...
+ * - data area size is rounded down to power of 2
+ * - record = [length (2)][checksum (1)][reserved (1)][data...], 4 bytes aligned, wraps around the data area
+ * - head, tail are free running byte counters, oldest records are overwritten
+ * - record data is written before head is advanced, a reset during append loses only that record
+ * - header crc covers the static part (magic, size, app_id), firmware change invalidates the ring
+ *   (records hold addresses of the firmware image)
+ */
+typedef struct log_crash_ring_header_t
+{
+    uint32_t magic;
+    uint32_t size;              // data area size
+    uint32_t app_id;
+    uint32_t crc;               // crc32 of [magic, size, app_id]
+    volatile uint32_t head;
+    volatile uint32_t tail;
+} log_crash_ring_header_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+class CLogCrashRing
+{
+public:
+    CLogCrashRing();
+    virtual ~CLogCrashRing();
+
+public:
+    /**
+     * @brief 메모리 영역 연결, 이전 내용이 유효하지 않으면 초기화
+     * @param[in] memory 리셋 후에도 유지되는 메모리
+     * @param[in] size 메모리 크기 (header 포함)
+     * @param[in] app_id 펌웨어 식별자
+     * @return true 이전 부팅의 record가 유효함
+     * @return false 초기화됨
+     */
+    bool attach(void *memory, size_t size, uint32_t app_id);
+
+    /**
+     * @brief record 추가 (data1 + data2), 공간이 부족하면 가장 오래된 record부터 덮어쓴다
+     * locking은 호출하는 쪽에서
+     */
+    bool append(const void *data1, size_t size1, const void *data2, size_t size2);
+
+    /**
+     * @brief cursor 위치의 record를 읽고 cursor를 다음 record로 이동
+     * @param[in,out] cursor get_tail()로 시작
+     * @param[in] end 읽기 종료 위치 (ex: attach 직후의 get_head())
+     * @return int record 크기 (-1 = 끝 또는 손상)
+     */
+    int read(uint32_t *cursor, uint32_t end, void *out, size_t out_size);
+
+    /**
+     * @brief end 이전의 record 삭제
+     */
+    void discard(uint32_t end);
+
+    uint32_t get_head();
+    uint32_t get_tail();
+    size_t get_size();
+
+private:
+    log_crash_ring_header_t *m_header;
+    uint8_t *m_data;
+    size_t m_size;
+
+    bool validate();
+    void copy_in(uint32_t pos, const void *data, size_t size);
+    void copy_out(uint32_t pos, void *out, size_t size);
+    static uint8_t calc_checksum(uint8_t checksum, const void *data, size_t size);
+};
+
+#ifdef __cplusplus
+}
+#endif
+#endif
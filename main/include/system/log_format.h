@@ -0,0 +1,144 @@
+#ifndef _LOG_FORMAT_H_
+#define _LOG_FORMAT_H_
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdarg.h>
+#include <type_traits>
+
+#define MAXLEN_LOG_ARGS         128     // encoded arguments per message
+#define MAXLEN_LOG_ARG_STRING   64      // %s argument is truncated
+
+/**
+ * @brief deferred formatting: arguments are stored raw and formatted later (drain task or host decoder)
+ * encoded argument = [tag][value]
+ * - LOG_ARG_INT32   : 4 bytes (little endian)
+ * - LOG_ARG_INT64   : 8 bytes
+ * - LOG_ARG_DOUBLE  : 8 bytes (IEEE 754)
+ * - LOG_ARG_STRING  : [length (1 byte)][bytes...] (not null-terminated)
+ * - LOG_ARG_POINTER : 4 bytes (target address)
+ * argument that doesn't fit in the buffer is replaced by LOG_ARG_TRUNCATED and the rest is dropped
+ */
+typedef enum {
+    LOG_ARG_INT32 = 'i',
+    LOG_ARG_INT64 = 'I',
+    LOG_ARG_DOUBLE = 'd',
+    LOG_ARG_STRING = 's',
+    LOG_ARG_POINTER = 'p',
+    LOG_ARG_TRUNCATED = 't',
+} eLogArgType;
+
+class CLogArgEncoder
+{
+public:
+    CLogArgEncoder(uint8_t *buffer, size_t capacity) : m_buffer(buffer), m_capacity(capacity), m_size(0), m_truncated(false) {}
+
+    size_t size() const { return m_size; }
+
+    void add(const char *value) {
+        if (!value) {
+            value = "(null)";
+        }
+        size_t length = 0;
+        while (length < MAXLEN_LOG_ARG_STRING && value[length]) {
+            length++;
+        }
+        if (reserve(2 + length)) {
+            m_buffer[m_size++] = LOG_ARG_STRING;
+            m_buffer[m_size++] = (uint8_t)length;
+            memcpy(&m_buffer[m_size], value, length);
+            m_size += length;
+        }
+    }
+    void add(char *value) { add((const char *)value); }
+    void add(float value) { add((double)value); }
+    void add(double value) { put(LOG_ARG_DOUBLE, &value, sizeof(value)); }
+    void add(bool value) { add((int32_t)value); }
+
+    template<typename T>
+    void add(T value) {
+        if constexpr (std::is_enum<T>::value) {
+            add((typename std::underlying_type<T>::type)value);
+        } else if constexpr (std::is_pointer<T>::value || std::is_null_pointer<T>::value) {
+            uint32_t address = (uint32_t)(uintptr_t)value;
+            put(LOG_ARG_POINTER, &address, sizeof(address));
+        } else if constexpr (std::is_integral<T>::value && sizeof(T) <= 4) {
+            int32_t temp = (int32_t)value;
+            put(LOG_ARG_INT32, &temp, sizeof(temp));
+        } else {
+            static_assert(std::is_integral<T>::value || std::is_floating_point<T>::value, "unsupported log argument type");
+            if constexpr (std::is_floating_point<T>::value) {
+                add((double)value);
+            } else {
+                int64_t temp = (int64_t)value;
+                put(LOG_ARG_INT64, &temp, sizeof(temp));
+            }
+        }
+    }
+
+private:
+    uint8_t *m_buffer;
+    size_t m_capacity;
+    size_t m_size;
+    bool m_truncated;
+
+    bool reserve(size_t size) {
+        if (m_truncated) {
+            return false;
+        }
+        if (m_size + size > m_capacity) {
+            if (m_size < m_capacity) {
+                m_buffer[m_size++] = LOG_ARG_TRUNCATED;
+            }
+            m_truncated = true;
+            return false;
+        }
+        return true;
+    }
+
+    void put(uint8_t tag, const void *value, size_t size) {
+        if (reserve(1 + size)) {
+            m_buffer[m_size++] = tag;
+            memcpy(&m_buffer[m_size], value, size);
+            m_size += size;
+        }
+    }
+};
+
+/**
+ * @brief printf 포맷 문자열의 conversion을 따라 va_list 인자를 인코딩 (CLogContext::Log)
+ * 인자 타입은 length modifier로 정해진다 (포맷 검사는 컴파일러가 call site에서 한다)
+ * @param[out] buffer 출력 버퍼 (capacity bytes)
+ * @return size_t 인코딩된 크기
+ */
+size_t log_encode_args(const char *format, va_list args, uint8_t *buffer, size_t capacity);
+
+/**
+ * @brief printf 포맷 문자열과 인코딩된 인자로 메시지 생성 (length modifier는 인자 타입을 따른다)
+ * @param[out] out 출력 버퍼 (항상 null-terminated)
+ * @return int 출력 길이
+ */
+int log_render(const char *format, const uint8_t *args, size_t size, char *out, size_t out_size);
+
+/**
+ * @brief binary output frame (LOG_OUTPUT_FORMAT = 1), decoded by scripts/decode_binlog.py
+ * [0xA5][0x5A][length][site (4)][format (4)][timestamp_ms (4)][arguments...][checksum]
+ * - length = bytes between length and checksum
+ * - site, format = target addresses, resolved with the ELF file
+ * - checksum = sum of bytes between length and checksum (inclusive length), 8 bits
+ */
+#define LOG_FRAME_SYNC_0        0xA5
+#define LOG_FRAME_SYNC_1        0x5A
+#define LOG_FRAME_HEADER_SIZE   15
+#define LOG_FRAME_SIZE_MAX      (LOG_FRAME_HEADER_SIZE + MAXLEN_LOG_ARGS + 1)
+
+/**
+ * @brief binary output frame 생성
+ * @param[out] frame 출력 버퍼 (LOG_FRAME_SIZE_MAX bytes)
+ * @return size_t frame 크기
+ */
+size_t log_encode_frame(uint32_t site, uint32_t format, uint32_t timestamp_ms, const uint8_t *args, size_t size, uint8_t *frame);
+
+#endif
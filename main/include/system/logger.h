@@ -3,15 +3,22 @@
 #define _LOGGER_H_
 
 #include <stdio.h>
-#include <stdarg.h>
-#include <string>
-#include <cstring>
-
-#ifdef __cplusplus
-extern "C" {
+#include <stdint.h>
+#include <atomic>
+#include "log_format.h"
+#include "log_crash_ring.h"
+#ifndef UNIT_TEST
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
 #endif
 
-#define MAXLEN_LOG_MSG  1024
+#define MAXLEN_LOG_MSG      192     // formatted message (excluding function/file info), longer message is truncated
+#define LOG_RING_COUNT      8       // max number of tasks with own ring buffer
+#define LOG_RING_SIZE       1024    // bytes per task ring buffer (power of 2)
+
+#define LOG_LEVEL_DEFAULT   eLogType::Info      // minimum log type printed (Debug < Info < Warning < Error < Exception)
+#define LOG_MODULE_COUNT    8       // max number of module level/rate limit overrides
 
 typedef enum
 {
@@ -22,6 +29,143 @@ typedef enum
 	Exception
 } eLogType;
 
+#define LOG_SITE_REGISTERED 0x01
+#define LOG_SITE_ENABLED    0x02    // runtime on/off of the call site
+#define LOG_SITE_ACTIVE     0x04    // enabled and passes global/module level
+#define LOG_SITE_LIMITED    0x08    // token bucket rate limit
+
+/**
+ * @brief 로그 호출 위치 정보 (컴파일 타임 상수, GetLogger() 호출 위치마다 하나씩 생성)
+ * funcname, filename은 __PRETTY_FUNCTION__, __FILE__ 내부를 가리킨다
+ */
+typedef struct log_site_info_t
+{
+    const char *funcname;       // short function name (not null-terminated)
+    uint16_t funcname_length;   // 0 = message only (GetLoggerM)
+    uint16_t module_length;     // module = file basename without extension
+    const char *filename;       // file basename
+    uint32_t fileline;
+    uint8_t type;               // eLogType
+} log_site_info_t;
+
+/**
+ * @brief 로그 호출 위치 런타임 상태 (처음 실행될 때 registry에 등록된다)
+ */
+typedef struct log_site_t
+{
+    const log_site_info_t *info;
+    std::atomic<uint8_t> flags;
+    log_site_t *next;
+    // token bucket (LOG_SITE_LIMITED), concurrent callers only affect accuracy
+    uint16_t rate;              // messages per second
+    uint16_t burst;
+    uint32_t tokens;            // x 1000
+    uint32_t refill_ms;
+    std::atomic<uint32_t> suppressed;
+} log_site_t;
+
+constexpr const char* log_basename(const char *path)
+{
+    const char *name = path;
+    for (; *path; path++) {
+        if (*path == '/' || *path == '\\') {
+            name = path + 1;
+        }
+    }
+    return name;
+}
+
+constexpr uint16_t log_module_length(const char *filename)
+{
+    uint16_t length = 0;
+    while (filename[length] && filename[length] != '.') {
+        length++;
+    }
+    return length;
+}
+
+/**
+ * @brief "ret CClass::func(args)" -> "CClass::func", "ret func(args)" -> "func"
+ */
+constexpr uint16_t log_funcname_begin(const char *pretty)
+{
+    uint16_t begin = 0;
+    for (uint16_t i = 0; pretty[i] && pretty[i] != '(' && !(pretty[i] == ':' && pretty[i + 1] == ':'); i++) {
+        if (pretty[i] == ' ') {
+            begin = i + 1;
+        }
+    }
+    return begin;
+}
+
+constexpr uint16_t log_funcname_length(const char *pretty)
+{
+    uint16_t begin = log_funcname_begin(pretty);
+    uint16_t paren = 0, length = 0;
+    for (; pretty[length]; length++) {
+        if (pretty[length] == '(') {
+            paren = length;
+        }
+    }
+    return paren > begin ? paren - begin : length - begin;
+}
+
+/**
+ * @brief 로그 호출 위치 정보
+ */
+class CLogContext
+{
+public:
+    explicit CLogContext(log_site_t *site) : m_site(site) {}
+
+    /**
+     * @brief GetLogger(n)->Log(...) 형태의 호출 유지용
+     */
+    CLogContext* operator->() { return this; }
+
+    /**
+     * @brief 로그 기록 메서드
+     * 비활성화된 call site는 바로 리턴한다
+     * 인자는 포맷팅하지 않고 그대로 기록 (포맷팅은 drain task 또는 host decoder에서)
+     * @param[in] msg 포맷 문자열 (string literal, flash에 남아있어야 한다)
+     * 인자는 포맷의 conversion을 따라 인코딩되므로 컴파일러가 call site에서 포맷을 검사한다 (format attribute)
+     */
+    void Log(const char* msg, ...) __attribute__((format(printf, 2, 3)));
+
+private:
+    log_site_t *m_site;
+};
+
+/**
+ * @brief ring buffer record header, followed by encoded arguments (log_format.h)
+ * site info and format are compile time constants, so they are valid when the record is drained
+ */
+typedef struct log_record_header_t
+{
+    uint16_t length;            // encoded arguments length
+    uint8_t type;               // eLogType
+    uint8_t reserved;
+    uint32_t timestamp_ms;
+    const log_site_info_t *site;    // nullptr = logger internal message
+    const char *format;
+} log_record_header_t;
+
+/**
+ * @brief single producer (owner task) / single consumer (drain task) ring buffer
+ * head, tail are free running byte counters
+ */
+typedef struct log_ring_t
+{
+    std::atomic<bool> used;
+    std::atomic<uint32_t> head;
+    std::atomic<uint32_t> tail;
+    std::atomic<uint32_t> dropped;
+    uint32_t dropped_total;     // drain task only
+    uint32_t high_water;        // owner task only
+    char task_name[16];
+    uint8_t buffer[LOG_RING_SIZE];
+} log_ring_t;
+
 class CLogger
 {
 public:
@@ -31,66 +175,166 @@ public:
 public:
     /**
      * @brief 객체 인스턴스 호출 메서드
-     * @param[in] logtype 로그 타입
-     * @param[in] funcname 함수 이름
-     * @param[in] filename 파일 이름
-     * @param[in] fileline 라인 넘버
-     * @return CLogger* 
+     * @return CLogger*
      */
-    static CLogger* Instance(eLogType logtype, const char* funcname, const char* filename, const unsigned long fileline);
+    static CLogger* Instance();
 
     /**
-     * @brief 
+     * @brief
      */
     static void Release();
 
     /**
-     * @brief 로그 기록 메서드
-     * @param[in] msg 포맷 문자열
-     * @param[in] ... arguments 
+     * @brief drain task 시작, 이후 로그는 비동기로 출력된다
+     * (시작 전이나 UNIT_TEST 빌드에서는 호출한 task에서 바로 출력)
+     * @return true
+     * @return false
+     */
+    bool start();
+
+    /**
+     * @brief ring buffer에 쌓인 로그를 호출한 task에서 즉시 출력 (재부팅 직전 등)
+     */
+    void flush();
+
+    /**
+     * @brief 포맷된 메시지를 호출한 task의 ring buffer에 기록
+     * heap 할당 없음, ring buffer가 가득 찬 경우 메시지는 버려지고 카운트된다
      */
-    void Log(const char* msg, ...);
+    void write(const log_site_info_t *site, const char *format, const uint8_t *args, size_t size, uint32_t start_cycles);
+
+    /**
+     * @brief call site를 registry에 등록하고 현재 설정에 따른 flags를 리턴 (call site당 한 번)
+     */
+    uint8_t register_site(log_site_t *site);
+
+    /**
+     * @brief 전체 최소 로그 레벨 설정
+     */
+    void set_level(eLogType type);
+
+    /**
+     * @brief 모듈(파일 이름에서 확장자 제외, ex: "ws2812") 최소 로그 레벨 설정
+     * @return true
+     * @return false 모듈 설정 개수 초과
+     */
+    bool set_module_level(const char *module, eLogType type);
+
+    /**
+     * @brief 모듈 call site별 token bucket rate limit 설정
+     * 초과된 메시지는 버려지고 다음 메시지 전에 "suppressed N similar messages"로 요약된다
+     * @param[in] module 모듈 이름, '*'로 끝나면 prefix (ex: "device_*")
+     * @param[in] rate 초당 메시지 수 (0 = 제한 없음)
+     * @param[in] burst 연속으로 허용되는 메시지 수
+     * @return true
+     * @return false 모듈 설정 개수 초과
+     */
+    bool set_module_rate_limit(const char *module, uint16_t rate, uint16_t burst);
+
+    /**
+     * @brief rate limit 적용된 call site의 token 소비 (false = 메시지 버림)
+     */
+    bool acquire_token(log_site_t *site);
+
+    /**
+     * @brief call site 활성화/비활성화
+     * @param[in] filename 파일 이름 (ex: "ws2812.cpp")
+     * @param[in] fileline 라인 넘버 (0 = 파일 내 모든 call site)
+     * @return int 변경된 call site 개수 (아직 실행되지 않은 call site는 registry에 없음)
+     */
+    int set_site_enabled(const char *filename, uint32_t fileline, bool enabled);
+
+    /**
+     * @brief 이전 부팅에서 RTC 메모리에 남은 로그를 reset reason과 함께 출력 (start()에서 호출)
+     */
+    void dump_crash_log();
+
+    void print_logger_info();
+    void print_log_sites();
 
 private:
-    bool m_valid_funcinfo;
     static CLogger* _instance;
-    eLogType m_eLogType;
-    std::string m_funcname;
-    std::string m_filename;
-    unsigned long m_fileline;
+    log_ring_t m_rings[LOG_RING_COUNT];
+    std::atomic<uint32_t> m_dropped_no_ring;    // ring pool exhausted
+    std::atomic<uint32_t> m_write_count;
+    std::atomic<uint32_t> m_write_cycles_max;
+    std::atomic<uint64_t> m_write_cycles_total;
+    uint32_t m_output_count;            // drain task only
+    uint64_t m_output_bytes_total;
+    uint64_t m_output_cycles_total;
+    std::atomic<log_site_t*> m_sites;           // registry (linked list)
+    std::atomic<uint8_t> m_level;
+    struct {
+        char name[24];
+        int8_t type;        // -1 = global level
+        bool has_rate_limit;
+        uint16_t rate;
+        uint16_t burst;
+    } m_modules[LOG_MODULE_COUNT];
+    int m_module_count;
+    std::atomic<uint32_t> m_suppressed_count;
+    uint32_t m_summary_ms;              // drain task only
+    CLogCrashRing m_crash_ring;
+    bool m_crash_ring_valid;            // records of previous boot
+    uint32_t m_crash_ring_boot_head;
+    uint32_t m_crash_ring_dump_count;
+#ifndef UNIT_TEST
+    TaskHandle_t m_drain_task_handle;
+    SemaphoreHandle_t m_drain_mutex;
+    portMUX_TYPE m_crash_ring_lock;
+#endif
+
+    log_ring_t* get_task_ring();
+    void drain();
+    void drain_ring(log_ring_t *ring);
+    int find_module(const char *module, bool create);
+    uint8_t apply_site_config(log_site_t *site, uint8_t flags);
+    void update_sites();
+    void write_suppressed(log_site_t *site, uint32_t count);
+    void flush_suppressed();
 
     /**
-     * @brief 실제로 콘솔 등에 로그를 기록하는 메서드
-     * @param[in] msg 
+     * @brief 실제로 콘솔 등에 로그를 기록하는 메서드 (text 또는 binary frame)
      */
-    void Process(std::string msg);
+    void Process(const log_record_header_t *header, const uint8_t *args);
+    void output_text(uint8_t type, uint32_t timestamp_ms, const char *text);
+
+#ifndef UNIT_TEST
+    static void func_drain(void *param);
+    static void func_shutdown_handler();
+#endif
 };
 
 /**
- * @brief 
- * @param logtype 
- * @param funcname 
- * @param filename 
- * @param fileline 
- * @return CLogger* 
+ * @brief CPU cycle counter (host: nanoseconds)
  */
-inline CLogger* _GetLogger(eLogType logtype, const char* funcname, const char* filename, const unsigned long fileline) {
-    return CLogger::Instance(logtype, funcname, filename, fileline);
-}
+uint32_t log_get_cycle_count();
 
 /**
- * @brief 
+ * @brief
  */
 inline void ReleaseLogger() {
     CLogger::Release();
 }
 
-#define GetLoggerBase() _GetLogger(eLogType::Info, __PRETTY_FUNCTION__, __FILE__, __LINE__)
-#define GetLogger(n) _GetLogger(n, __PRETTY_FUNCTION__, __FILE__, __LINE__)
-#define GetLoggerM(n) _GetLogger(n, nullptr, nullptr, 0)
+/**
+ * @brief call site마다 static descriptor 생성 (상수 초기화, 런타임 비용 없음)
+ */
+#define _LOG_SITE(n, pretty, file, line, funcinfo) ({ \
+    static constexpr log_site_info_t _log_site_info = { \
+        (pretty) + log_funcname_begin(pretty), \
+        (uint16_t)((funcinfo) ? log_funcname_length(pretty) : 0), \
+        log_module_length(log_basename(file)), \
+        log_basename(file), \
+        (uint32_t)(line), \
+        (uint8_t)(n) \
+    }; \
+    static log_site_t _log_site = {&_log_site_info, {0}, nullptr, 0, 0, 0, 0, {0}}; \
+    &_log_site; \
+})
 
-#ifdef __cplusplus
-};
-#endif
+#define GetLoggerBase() CLogContext(_LOG_SITE(eLogType::Info, __PRETTY_FUNCTION__, __FILE__, __LINE__, true))
+#define GetLogger(n) CLogContext(_LOG_SITE(n, __PRETTY_FUNCTION__, __FILE__, __LINE__, true))
+#define GetLoggerM(n) CLogContext(_LOG_SITE(n, __PRETTY_FUNCTION__, __FILE__, __LINE__, false))
 
-#endif
\ No newline at end of file
+#endif
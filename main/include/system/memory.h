@@ -4,12 +4,88 @@
 
 #include <stdint.h>
 #include <strings.h>
+#include <stddef.h>
+#include <type_traits>
 #include "definition.h"
+#include "memory_backend.h"
+#include "journal.h"
+#ifdef UNIT_TEST
+#include <mutex>
+#else
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#endif
 #include <vector>
+#include <string>
 
-#ifdef __cplusplus
-extern "C" {
-#endif
+#define MEMORY_KEY_MAX_LENGTH   15      // NVS_KEY_NAME_MAX_SIZE - 1
+
+/**
+ * @brief compile-time key
+ * key name is hashed (FNV-1a) at compile time, cache lookup compares the hash only.
+ * key longer than nvs limit is rejected at compile time (memory_key_too_long is not constexpr)
+ */
+struct memory_key_t
+{
+    const char *name;
+    uint32_t hash;
+};
+
+constexpr uint32_t memory_key_hash(const char *name, uint32_t hash = 0x811C9DC5)
+{
+    return *name ? memory_key_hash(name + 1, (hash ^ (uint8_t)*name) * 0x01000193) : hash;
+}
+
+constexpr size_t memory_key_length(const char *name)
+{
+    return *name ? 1 + memory_key_length(name + 1) : 0;
+}
+
+memory_key_t memory_key_too_long(const char *name);
+
+constexpr memory_key_t make_memory_key(const char *name)
+{
+    return memory_key_length(name) <= MEMORY_KEY_MAX_LENGTH ? memory_key_t{name, memory_key_hash(name)} : memory_key_too_long(name);
+}
+
+constexpr memory_key_t MEMORY_KEY_LIGHT_STATE = make_memory_key("light_state");
+constexpr memory_key_t MEMORY_KEY_LEGACY_BRIGHTNESS = make_memory_key("ws2812_br");
+constexpr memory_key_t MEMORY_KEY_LEGACY_RGB = make_memory_key("ws2812_rgb");
+
+#define LIGHT_STATE_VERSION     1
+
+/**
+ * @brief light state record (single nvs blob)
+ * state the device tracks but esp_matter does not persist, restored with a single read at boot.
+ * fields backed by non-volatile matter attributes (OnOff, CurrentLevel, hue, saturation, xy) are
+ * restored from matter attribute storage instead and no longer written (kept for layout compatibility).
+ * schema migration rule: new fields are only appended (before crc) and the version is increased,
+ * record of older version is restored with default value for the missing fields.
+ */
+struct __attribute__((packed)) light_state_t
+{
+    uint16_t version = LIGHT_STATE_VERSION;
+    uint16_t size = sizeof(light_state_t);  // record size of the writer (crc included)
+    // version 1 fields, unused (restored from matter attribute storage)
+    uint8_t brightness = 0;                 // pwm brightness (0 = off)
+    uint8_t red = 0;
+    uint8_t green = 0;
+    uint8_t blue = 0;
+    uint8_t onoff = 0;
+    uint8_t level = 254;
+    uint8_t hue = 0;
+    uint8_t saturation = 0;
+    uint16_t enhanced_hue = 0;
+    uint16_t x = 20493;                     // D65 white point
+    uint16_t y = 21561;
+    // color loop (effect)
+    uint8_t color_loop_active = 0;
+    uint8_t color_loop_direction = 1;
+    uint16_t color_loop_time = 25;
+    uint16_t color_loop_start_hue = 0;
+    uint32_t crc = 0;                       // crc32 of [0, size - 4)
+};
 
 class CMemory
 {
@@ -21,16 +97,95 @@ public:
     static CMemory* Instance();
     static void Release();
 
-    bool load_ws2812_brightness(uint8_t *brightness);
-    bool save_ws2812_brightness(const uint8_t brightness);
-    bool load_ws2812_color(uint8_t *red, uint8_t *green, uint8_t *blue);
-    bool save_ws2812_color(const uint8_t red, uint8_t green, uint8_t blue);
+    bool initialize(CMemoryBackend *backend = nullptr, CJournalFlash *journal_flash = nullptr);
+    bool flush(bool force = true);
+    void print_memory_info();
+
+    /**
+     * @brief typed key/value access (read-through cache, write-behind)
+     * T should be trivially copyable (stored as raw bytes)
+     */
+    template <typename T>
+    bool load(const memory_key_t &key, T *value) {
+        static_assert(std::is_trivially_copyable<T>::value, "memory value should be trivially copyable");
+        return read_entry(key, value, sizeof(T));
+    }
+
+    template <typename T>
+    bool save(const memory_key_t &key, const T &value) {
+        static_assert(std::is_trivially_copyable<T>::value, "memory value should be trivially copyable");
+        return write_entry(key, &value, sizeof(T));
+    }
+
+    /**
+     * @brief keys saved between begin_batch() and end_batch() are committed together
+     */
+    void begin_batch();
+    void end_batch();
+
+    bool load_light_state(light_state_t *state);
+    bool save_light_state(const light_state_t *state);
+
 
 private:
     static CMemory* _instance;
 
-    bool read_nvs(const char *key, void *out, size_t data_size);
-    bool write_nvs(const char *key, const void *data, const size_t data_size);
+    /**
+     * @brief write-behind cache entry
+     * write request only updates RAM and marks the entry dirty,
+     * dirty entries are committed to nvs at once by the flush task (debounced)
+     */
+    struct cache_entry_t {
+        memory_key_t key;
+        std::vector<uint8_t> data;
+        bool dirty;
+    };
+    std::vector<cache_entry_t> m_cache;
+    CMemoryBackend *m_backend;
+    bool m_backend_owned;
+    int m_batch_depth;
+#ifdef UNIT_TEST
+    std::mutex m_mutex;
+    std::mutex m_flush_mutex;
+#else
+    SemaphoreHandle_t m_mutex;
+    SemaphoreHandle_t m_flush_mutex;    // serializes storage access of flush task, shutdown handler, ...
+    TaskHandle_t m_flush_task_handle;
+#endif
+
+    /**
+     * @brief light state is appended to the journal partition as delta records,
+     * nvs record (MEMORY_KEY_LIGHT_STATE) is used when the journal partition does not exist
+     */
+    CStateJournal m_journal;
+    CJournalFlash *m_journal_flash;
+    bool m_journal_flash_owned;
+    bool m_journal_ready;
+    light_state_t m_light_state;
+    bool m_light_state_loaded;
+    bool m_light_state_dirty;
+
+    // statistics
+    uint32_t m_write_request_count;
+    uint32_t m_commit_count;
+    uint32_t m_flush_us_max;
+
+    void lock();
+    void unlock();
+    void lock_flush();
+    void unlock_flush();
+    void request_flush();
+    bool read_entry(const memory_key_t &key, void *out, size_t data_size, size_t *read_size = nullptr);
+    bool write_entry(const memory_key_t &key, const void *data, const size_t data_size);
+    cache_entry_t* find_cache_entry(const memory_key_t &key);
+    bool read_light_state();
+    bool migrate_legacy_light_state();
+    static uint32_t calc_light_state_crc(const void *data, size_t size);
+
+#ifndef UNIT_TEST
+    static void func_flush(void *param);
+    static void func_shutdown_handler();
+#endif
 };
 
 inline CMemory* GetMemory() {
@@ -41,7 +196,4 @@ inline void ReleaseMemory() {
     CMemory::Release();
 }
 
-#ifdef __cplusplus
-}
 #endif
-#endif
\ No newline at end of file
@@ -0,0 +1,97 @@
+#ifndef _MEMORY_BACKEND_H_
+#define _MEMORY_BACKEND_H_
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <map>
+#include <string>
+#include <vector>
+#ifndef UNIT_TEST
+#include "nvs.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief key/value storage backend of CMemory
+ * written data is durable only after commit() (nvs semantics)
+ */
+class CMemoryBackend
+{
+public:
+    virtual ~CMemoryBackend() {}
+
+public:
+    virtual const char* get_name() = 0;
+    virtual bool open() = 0;
+    virtual void close() = 0;
+    /**
+     * @param size [in] buffer size, [out] stored data size
+     */
+    virtual bool read(const char *key, void *out, size_t *size) = 0;
+    virtual bool write(const char *key, const void *data, size_t size) = 0;
+    virtual bool commit() = 0;
+};
+
+#ifndef UNIT_TEST
+/**
+ * @brief nvs backend (handle is opened once and kept)
+ */
+class CMemoryBackendNvs : public CMemoryBackend
+{
+public:
+    CMemoryBackendNvs(const char *name_space);
+    virtual ~CMemoryBackendNvs();
+
+public:
+    const char* get_name() override;
+    bool open() override;
+    void close() override;
+    bool read(const char *key, void *out, size_t *size) override;
+    bool write(const char *key, const void *data, size_t size) override;
+    bool commit() override;
+
+private:
+    std::string m_namespace;
+    nvs_handle_t m_handle;
+    bool m_opened;
+};
+#endif
+
+/**
+ * @brief in-memory nvs stand-in (host unit test)
+ * uncommitted data is visible to read() but lost by discard_uncommitted() (= power loss)
+ */
+class CMemoryBackendRam : public CMemoryBackend
+{
+public:
+    CMemoryBackendRam();
+    virtual ~CMemoryBackendRam();
+
+public:
+    const char* get_name() override;
+    bool open() override;
+    void close() override;
+    bool read(const char *key, void *out, size_t *size) override;
+    bool write(const char *key, const void *data, size_t size) override;
+    bool commit() override;
+
+    void discard_uncommitted();
+    uint32_t get_write_count();
+    uint32_t get_commit_count();
+
+private:
+    std::map<std::string, std::vector<uint8_t>> m_storage;
+    std::map<std::string, std::vector<uint8_t>> m_pending;
+    bool m_opened;
+    uint32_t m_write_count;
+    uint32_t m_commit_count;
+};
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -8,12 +8,41 @@
 #include <esp_matter_ota.h>
 #include <iot_button.h>
 #include <vector>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
 #include "device.h"
+#include "histogram.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * @brief work handed to the device worker task (every change of the devices runs in this task)
+ */
+enum class eWorkerRequest : uint8_t {
+    Attribute = 0,  // attribute change of the device
+    Toggle,         // default button (queued to the front)
+    SystemInfo,     // print_system_info()
+    Overflow,       // wake up to take the changes coalesced while the queue was full
+};
+
+/**
+ * @brief attribute change copied in CHIP task, handled by device worker task
+ * value is a copy (scalar types only, string/array values point to the caller's buffer)
+ */
+typedef struct matter_attribute_event_t
+{
+    eWorkerRequest request;
+    CDevice *device;            // eWorkerRequest::Attribute only
+    esp_matter::attribute::callback_type_t type;
+    uint32_t cluster_id;
+    uint32_t attribute_id;
+    esp_matter_attr_val_t value;
+    uint32_t echo_generation;   // own write of the device (0 = controller write)
+    int64_t tm_queued;
+} matter_attribute_event_t;
+
 class CSystem
 {
 public:
@@ -41,17 +70,63 @@ private:
     static CSystem* _instance;
     esp_matter::node_t* m_root_node;
     std::vector<CDevice*> m_device_list;
+    CDevice* m_device_index[DEVICE_ENDPOINT_INDEX_SIZE];  // endpoint id -> device
+    esp_matter::endpoint_t* m_endpoint_aggregator;
 
     button_handle_t m_handle_default_btn;
     static bool m_default_btn_pressed_long;
+    static CHistogram m_button_press_histogram;     // press down -> light changed
+    static CHistogram m_button_light_histogram;     // toggle in device worker (local control path)
+    static uint32_t m_button_drop_count;            // worker queue full
     static bool m_commisioning_session_working;
+
+    /**
+     * @brief device worker: attribute changes are handled (hardware, nvs, logs) outside of CHIP task
+     * events are handled in the order of callbacks
+     */
+    static QueueHandle_t m_queue_attribute;
+    TaskHandle_t m_task_handle_device;
+
+    // attribute update callback latency statistics
+    static CHistogram m_callback_histogram;         // CHIP task (callback duration)
+    static CHistogram m_queue_latency_histogram;    // callback -> worker
+    static CHistogram m_handle_histogram;           // worker (device handler duration)
+    static CHistogram m_commit_histogram;           // worker (staged hardware work of all devices)
+    static uint32_t m_attribute_sync_count;         // handled in callback (worker not running)
+    static uint32_t m_attribute_queue_full_count;   // queue full, coalesced into the overflow table
+    static uint32_t m_attribute_drop_count;         // overflow table full
+    /**
+     * @brief latest change per (device, cluster, attribute) while the queue is full
+     * once it holds a change every newer change goes here too, the worker applies it after the queue is empty (keeps the order)
+     */
+    static matter_attribute_event_t m_attribute_overflow[DEVICE_ATTRIBUTE_OVERFLOW_MAX];
+    static size_t m_attribute_overflow_count;
+    static portMUX_TYPE m_attribute_overflow_lock;
     
     bool init_default_button();
     bool deinit_default_button();
     static void callback_default_button(void *arg, void *data);
     void print_system_info();
+    /**
+     * @brief print_system_info() in device worker task (caller doesn't wait for the log output)
+     */
+    void request_system_info();
+    /**
+     * @brief toggle_device_state_action() in device worker task, ahead of the queued attribute changes
+     */
+    void request_toggle();
+    bool add_device(CDevice *device);
+    bool create_bridged_devices();
     void print_matter_endpoints_info();
 
+    bool start_device_worker();
+    static void func_device_worker(void *param);
+    void commit_staged_changes();
+    static bool matter_is_attribute_value_copyable(const esp_matter_attr_val_t *val);
+    static void matter_handle_attribute_event(matter_attribute_event_t *event);
+    static void matter_post_attribute_event(const matter_attribute_event_t *event);
+    static size_t matter_take_overflow_events(matter_attribute_event_t *events);
+
     static void matter_event_callback(const ChipDeviceEvent *event, intptr_t arg);
     static esp_err_t matter_identification_callback(
         esp_matter::identification::callback_type_t type, 
@@ -1,20 +1,41 @@
 #include "device.h"
 #include "logger.h"
 #include "system.h"
+#include "memory.h"
+#include <platform/CHIPDeviceLayer.h>
+#include <app/reporting/reporting.h>
 
 CDevice::CDevice()
 {
-    m_state_onoff = false;
-    m_state_brightness = 0;
-    m_state_hue = 0;
-    m_state_saturation = 0;
     m_endpoint = nullptr;
     m_endpoint_id = 0;
+    m_publishing = publish_context_t();
+    m_publish_mutex = xSemaphoreCreateRecursiveMutex();
+    m_publish_batch = matter_publish_batch_t();
+    m_publish_scheduled = false;
+    m_publish_batch_lock = portMUX_INITIALIZER_UNLOCKED;
+    m_staged_changes = 0;
+    m_stat_staged_count = 0;
+    m_stat_commit_count = 0;
+    m_stat_batch_count = 0;
+    m_stat_batch_write_count = 0;
+    m_stat_batch_unchanged_count = 0;
+    m_stat_batch_merged_count = 0;
+    m_report_timer = nullptr;
+    m_state.add_listener(on_state_changed, this);
 }
 
 CDevice::~CDevice()
 {
-
+    if (m_report_timer) {
+        esp_timer_stop(m_report_timer);
+        esp_timer_delete(m_report_timer);
+        m_report_timer = nullptr;
+    }
+    if (m_publish_mutex) {
+        vSemaphoreDelete(m_publish_mutex);
+        m_publish_mutex = nullptr;
+    }
 }
 
 bool CDevice::matter_add_endpoint()
@@ -22,11 +43,11 @@ bool CDevice::matter_add_endpoint()
     esp_err_t ret;
     
     if (m_endpoint != nullptr) {
-        matter_init_endpoint();
-
-        // get endpoint id
+        // get endpoint id (attribute writes of matter_init_endpoint need it)
         m_endpoint_id = esp_matter::endpoint::get_id(m_endpoint);
 
+        matter_init_endpoint();
+
         ret = esp_matter::endpoint::enable(m_endpoint);  // should be called after esp_matter::start()
         if (ret != ESP_OK) {
             GetLogger(eLogType::Error)->Log("Failed to enable endpoint (%d, ret=%d)", m_endpoint_id, ret);
@@ -70,7 +91,7 @@ uint16_t CDevice::matter_get_endpoint_id()
     return m_endpoint_id; 
 }
 
-void CDevice::matter_on_change_attribute_value(esp_matter::attribute::callback_type_t type, uint32_t cluster_id, uint32_t attribute_id, esp_matter_attr_val_t *value)
+void CDevice::matter_on_change_attribute_value(esp_matter::attribute::callback_type_t type, uint32_t cluster_id, uint32_t attribute_id, esp_matter_attr_val_t *value, uint32_t echo_generation)
 {
     
 }
@@ -80,6 +101,392 @@ void CDevice::matter_update_all_attribute_values()
 
 }
 
+void CDevice::load_state()
+{
+    /**
+     * only the state esp_matter does not persist is kept in the light state record,
+     * non-volatile attributes (OnOff, CurrentLevel, ...) are read back from the endpoint
+     * (see matter_get_attribute_value)
+     */
+    light_state_t state;
+    GetMemory()->load_light_state(&state);
+
+    m_state.set(eStateField::ColorLoopActive, state.color_loop_active ? 1 : 0, eStateSource::Restore);
+    m_state.set(eStateField::ColorLoopDirection, state.color_loop_direction, eStateSource::Restore);
+    m_state.set(eStateField::ColorLoopTime, state.color_loop_time, eStateSource::Restore);
+    m_state.set(eStateField::ColorLoopStartHue, state.color_loop_start_hue, eStateSource::Restore);
+}
+
+void CDevice::save_state()
+{
+    // unchanged record is not written
+    light_state_t state;
+    GetMemory()->load_light_state(&state);
+
+    state.color_loop_active = m_state.get(eStateField::ColorLoopActive) ? 1 : 0;
+    state.color_loop_direction = (uint8_t)m_state.get(eStateField::ColorLoopDirection);
+    state.color_loop_time = m_state.get(eStateField::ColorLoopTime);
+    state.color_loop_start_hue = m_state.get(eStateField::ColorLoopStartHue);
+    GetMemory()->save_light_state(&state);
+}
+
+void CDevice::on_state_changed(void *context, eStateField field, uint16_t value, eStateSource source)
+{
+    CDevice *obj = static_cast<CDevice *>(context);
+
+    // light state record holds the color loop state only
+    if (source == eStateSource::Restore) {
+        return;
+    }
+    switch (field) {
+    case eStateField::ColorLoopActive:
+    case eStateField::ColorLoopDirection:
+    case eStateField::ColorLoopTime:
+    case eStateField::ColorLoopStartHue:
+        // ColorLoopSet writes up to 4 fields, the record is written once per commit
+        obj->stage_change(DEVICE_STAGED_SAVE_STATE);
+        break;
+    default:
+        break;
+    }
+}
+
+void CDevice::stage_change(uint32_t flags)
+{
+    if (flags & DEVICE_STAGED_COLOR_MASK) {
+        // the last color mode (hue/saturation, xy, temperature) of the commit wins
+        m_staged_changes &= ~DEVICE_STAGED_COLOR_MASK;
+    }
+    m_staged_changes |= flags;
+    m_stat_staged_count++;
+}
+
+void CDevice::apply_staged_changes(uint32_t flags)
+{
+    if (flags & DEVICE_STAGED_SAVE_STATE) {
+        save_state();
+    }
+}
+
+void CDevice::commit_staged_changes()
+{
+    uint32_t flags = m_staged_changes;
+    if (!flags) {
+        return;
+    }
+    m_staged_changes = 0;
+    m_stat_commit_count++;
+    apply_staged_changes(flags);
+}
+
+bool CDevice::matter_get_attribute_value(uint32_t cluster_id, uint32_t attribute_id, esp_matter_attr_val_t *value)
+{
+    // non-volatile attribute value is restored from esp_matter nvs storage when the endpoint is created
+    esp_matter::cluster_t *cluster = esp_matter::cluster::get(m_endpoint, cluster_id);
+    if (!cluster) {
+        return false;
+    }
+    esp_matter::attribute_t *attribute = esp_matter::attribute::get(cluster, attribute_id);
+    if (!attribute) {
+        return false;
+    }
+
+    return esp_matter::attribute::get_val(attribute, value) == ESP_OK;
+}
+
+bool CDevice::matter_publish_attribute(uint32_t cluster_id, uint32_t attribute_id, eStateField field)
+{
+    esp_err_t ret;
+
+    /**
+     * esp_matter::attribute::update() calls PRE_UPDATE callback in this task (chip stack locked),
+     * callback compares the task and attribute to tag the change as echo (see matter_get_echo_generation)
+     */
+    xSemaphoreTakeRecursive(m_publish_mutex, portMAX_DELAY);
+    uint32_t generation = m_state.mark_published(field);
+    esp_matter_attr_val_t val = make_matter_value(field, m_state.get(field));
+    m_publishing.cluster_id = cluster_id;
+    m_publishing.attribute_id = attribute_id;
+    m_publishing.generation = generation;
+    m_publishing.task = xTaskGetCurrentTaskHandle();
+    ret = esp_matter::attribute::update(m_endpoint_id, cluster_id, attribute_id, &val);
+    m_publishing = publish_context_t();
+    xSemaphoreGiveRecursive(m_publish_mutex);
+
+    if (ret != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to update attribute (%d)", ret);
+        return false;
+    }
+
+    return true;
+}
+
+bool CDevice::matter_publish_attributes(const matter_attribute_batch_item_t *items, size_t count)
+{
+    if (count > MATTER_ATTRIBUTE_BATCH_MAX) {
+        GetLogger(eLogType::Error)->Log("Too many attributes in batch (%d)", (int)count);
+        return false;
+    }
+
+    // values are taken here (published generation), outside of the batch lock
+    esp_matter_attr_val_t values[MATTER_ATTRIBUTE_BATCH_MAX];
+    for (size_t i = 0; i < count; i++) {
+        m_state.mark_published(items[i].field);
+        values[i] = make_matter_value(items[i].field, m_state.get(items[i].field));
+    }
+
+    /**
+     * called from the device worker, the realtime task (effect) and the esp_timer task (report timer),
+     * a batch already waiting for CHIP task takes the new values instead of scheduling another one
+     */
+    bool merged = true;
+    bool schedule = false;
+    portENTER_CRITICAL(&m_publish_batch_lock);
+    for (size_t i = 0; i < count; i++) {
+        size_t j = 0;
+        while (j < m_publish_batch.count && (m_publish_batch.items[j].cluster_id != items[i].cluster_id || m_publish_batch.items[j].attribute_id != items[i].attribute_id)) {
+            j++;
+        }
+        if (j == MATTER_ATTRIBUTE_BATCH_MAX) {
+            merged = false;
+            continue;
+        }
+        if (j == m_publish_batch.count) {
+            m_publish_batch.count++;
+        } else {
+            m_stat_batch_merged_count++;
+        }
+        m_publish_batch.items[j].cluster_id = items[i].cluster_id;
+        m_publish_batch.items[j].attribute_id = items[i].attribute_id;
+        m_publish_batch.items[j].value = values[i];
+    }
+    if (!m_publish_scheduled) {
+        m_publish_scheduled = true;
+        schedule = true;
+    }
+    portEXIT_CRITICAL(&m_publish_batch_lock);
+
+    if (!merged) {
+        GetLogger(eLogType::Error)->Log("Publish batch is full (%d)", MATTER_ATTRIBUTE_BATCH_MAX);
+    }
+    if (!schedule) {
+        return merged;
+    }
+
+    if (chip::DeviceLayer::PlatformMgr().ScheduleWork(matter_publish_batch_work, (intptr_t)this) != CHIP_NO_ERROR) {
+        // CHIP task not running (ex: before esp_matter::start), one attribute at a time
+        portENTER_CRITICAL(&m_publish_batch_lock);
+        m_publish_batch.count = 0;
+        m_publish_scheduled = false;
+        portEXIT_CRITICAL(&m_publish_batch_lock);
+        bool result = true;
+        for (size_t i = 0; i < count; i++) {
+            result &= matter_publish_attribute(items[i].cluster_id, items[i].attribute_id, items[i].field);
+        }
+        return result;
+    }
+
+    return merged;
+}
+
+void CDevice::matter_publish_batch_work(intptr_t arg)
+{
+    // CHIP task, chip stack is locked
+    CDevice *obj = (CDevice *)arg;
+    esp_matter_attr_val_t current = esp_matter_invalid(NULL);
+
+    // take the batch, publishes from now on schedule a new one
+    matter_publish_batch_t batch;
+    portENTER_CRITICAL(&obj->m_publish_batch_lock);
+    batch.count = obj->m_publish_batch.count;
+    for (size_t i = 0; i < batch.count; i++) {
+        batch.items[i] = obj->m_publish_batch.items[i];
+    }
+    obj->m_publish_batch.count = 0;
+    obj->m_publish_scheduled = false;
+    portEXIT_CRITICAL(&obj->m_publish_batch_lock);
+
+    for (size_t i = 0; i < batch.count; i++) {
+        esp_matter::attribute_t *attribute = esp_matter::attribute::get(obj->m_endpoint_id, batch.items[i].cluster_id, batch.items[i].attribute_id);
+        if (!attribute) {
+            continue;
+        }
+        if (esp_matter::attribute::get_val(attribute, &current) == ESP_OK && get_matter_value(&current) == get_matter_value(&batch.items[i].value)) {
+            obj->m_stat_batch_unchanged_count++;
+            continue;
+        }
+        if (esp_matter::attribute::set_val(attribute, &batch.items[i].value) != ESP_OK) {
+            GetLogger(eLogType::Error)->Log("Failed to set attribute value (cluster 0x%04X, attribute 0x%04X)", batch.items[i].cluster_id, batch.items[i].attribute_id);
+            continue;
+        }
+        MatterReportingAttributeChangeCallback(obj->m_endpoint_id, batch.items[i].cluster_id, batch.items[i].attribute_id);
+        obj->m_stat_batch_write_count++;
+    }
+    obj->m_stat_batch_count++;
+}
+
+void CDevice::matter_begin_transition(uint32_t cluster_id, uint32_t attribute_id, eStateField field)
+{
+    if (!m_report_timer) {
+        esp_timer_create_args_t args = esp_timer_create_args_t();
+        args.callback = func_report_timer;
+        args.arg = this;
+        args.dispatch_method = ESP_TIMER_TASK;
+        args.name = "device_report";
+        args.skip_unhandled_events = true;
+        if (esp_timer_create(&args, &m_report_timer) != ESP_OK) {
+            GetLogger(eLogType::Error)->Log("Failed to create report timer");
+            m_report_timer = nullptr;
+        }
+    }
+    if (m_report_timer && !esp_timer_is_active(m_report_timer)) {
+        esp_timer_start_periodic(m_report_timer, (uint64_t)m_report_policy.get_interval() * 1000);
+    }
+
+    if (!m_report_policy.has_transition()) {
+        // rate window of the transition (logged by matter_end_transition)
+        m_report_policy.reset_rates(esp_timer_get_time());
+    }
+    if (m_report_policy.begin_transition(field, cluster_id, attribute_id, esp_timer_get_time())) {
+        matter_attribute_batch_item_t item = {cluster_id, attribute_id, field};
+        matter_publish_attributes(&item, 1);
+    }
+}
+
+void CDevice::matter_report_attribute(uint32_t cluster_id, uint32_t attribute_id, eStateField field, uint32_t updates/*=1*/)
+{
+    if (m_report_policy.request(field, esp_timer_get_time(), updates)) {
+        matter_attribute_batch_item_t item = {cluster_id, attribute_id, field};
+        matter_publish_attributes(&item, 1);
+    }
+}
+
+void CDevice::matter_end_transition(uint32_t cluster_id, uint32_t attribute_id, eStateField field)
+{
+    if (m_report_policy.end_transition(field, esp_timer_get_time())) {
+        matter_attribute_batch_item_t item = {cluster_id, attribute_id, field};
+        matter_publish_attributes(&item, 1);
+    }
+    if (!m_report_policy.has_transition()) {
+        if (m_report_timer) {
+            esp_timer_stop(m_report_timer);
+        }
+        uint32_t requested_x10, reported_x10;
+        m_report_policy.get_rates(esp_timer_get_time(), &requested_x10, &reported_x10);
+        GetLogger(eLogType::Info)->Log("Transition end (%s): device updates %u.%u/s -> reports %u.%u/s",
+            CDeviceState::get_field_name(field), requested_x10 / 10, requested_x10 % 10, reported_x10 / 10, reported_x10 % 10);
+    }
+}
+
+void CDevice::func_report_timer(void *arg)
+{
+    // esp_timer task: held values whose interval has passed, published as one batch
+    CDevice *obj = static_cast<CDevice *>(arg);
+    obj->sample_device_values();
+
+    matter_attribute_batch_item_t items[MATTER_ATTRIBUTE_BATCH_MAX];
+    size_t count = 0;
+    int64_t now_us = esp_timer_get_time();
+
+    for (int i = 0; i < STATE_FIELD_COUNT && count < MATTER_ATTRIBUTE_BATCH_MAX; i++) {
+        eStateField field = (eStateField)i;
+        if (obj->m_report_policy.take_pending(field, now_us, &items[count].cluster_id, &items[count].attribute_id)) {
+            items[count].field = field;
+            count++;
+        }
+    }
+    if (count) {
+        obj->matter_publish_attributes(items, count);
+    }
+}
+
+uint32_t CDevice::matter_get_echo_generation(uint32_t cluster_id, uint32_t attribute_id)
+{
+    // controller write in CHIP task can't be mistaken for the echo (different task)
+    if (m_publishing.task != xTaskGetCurrentTaskHandle() || !m_publishing.generation) {
+        return 0;
+    }
+    if (m_publishing.cluster_id != cluster_id || m_publishing.attribute_id != attribute_id) {
+        return 0;
+    }
+
+    return m_publishing.generation;
+}
+
+esp_matter_attr_val_t CDevice::make_matter_value(eStateField field, uint16_t value)
+{
+    switch (CDeviceState::get_field_type(field)) {
+    case eStateType::Bool:
+        return esp_matter_bool(value ? true : false);
+    case eStateType::Uint8:
+        return esp_matter_uint8((uint8_t)value);
+    default:
+        return esp_matter_uint16(value);
+    }
+}
+
+uint16_t CDevice::get_matter_value(esp_matter_attr_val_t *value)
+{
+    switch (value->type) {
+    case ESP_MATTER_VAL_TYPE_BOOLEAN:
+        return value->val.b ? 1 : 0;
+    case ESP_MATTER_VAL_TYPE_UINT8:
+    case ESP_MATTER_VAL_TYPE_ENUM8:
+    case ESP_MATTER_VAL_TYPE_BITMAP8:
+    case ESP_MATTER_VAL_TYPE_NULLABLE_UINT8:
+        return value->val.u8;
+    default:
+        return value->val.u16;
+    }
+}
+
+void CDevice::print_state_info()
+{
+    GetLoggerM(eLogType::Info)->Log("----- Device (endpoint %u) -----", m_endpoint_id);
+    m_state.print_state_info();
+    GetLoggerM(eLogType::Info)->Log("Staged Changes: %u, Commits: %u", m_stat_staged_count, m_stat_commit_count);
+    GetLoggerM(eLogType::Info)->Log("Attribute Batches: %u (written: %u, unchanged: %u, merged: %u)", m_stat_batch_count, m_stat_batch_write_count, m_stat_batch_unchanged_count, m_stat_batch_merged_count);
+    uint32_t requested_x10, reported_x10;
+    m_report_policy.get_rates(esp_timer_get_time(), &requested_x10, &reported_x10);
+    GetLoggerM(eLogType::Info)->Log("Device Updates: %u.%u/s -> Reports: %u.%u/s (total %u -> %u, interval %u ms)",
+        requested_x10 / 10, requested_x10 % 10, reported_x10 / 10, reported_x10 % 10,
+        m_report_policy.get_requested_count(), m_report_policy.get_reported_count(), m_report_policy.get_interval());
+}
+
+void CDevice::matter_log_attribute_change(const char *cluster_name, uint32_t cluster_id, const char *attribute_name, uint32_t attribute_id, esp_matter_attr_val_t *value)
+{
+    int32_t temp;
+    switch (value->type) {
+    case ESP_MATTER_VAL_TYPE_BOOLEAN:
+        temp = value->val.b;
+        break;
+    case ESP_MATTER_VAL_TYPE_UINT8:
+    case ESP_MATTER_VAL_TYPE_ENUM8:
+    case ESP_MATTER_VAL_TYPE_BITMAP8:
+    case ESP_MATTER_VAL_TYPE_NULLABLE_UINT8:
+        temp = value->val.u8;
+        break;
+    case ESP_MATTER_VAL_TYPE_UINT16:
+    case ESP_MATTER_VAL_TYPE_ENUM16:
+    case ESP_MATTER_VAL_TYPE_BITMAP16:
+    case ESP_MATTER_VAL_TYPE_NULLABLE_UINT16:
+        temp = value->val.u16;
+        break;
+    case ESP_MATTER_VAL_TYPE_INT8:
+    case ESP_MATTER_VAL_TYPE_NULLABLE_INT8:
+        temp = value->val.i8;
+        break;
+    case ESP_MATTER_VAL_TYPE_INT16:
+    case ESP_MATTER_VAL_TYPE_NULLABLE_INT16:
+        temp = value->val.i16;
+        break;
+    default:
+        temp = value->val.i32;
+        break;
+    }
+    GetLogger(eLogType::Info)->Log("MATTER::PRE_UPDATE >> cluster: %s(0x%04X), attribute: %s(0x%04X), value: %d", cluster_name, cluster_id, attribute_name, attribute_id, temp);
+}
+
 void CDevice::toggle_state_action()
 {
     
@@ -0,0 +1,268 @@
+#include "device_light.h"
+#include "system.h"
+#include "logger.h"
+#include "ws2812.h"
+#include <esp_matter_endpoint.h>
+#include <esp_matter_attribute_utils.h>
+
+/**
+ * @brief only the composition selected by LIGHT_TYPE / BRIDGE_MODE is used by the firmware,
+ * the others are instantiated here so every build checks them (attribute table, batch size, device type)
+ */
+static_assert(CDeviceOnOffLight::device_type == eLightDeviceType::OnOff && CDeviceOnOffLight::color_features == 0, "on/off light");
+static_assert(CDeviceLevelControlLight::device_type == eLightDeviceType::Dimmable && CDeviceLevelControlLight::color_features == 0, "dimmable light");
+static_assert(CDeviceColorControlLight::device_type == eLightDeviceType::Color && CDeviceColorControlLight::color_features == 0x1F, "color light (HS, EHUE, CL, XY, CT)");
+static_assert(CDeviceBridgedLight::device_type == eLightDeviceType::Dimmable && !CDeviceBridgedLight::saves_state, "bridged light");
+
+void CLightStripOutput::set_white()
+{
+    GetWS2812Ctrl()->set_common_color(255, 255, 255);
+}
+
+void CLightStripOutput::set_brightness(bool on, uint8_t level)
+{
+    GetWS2812Ctrl()->set_brightness(on ? level : 0);
+}
+
+void CLightStripOutput::set_hue_saturation(uint16_t enhanced_hue, uint8_t saturation)
+{
+    GetWS2812Ctrl()->set_hue(enhanced_hue, false);
+    GetWS2812Ctrl()->set_saturation((uint16_t)REMAP_TO_RANGE((uint32_t)saturation, 254, 65535));
+}
+
+void CLightStripOutput::set_xy(uint16_t x, uint16_t y)
+{
+    GetWS2812Ctrl()->set_cie_x(x, false);
+    GetWS2812Ctrl()->set_cie_y(y);
+}
+
+void CLightStripOutput::set_temperature(uint16_t mireds)
+{
+    GetWS2812Ctrl()->set_temperature(mireds);
+}
+
+void CLightStripOutput::start_color_loop(uint8_t direction, uint16_t time_sec, uint16_t start_hue, uint8_t saturation)
+{
+    // saturation of the loop is kept even if the last color was xy or color temperature
+    GetWS2812Ctrl()->set_saturation((uint16_t)REMAP_TO_RANGE((uint32_t)saturation, 254, 65535), false);
+    GetWS2812Ctrl()->set_color_loop(true, direction, time_sec, start_hue);
+}
+
+void CLightStripOutput::set_hue_listener(void (*listener)(void *context, uint16_t hue), void *context)
+{
+    GetWS2812Ctrl()->set_color_loop_listener(listener, context);
+}
+
+void CLightStripOutput::stop_color_loop()
+{
+    GetWS2812Ctrl()->set_color_loop(false);
+}
+
+bool CLightStripOutput::is_color_loop_active()
+{
+    return GetWS2812Ctrl()->is_color_loop_active();
+}
+
+uint16_t CLightStripOutput::get_hue()
+{
+    return GetWS2812Ctrl()->get_hue();
+}
+
+CLightSegmentOutput::CLightSegmentOutput(int pixel_start, int pixel_count)
+{
+    m_pixel_start = pixel_start;
+    m_pixel_count = pixel_count;
+    m_segment = -1;
+}
+
+void CLightSegmentOutput::attach(uint16_t endpoint_id)
+{
+    m_segment = GetWS2812Ctrl()->add_segment(endpoint_id, m_pixel_start, m_pixel_count);
+}
+
+void CLightSegmentOutput::set_white()
+{
+    GetWS2812Ctrl()->set_segment_color(m_segment, 255, 255, 255);
+}
+
+void CLightSegmentOutput::set_brightness(bool on, uint8_t level)
+{
+    GetWS2812Ctrl()->set_segment_state(m_segment, on, level);
+}
+
+void CLightSegmentOutput::set_hue_saturation(uint16_t enhanced_hue, uint8_t saturation)
+{
+    rgb_t rgb = hsv_t(enhanced_hue, (uint16_t)REMAP_TO_RANGE((uint32_t)saturation, 254, 65535)).conv2rgb();
+    GetWS2812Ctrl()->set_segment_color(m_segment, rgb.r, rgb.g, rgb.b);
+}
+
+void CLightSegmentOutput::set_xy(uint16_t x, uint16_t y)
+{
+    rgb_t rgb = xy_t(x, y).conv2rgb();
+    GetWS2812Ctrl()->set_segment_color(m_segment, rgb.r, rgb.g, rgb.b);
+}
+
+void CLightSegmentOutput::set_temperature(uint16_t mireds)
+{
+    rgb_t rgb = xy_t::from_mireds(mireds).conv2rgb();
+    GetWS2812Ctrl()->set_segment_color(m_segment, rgb.r, rgb.g, rgb.b);
+}
+
+CDeviceLightBase::CDeviceLightBase(eLightDeviceType device_type, esp_matter::endpoint_t *parent)
+{
+    m_device_type = device_type;
+    m_endpoint_parent = parent;
+}
+
+bool CDeviceLightBase::matter_add_endpoint()
+{
+    esp_matter::node_t *root = GetSystem()->get_root_node();
+    uint8_t flags = esp_matter::ENDPOINT_FLAG_DESTROYABLE;
+    if (m_endpoint_parent) {
+        flags |= esp_matter::ENDPOINT_FLAG_BRIDGE;
+    }
+
+    switch (m_device_type) {
+    case eLightDeviceType::OnOff: {
+        esp_matter::endpoint::on_off_light::config_t config_endpoint;
+        config_endpoint.on_off.on_off = false;
+        config_endpoint.on_off.lighting.start_up_on_off = nullptr;
+        m_endpoint = esp_matter::endpoint::on_off_light::create(root, &config_endpoint, flags, nullptr);
+        break;
+    }
+    case eLightDeviceType::Dimmable: {
+        esp_matter::endpoint::dimmable_light::config_t config_endpoint;
+        config_endpoint.on_off.on_off = false;
+        config_endpoint.on_off.lighting.start_up_on_off = nullptr;
+        config_endpoint.level_control.current_level = (uint8_t)m_state.get(eStateField::Level);
+        config_endpoint.level_control.lighting.min_level = 1;
+        config_endpoint.level_control.lighting.max_level = 254;
+        config_endpoint.level_control.lighting.start_up_current_level = nullptr;
+        m_endpoint = esp_matter::endpoint::dimmable_light::create(root, &config_endpoint, flags, nullptr);
+        break;
+    }
+    case eLightDeviceType::Color: {
+        esp_matter::endpoint::extended_color_light::config_t config_endpoint;
+        config_endpoint.on_off.on_off = false;
+        config_endpoint.on_off.lighting.start_up_on_off = nullptr;
+        config_endpoint.level_control.current_level = (uint8_t)m_state.get(eStateField::Level);
+        config_endpoint.level_control.lighting.min_level = 1;
+        config_endpoint.level_control.lighting.max_level = 254;
+        config_endpoint.level_control.lighting.start_up_current_level = nullptr;
+        /**
+        * 3.2.7.9. Color Mode Attribute
+        * The ColorMode attribute indicates which attributes are currently determining the color of the device.
+        * The value of the ColorMode attribute cannot be written directly -
+        * it is set upon reception of any command in section Commands to the appropriate mode for that command.
+        */
+        uint8_t color_mode = COLOR_MODE;
+        config_endpoint.color_control.color_mode = color_mode;
+        config_endpoint.color_control.enhanced_color_mode = color_mode;
+        m_endpoint = esp_matter::endpoint::extended_color_light::create(root, &config_endpoint, flags, nullptr);
+        break;
+    }
+    }
+    if (!m_endpoint) {
+        GetLogger(eLogType::Error)->Log("Failed to create endpoint");
+        return false;
+    }
+
+    if (m_endpoint_parent) {
+        /**
+        * bridged node device type (Bridged Device Basic Information cluster)를 추가하고
+        * aggregator endpoint의 하위 endpoint로 등록한다
+        */
+        esp_matter::endpoint::bridged_node::config_t config_bridged;
+        esp_err_t ret = esp_matter::endpoint::bridged_node::add(m_endpoint, &config_bridged);
+        if (ret != ESP_OK) {
+            GetLogger(eLogType::Error)->Log("Failed to add bridged node device type (ret: %d)", ret);
+            return false;
+        }
+        ret = esp_matter::endpoint::set_parent_endpoint(m_endpoint, m_endpoint_parent);
+        if (ret != ESP_OK) {
+            GetLogger(eLogType::Error)->Log("Failed to set parent endpoint (ret: %d)", ret);
+            return false;
+        }
+    }
+
+    return CDevice::matter_add_endpoint();
+}
+
+bool CDeviceLightBase::matter_restore_attribute(uint32_t cluster_id, uint32_t attribute_id, eStateField field)
+{
+    esp_matter_attr_val_t val = esp_matter_invalid(NULL);
+    if (!matter_get_attribute_value(cluster_id, attribute_id, &val)) {
+        return false;
+    }
+    m_state.set(field, get_matter_value(&val), eStateSource::Restore);
+    return true;
+}
+
+bool CDeviceLightBase::matter_defer_persistence(uint32_t cluster_id, uint32_t attribute_id)
+{
+    esp_matter::cluster_t *cluster = esp_matter::cluster::get(m_endpoint, cluster_id);
+    esp_matter::attribute_t *attribute = cluster ? esp_matter::attribute::get(cluster, attribute_id) : nullptr;
+    if (!attribute) {
+        return false;
+    }
+
+    esp_err_t ret = esp_matter::attribute::set_deferred_persistence(attribute);
+    if (ret != ESP_OK) {
+        GetLogger(eLogType::Warning)->Log("Failed to defer persistence (cluster 0x%04X, attribute 0x%04X, ret: %d)", cluster_id, attribute_id, ret);
+        return false;
+    }
+
+    return true;
+}
+
+void CDeviceLightBase::matter_check_feature_result(const char *name, esp_err_t ret)
+{
+    if (ret != ESP_OK) {
+        GetLogger(eLogType::Warning)->Log("Failed to add %s feature (ret: %d)", name, ret);
+    }
+}
+
+esp_matter::cluster_t* CDeviceLightBase::matter_get_color_control_cluster()
+{
+    return esp_matter::cluster::get(m_endpoint, chip::app::Clusters::ColorControl::Id);
+}
+
+void CDeviceLightBase::matter_set_color_capabilities(uint32_t color_features)
+{
+    /**
+    * feature map & color capabilities 속성을 바꿔준다
+    * 3.2.5. Features
+    * | Bit | Code |     Feature       |
+    * |  0  | HS   | Hue/Saturation    |
+    * |  1  | EHUE | Enhanced Hue      |
+    * |  2  | CL   | Color Loop        |
+    * |  3  | XY   | XY                |
+    * |  4  | CT   | Color Temperature |
+    */
+    esp_err_t ret;
+    esp_matter::cluster_t *cluster = matter_get_color_control_cluster();
+    esp_matter::attribute_t *attribute = esp_matter::attribute::get(cluster, chip::app::Clusters::Globals::Attributes::FeatureMap::Id);
+    esp_matter_attr_val_t val = esp_matter_invalid(NULL);
+    esp_matter::attribute::get_val(attribute, &val);
+    val.val.u32 = color_features;
+    ret = esp_matter::attribute::set_val(attribute, &val);
+    if (ret != ESP_OK) {
+        GetLogger(eLogType::Warning)->Log("Failed to change feature map value (ret: %d)", ret);
+    }
+    attribute = esp_matter::attribute::get(cluster, chip::app::Clusters::ColorControl::Attributes::ColorCapabilities::Id);
+    esp_matter::attribute::get_val(attribute, &val);
+    val.val.u16 = (uint16_t)color_features;
+    ret = esp_matter::attribute::set_val(attribute, &val);
+    if (ret != ESP_OK) {
+        GetLogger(eLogType::Warning)->Log("Failed to change color capabilities value (ret: %d)", ret);
+    }
+}
+
+uint8_t CDeviceLightBase::matter_get_color_mode()
+{
+    esp_matter_attr_val_t val = esp_matter_invalid(NULL);
+    if (matter_get_attribute_value(chip::app::Clusters::ColorControl::Id, chip::app::Clusters::ColorControl::Attributes::ColorMode::Id, &val)) {
+        return val.val.u8;
+    }
+    return COLOR_MODE;
+}
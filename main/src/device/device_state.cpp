@@ -0,0 +1,183 @@
+#include "device_state.h"
+#include "logger.h"
+#include <string.h>
+
+typedef struct state_field_info_t {
+    const char *name;
+    eStateType type;
+    uint16_t default_value;
+} state_field_info_t;
+
+static const state_field_info_t s_field_info[STATE_FIELD_COUNT] = {
+    {"OnOff", eStateType::Bool, 0},
+    {"Level", eStateType::Uint8, 254},
+    {"Hue", eStateType::Uint8, 0},
+    {"EnhancedHue", eStateType::Uint16, 0},
+    {"Saturation", eStateType::Uint8, 0},
+    {"X", eStateType::Uint16, 20493},   // D65 white point
+    {"Y", eStateType::Uint16, 21561},
+    {"ColorTemperature", eStateType::Uint16, 250},  // mireds (4000K)
+    {"ColorLoopActive", eStateType::Uint8, 0},
+    {"ColorLoopDirection", eStateType::Uint8, 1},
+    {"ColorLoopTime", eStateType::Uint16, 25},
+    {"ColorLoopStartHue", eStateType::Uint16, 0},
+};
+
+CDeviceState::CDeviceState()
+{
+#ifndef UNIT_TEST
+    portMUX_INITIALIZE(&m_lock);
+#endif
+    for (int i = 0; i < STATE_FIELD_COUNT; i++) {
+        m_fields[i].value = s_field_info[i].default_value;
+        m_fields[i].generation = 1;     // 0 = not an echo (see CDevice::matter_get_echo_generation)
+        m_fields[i].published_generation = 0;
+    }
+    memset(m_listeners, 0, sizeof(m_listeners));
+    m_listener_count = 0;
+    m_change_count = 0;
+    m_unchanged_count = 0;
+    m_echo_count = 0;
+    m_stale_echo_count = 0;
+}
+
+CDeviceState::~CDeviceState()
+{
+
+}
+
+void CDeviceState::lock()
+{
+#ifdef UNIT_TEST
+    m_mutex.lock();
+#else
+    portENTER_CRITICAL(&m_lock);
+#endif
+}
+
+void CDeviceState::unlock()
+{
+#ifdef UNIT_TEST
+    m_mutex.unlock();
+#else
+    portEXIT_CRITICAL(&m_lock);
+#endif
+}
+
+uint16_t CDeviceState::get(eStateField field)
+{
+    return m_fields[(int)field].value;
+}
+
+uint16_t CDeviceState::get(eStateField field, uint32_t *generation)
+{
+    lock();
+    uint16_t value = m_fields[(int)field].value;
+    *generation = m_fields[(int)field].generation;
+    unlock();
+    return value;
+}
+
+uint32_t CDeviceState::get_generation(eStateField field)
+{
+    return m_fields[(int)field].generation;
+}
+
+bool CDeviceState::set(eStateField field, uint16_t value, eStateSource source)
+{
+    switch (get_field_type(field)) {
+    case eStateType::Bool:
+        value = value ? 1 : 0;
+        break;
+    case eStateType::Uint8:
+        value &= 0xFF;
+        break;
+    default:
+        break;
+    }
+
+    lock();
+    field_t *item = &m_fields[(int)field];
+    if (item->value == value) {
+        m_unchanged_count++;
+        unlock();
+        return false;
+    }
+    item->value = value;
+    item->generation++;
+    m_change_count++;
+    int listener_count = m_listener_count;
+    unlock();
+
+    for (int i = 0; i < listener_count; i++) {
+        m_listeners[i].func(m_listeners[i].context, field, value, source);
+    }
+
+    return true;
+}
+
+bool CDeviceState::add_listener(state_listener_t listener, void *context)
+{
+    lock();
+    if (m_listener_count >= STATE_LISTENER_MAX) {
+        unlock();
+        GetLogger(eLogType::Error)->Log("Too many state listeners");
+        return false;
+    }
+    m_listeners[m_listener_count].func = listener;
+    m_listeners[m_listener_count].context = context;
+    m_listener_count++;
+    unlock();
+
+    return true;
+}
+
+uint32_t CDeviceState::mark_published(eStateField field)
+{
+    lock();
+    field_t *item = &m_fields[(int)field];
+    item->published_generation = item->generation;
+    uint32_t generation = item->generation;
+    unlock();
+
+    return generation;
+}
+
+bool CDeviceState::confirm_echo(eStateField field, uint32_t generation)
+{
+    bool republish = false;
+
+    lock();
+    field_t *item = &m_fields[(int)field];
+    if (item->generation == generation) {
+        m_echo_count++;
+    } else {
+        /**
+         * field has changed after the write (ex: controller write handled before the echo),
+         * matter attribute storage holds the older value of the write unless a newer write follows
+         */
+        m_stale_echo_count++;
+        republish = item->published_generation < item->generation;
+    }
+    unlock();
+
+    return republish;
+}
+
+const char* CDeviceState::get_field_name(eStateField field)
+{
+    return (int)field < STATE_FIELD_COUNT ? s_field_info[(int)field].name : "?";
+}
+
+eStateType CDeviceState::get_field_type(eStateField field)
+{
+    return (int)field < STATE_FIELD_COUNT ? s_field_info[(int)field].type : eStateType::Uint16;
+}
+
+void CDeviceState::print_state_info()
+{
+    GetLoggerM(eLogType::Info)->Log("Changes: %u, Unchanged Writes: %u, Echoes: %u (stale: %u)", m_change_count, m_unchanged_count, m_echo_count, m_stale_echo_count);
+    for (int i = 0; i < STATE_FIELD_COUNT; i++) {
+        GetLoggerM(eLogType::Info)->Log("  %s: %u (generation: %u, published: %u)", s_field_info[i].name, m_fields[i].value, m_fields[i].generation, m_fields[i].published_generation);
+    }
+}
@@ -0,0 +1,158 @@
+#include "report_policy.h"
+#include "definition.h"
+#include <string.h>
+
+CReportPolicy::CReportPolicy()
+{
+#ifndef UNIT_TEST
+    portMUX_INITIALIZE(&m_lock);
+#endif
+    memset(m_fields, 0, sizeof(m_fields));
+    m_interval_us = (int64_t)DEVICE_REPORT_INTERVAL_MS * 1000;
+    m_requested_count = 0;
+    m_reported_count = 0;
+    m_rate_requested_count = 0;
+    m_rate_reported_count = 0;
+    m_tm_rate = 0;
+}
+
+CReportPolicy::~CReportPolicy()
+{
+
+}
+
+void CReportPolicy::lock()
+{
+#ifdef UNIT_TEST
+    m_mutex.lock();
+#else
+    portENTER_CRITICAL(&m_lock);
+#endif
+}
+
+void CReportPolicy::unlock()
+{
+#ifdef UNIT_TEST
+    m_mutex.unlock();
+#else
+    portEXIT_CRITICAL(&m_lock);
+#endif
+}
+
+void CReportPolicy::mark_reported(field_t *item, int64_t now_us)
+{
+    item->pending = false;
+    item->tm_last_report = now_us;
+    m_reported_count++;
+}
+
+bool CReportPolicy::begin_transition(eStateField field, uint32_t cluster_id, uint32_t attribute_id, int64_t now_us)
+{
+    lock();
+    field_t *item = &m_fields[(int)field];
+    bool started = !item->in_transition;
+    item->in_transition = true;
+    item->cluster_id = cluster_id;
+    item->attribute_id = attribute_id;
+    if (started) {
+        m_requested_count++;
+        mark_reported(item, now_us);
+    }
+    unlock();
+
+    return started;
+}
+
+bool CReportPolicy::end_transition(eStateField field, int64_t now_us)
+{
+    lock();
+    field_t *item = &m_fields[(int)field];
+    bool report = item->in_transition && item->pending;
+    item->in_transition = false;
+    if (report) {
+        mark_reported(item, now_us);
+    }
+    item->pending = false;
+    unlock();
+
+    return report;
+}
+
+bool CReportPolicy::is_in_transition(eStateField field)
+{
+    return m_fields[(int)field].in_transition;
+}
+
+bool CReportPolicy::has_transition()
+{
+    for (int i = 0; i < STATE_FIELD_COUNT; i++) {
+        if (m_fields[i].in_transition) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CReportPolicy::request(eStateField field, int64_t now_us, uint32_t updates/*=1*/)
+{
+    bool report = true;
+
+    lock();
+    m_requested_count += updates;
+    field_t *item = &m_fields[(int)field];
+    if (item->in_transition && now_us - item->tm_last_report < m_interval_us) {
+        item->pending = true;
+        report = false;
+    } else {
+        mark_reported(item, now_us);
+    }
+    unlock();
+
+    return report;
+}
+
+bool CReportPolicy::take_pending(eStateField field, int64_t now_us, uint32_t *cluster_id, uint32_t *attribute_id)
+{
+    bool report = false;
+
+    lock();
+    field_t *item = &m_fields[(int)field];
+    if (item->pending && now_us - item->tm_last_report >= m_interval_us) {
+        *cluster_id = item->cluster_id;
+        *attribute_id = item->attribute_id;
+        mark_reported(item, now_us);
+        report = true;
+    }
+    unlock();
+
+    return report;
+}
+
+void CReportPolicy::get_rates(int64_t now_us, uint32_t *requested_x10, uint32_t *reported_x10)
+{
+    lock();
+    int64_t elapsed_ms = (now_us - m_tm_rate) / 1000;
+    uint32_t requested = m_requested_count - m_rate_requested_count;
+    uint32_t reported = m_reported_count - m_rate_reported_count;
+    m_rate_requested_count = m_requested_count;
+    m_rate_reported_count = m_reported_count;
+    m_tm_rate = now_us;
+    unlock();
+
+    if (elapsed_ms <= 0) {
+        *requested_x10 = 0;
+        *reported_x10 = 0;
+        return;
+    }
+    *requested_x10 = (uint32_t)((int64_t)requested * 10000 / elapsed_ms);
+    *reported_x10 = (uint32_t)((int64_t)reported * 10000 / elapsed_ms);
+}
+
+void CReportPolicy::reset_rates(int64_t now_us)
+{
+    lock();
+    m_rate_requested_count = m_requested_count;
+    m_rate_reported_count = m_reported_count;
+    m_tm_rate = now_us;
+    unlock();
+}
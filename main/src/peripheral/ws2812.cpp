@@ -1,7 +1,9 @@
 #include "ws2812.h"
 #include "logger.h"
-#include "memory.h"
 #include "driver/ledc.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
+#include <string.h>
 
 CWS2812Ctrl* CWS2812Ctrl::_instance = nullptr;
 
@@ -11,6 +13,7 @@ enum CMD_TYPE {
     SETRGB = 0,
     BLINK = 1,
     BLINK_DEMO = 2,
+    COLOR_LOOP = 3,
 };
 
 CWS2812Ctrl::CWS2812Ctrl()
@@ -18,16 +21,45 @@ CWS2812Ctrl::CWS2812Ctrl()
     m_initialized = false;
     m_keep_task_alive = false;
     m_brightness = 0;
+    m_pwm_duty = -1;
     m_common_color = rgb_t();
+    m_common_color_applied = false;
     m_hsv_value = hsv_t();
+    m_xy_value = xy_t();
+    m_framebuffer_mutex = xSemaphoreCreateMutex();
     m_blink_duration_ms = 0;
     m_blink_count = 0;
+    m_color_loop_active = false;
+    m_color_loop_direction = 1;
+    m_color_loop_start_hue = 0;
+    m_color_loop_step = 0;
+    m_color_loop_hue_acc = 0;
+    m_color_loop_tick_us = 0;
+    m_color_loop_listener = nullptr;
+    m_color_loop_listener_context = nullptr;
+    for (int i = 0; i < WS2812_SEGMENT_MAX; i++) {
+        m_segments[i] = led_segment_t();
+    }
+    m_segment_count = 0;
+    portMUX_INITIALIZE(&m_segment_lock);
+    m_frame_depth = 0;
+    m_frame_requested = false;
 
     m_rmt_ch_handle = nullptr;
     m_rmt_enc_base = nullptr;
     m_rmt_enc_bytes = nullptr;
     m_rmt_enc_copy = nullptr;
     m_rmt_state = 0;
+    m_rmt_pixel_index = 0;
+
+    m_stat_frame_count = 0;
+    m_stat_encode_cycles = 0;
+    m_stat_transmit_us = 0;
+    m_stat_transmit_us_max = 0;
+    m_stat_skip_duty_count = 0;
+    m_stat_skip_color_count = 0;
+    m_stat_segment_update_count = 0;
+    m_stat_segment_frame_count = 0;
 }
 
 CWS2812Ctrl::~CWS2812Ctrl()
@@ -51,18 +83,43 @@ static size_t func_rmt_encode(rmt_encoder_t *encoder, rmt_channel_handle_t chann
     rmt_encoder_handle_t enc_copy = obj->get_rmt_encoder_copy();
     rmt_symbol_word_t reset_code = obj->get_rmt_reset_code();
 
+    CFrameBuffer *fb = obj->get_framebuffer();
+    uint32_t cycles_begin = esp_cpu_get_cycle_count();
+
     rmt_encode_state_t session_state = (rmt_encode_state_t)0;
     int state = 0;
     size_t encoded_symbols = 0;
 
     switch (obj->get_rmt_state()) {
     case 0:
-        encoded_symbols += enc_bytes->encode(enc_bytes, channel, primary_data, data_size, &session_state);
-        if (session_state & RMT_ENCODING_COMPLETE) {
-            obj->set_rmt_state(1);
-        }
-        if (session_state & RMT_ENCODING_MEM_FULL) {
-            state |= RMT_ENCODING_MEM_FULL;
+        if (fb->get_format() == FB_FORMAT_PALETTE) {
+            // expand palette index to wire order pixel bytes while encoding
+            const uint8_t *indices = (const uint8_t *)primary_data;
+            size_t index = obj->get_rmt_pixel_index();
+            while (index < data_size) {
+                const uint8_t *entry = fb->get_palette_wire_entry(indices[index]);
+                encoded_symbols += enc_bytes->encode(enc_bytes, channel, entry, led_chip_t::bytes_per_pixel, &session_state);
+                if (session_state & RMT_ENCODING_COMPLETE) {
+                    index++;
+                }
+                if (session_state & RMT_ENCODING_MEM_FULL) {
+                    state |= RMT_ENCODING_MEM_FULL;
+                    break;
+                }
+            }
+            obj->set_rmt_pixel_index(index);
+            if (index >= data_size) {
+                obj->set_rmt_pixel_index(0);
+                obj->set_rmt_state(1);
+            }
+        } else {
+            encoded_symbols += enc_bytes->encode(enc_bytes, channel, primary_data, data_size, &session_state);
+            if (session_state & RMT_ENCODING_COMPLETE) {
+                obj->set_rmt_state(1);
+            }
+            if (session_state & RMT_ENCODING_MEM_FULL) {
+                state |= RMT_ENCODING_MEM_FULL;
+            }
         }
         break;
     case 1:
@@ -79,6 +136,7 @@ static size_t func_rmt_encode(rmt_encoder_t *encoder, rmt_channel_handle_t chann
         break;
     }
 
+    obj->add_rmt_encode_cycles(esp_cpu_get_cycle_count() - cycles_begin);
     *ret_state = (rmt_encode_state_t)state;
     return encoded_symbols;
 }
@@ -91,6 +149,7 @@ static esp_err_t func_rmt_reset(rmt_encoder_t *encoder)
     rmt_encoder_reset(enc_bytes);
     rmt_encoder_reset(enc_copy);
     obj->set_rmt_state(0);
+    obj->set_rmt_pixel_index(0);
     return ESP_OK;
 }
 
@@ -114,7 +173,12 @@ bool CWS2812Ctrl::initialize()
 {
     m_initialized = false;
 
-    m_pixel_values.resize(WS2812_ARRAY_COUNT);
+    if (!m_framebuffer.initialize((eFrameBufferFormat)WS2812_FRAMEBUFFER_FORMAT, WS2812_ARRAY_COUNT)) {
+        GetLogger(eLogType::Error)->Log("Failed to initialize framebuffer");
+        return false;
+    }
+    GetLogger(eLogType::Info)->Log("led chip: %s, framebuffer format: %s, pixels: %d, memory: %d bytes", 
+        led_chip_t::name, m_framebuffer.get_format_name(), (int)m_framebuffer.get_pixel_count(), (int)m_framebuffer.get_memory_size());
 
     if (!init_ledc())
         return false;
@@ -127,14 +191,7 @@ bool CWS2812Ctrl::initialize()
     xTaskCreate(func_command, "TASK_WS2812_CTRL", TASK_STACK_DEPTH, this, TASK_PRIORITY_WS2812, &m_task_handle);
 
     m_initialized = true;
-
-    uint8_t brightness = 0;
-    GetMemory()->load_ws2812_brightness(&brightness);
-    set_brightness(brightness);
-
-    uint8_t red = 0, green = 0, blue = 0;
-    GetMemory()->load_ws2812_color(&red, &green, &blue);
-    set_common_color(red, green, blue);
+    // brightness & color are restored by the device from matter attribute storage
 
     return true;
 }
@@ -202,13 +259,18 @@ bool CWS2812Ctrl::init_rmt()
     m_rmt_enc_base->del = func_rmt_delete;
 
     rmt_bytes_encoder_config_t rmt_bytes_enc_cfg;
-    rmt_bytes_enc_cfg.bit0.duration0 = 0.3 * RMT_RESOLUTION_HZ / 1000000;  // T0H=300ns
+    // bit timing is fixed at compile time by LED chip traits (led_chip.h)
+    constexpr uint32_t t0h_ticks = led_chip_ns_to_ticks(led_chip_t::t0h_ns, RMT_RESOLUTION_HZ);
+    constexpr uint32_t t0l_ticks = led_chip_ns_to_ticks(led_chip_t::t0l_ns, RMT_RESOLUTION_HZ);
+    constexpr uint32_t t1h_ticks = led_chip_ns_to_ticks(led_chip_t::t1h_ns, RMT_RESOLUTION_HZ);
+    constexpr uint32_t t1l_ticks = led_chip_ns_to_ticks(led_chip_t::t1l_ns, RMT_RESOLUTION_HZ);
+    rmt_bytes_enc_cfg.bit0.duration0 = t0h_ticks;
     rmt_bytes_enc_cfg.bit0.level0 = 1;
-    rmt_bytes_enc_cfg.bit0.duration1 = 0.9 * RMT_RESOLUTION_HZ / 1000000;  // T0L=900ns
+    rmt_bytes_enc_cfg.bit0.duration1 = t0l_ticks;
     rmt_bytes_enc_cfg.bit0.level1 = 0;
-    rmt_bytes_enc_cfg.bit1.duration0 = 0.9 * RMT_RESOLUTION_HZ / 1000000;  // T1H=900ns
+    rmt_bytes_enc_cfg.bit1.duration0 = t1h_ticks;
     rmt_bytes_enc_cfg.bit1.level0 = 1;
-    rmt_bytes_enc_cfg.bit1.duration1 = 0.3 * RMT_RESOLUTION_HZ / 1000000;  // T1L=300ns
+    rmt_bytes_enc_cfg.bit1.duration1 = t1l_ticks;
     rmt_bytes_enc_cfg.bit1.level1 = 0;
     rmt_bytes_enc_cfg.flags.msb_first = 1;
     ret = rmt_new_bytes_encoder(&rmt_bytes_enc_cfg, &m_rmt_enc_bytes);
@@ -224,7 +286,7 @@ bool CWS2812Ctrl::init_rmt()
         return false;
     }
 
-    uint32_t reset_ticks = RMT_RESOLUTION_HZ / 1000000 * 300 / 2; // reset code = 300us
+    constexpr uint32_t reset_ticks = led_chip_ns_to_ticks(led_chip_t::reset_us * 1000, RMT_RESOLUTION_HZ) / 2;
     m_rmt_reset_code.duration0 = reset_ticks;
     m_rmt_reset_code.level0 = 0;
     m_rmt_reset_code.duration1 = reset_ticks;
@@ -265,6 +327,11 @@ bool CWS2812Ctrl::set_pwm_duty(uint32_t duty, bool verbose/*=true*/)
         return false;
     }
 
+    if ((int)duty == m_pwm_duty) {
+        m_stat_skip_duty_count++;
+        return true;
+    }
+
     esp_err_t ret;
     ret = ledc_set_duty(LEDC_HIGH_SPEED_MODE, LEDC_CHANNEL_0, duty);
     if (ret != ESP_OK) {
@@ -275,8 +342,10 @@ bool CWS2812Ctrl::set_pwm_duty(uint32_t duty, bool verbose/*=true*/)
     ret = ledc_update_duty(LEDC_HIGH_SPEED_MODE, LEDC_CHANNEL_0);
     if (ret != ESP_OK) {
         GetLogger(eLogType::Error)->Log("Failed to set update duty (ret: %d)", ret);
+        m_pwm_duty = -1;
         return false;
     }
+    m_pwm_duty = (int)duty;
     
     if (verbose) {
         GetLogger(eLogType::Info)->Log("set pwm duty: %d", duty);
@@ -288,19 +357,14 @@ bool CWS2812Ctrl::set_pwm_duty(uint32_t duty, bool verbose/*=true*/)
 bool CWS2812Ctrl::set_pixel_rgb_value(int index, uint8_t red, uint8_t green, uint8_t blue, bool update/*=true*/)
 {
     bool result = true;
-    if (index >= 0 && index < m_pixel_values.size()) {
-        m_pixel_values[index].r = red;
-        m_pixel_values[index].g = green;
-        m_pixel_values[index].b = blue;
-    } else if (index < 0) {
-        for (auto & rgb : m_pixel_values) {
-            rgb.r = red;
-            rgb.g = green;
-            rgb.b = blue;
-        }
+    xSemaphoreTake(m_framebuffer_mutex, portMAX_DELAY);
+    if (index >= 0) {
+        result = m_framebuffer.set_pixel(index, red, green, blue);
+        m_common_color_applied = false;
     } else {
-        result = false;
+        m_framebuffer.fill(red, green, blue);
     }
+    xSemaphoreGive(m_framebuffer_mutex);
 
     if (result && update) {
         result = update_color();
@@ -314,30 +378,29 @@ bool CWS2812Ctrl::clear_color()
     return set_pixel_rgb_value(-1, 0, 0, 0);
 }
 
-bool CWS2812Ctrl::update_color()
+bool CWS2812Ctrl::send_command(int command)
 {
-    if (!m_initialized) {
-        GetLogger(eLogType::Error)->Log("Not initialized!");
+    // command is copied into the queue (no allocation per frame)
+    if (xQueueSend(m_queue_command, &command, pdMS_TO_TICKS(10)) != pdTRUE) {
+        GetLogger(eLogType::Error)->Log("Failed to add command queue");
         return false;
     }
+    return true;
+}
 
-    int *CMD = new int[1];
-    CMD[0] = SETRGB;
-    if (xQueueSend(m_queue_command, (void *)&CMD, pdMS_TO_TICKS(10)) != pdTRUE) {
-        GetLogger(eLogType::Error)->Log("Failed to add command queue");
-        delete CMD;
+bool CWS2812Ctrl::update_color()
+{
+    if (!m_initialized) {
+        GetLogger(eLogType::Error)->Log("Not initialized!");
         return false;
     }
 
-    return true;
+    return send_command(SETRGB);
 }
 
-bool CWS2812Ctrl::set_brightness(uint8_t value, bool save_memory/*=true*/,  bool verbose/*=true*/)
+bool CWS2812Ctrl::set_brightness(uint8_t value, bool verbose/*=true*/)
 {
     m_brightness = value;
-    if (save_memory) {
-        GetMemory()->save_ws2812_brightness(value);
-    }
 
     uint32_t duty;
     if (value) {
@@ -358,17 +421,21 @@ rgb_t CWS2812Ctrl::get_common_color()
     return m_common_color;
 }
 
-bool CWS2812Ctrl::set_common_color(uint8_t red, uint8_t green, uint8_t blue, bool save_memory/*=true*/)
+bool CWS2812Ctrl::set_common_color(uint8_t red, uint8_t green, uint8_t blue)
 {
+    // ex) hue change while saturation is 0
+    if (m_common_color_applied && m_common_color.r == red && m_common_color.g == green && m_common_color.b == blue) {
+        m_stat_skip_color_count++;
+        return true;
+    }
+
     m_common_color.r = red;
     m_common_color.g = green;
     m_common_color.b = blue;
-    if (save_memory) {
-        GetMemory()->save_ws2812_color(red, green, blue);
-    }
 
     GetLogger(eLogType::Info)->Log("set common color(%d,%d,%d)", red, green, blue);
-    return set_pixel_rgb_value(LED_SET_ALL, red, green, blue, true);
+    m_common_color_applied = set_pixel_rgb_value(LED_SET_ALL, red, green, blue, true);
+    return m_common_color_applied;
 }
 
 bool CWS2812Ctrl::set_hue(uint16_t hue, bool update_color/*=true*/)
@@ -382,7 +449,7 @@ bool CWS2812Ctrl::set_hue(uint16_t hue, bool update_color/*=true*/)
     return result;
 }
 
-bool CWS2812Ctrl::set_saturation(uint8_t saturation, bool update_color/*=true*/)
+bool CWS2812Ctrl::set_saturation(uint16_t saturation, bool update_color/*=true*/)
 {
     bool result = true;
     m_hsv_value.saturation = saturation;
@@ -393,16 +460,212 @@ bool CWS2812Ctrl::set_saturation(uint8_t saturation, bool update_color/*=true*/)
     return result;
 }
 
-bool CWS2812Ctrl::set_temperature(uint32_t temperature)
+uint16_t CWS2812Ctrl::get_hue()
+{
+    return m_hsv_value.hue;
+}
+
+bool CWS2812Ctrl::set_cie_x(uint16_t x, bool update_color/*=true*/)
+{
+    bool result = true;
+    m_xy_value.x = x;
+    if (update_color) {
+        rgb_t rgb_conv = m_xy_value.conv2rgb();
+        result = set_common_color(rgb_conv.r, rgb_conv.g, rgb_conv.b);
+    }
+    return result;
+}
+
+bool CWS2812Ctrl::set_cie_y(uint16_t y, bool update_color/*=true*/)
+{
+    bool result = true;
+    m_xy_value.y = y;
+    if (update_color) {
+        rgb_t rgb_conv = m_xy_value.conv2rgb();
+        result = set_common_color(rgb_conv.r, rgb_conv.g, rgb_conv.b);
+    }
+    return result;
+}
+
+bool CWS2812Ctrl::set_temperature(uint16_t mireds, bool update_color/*=true*/)
+{
+    bool result = true;
+    m_xy_value = xy_t::from_mireds(mireds);
+    if (update_color) {
+        rgb_t rgb_conv = m_xy_value.conv2rgb();
+        result = set_common_color(rgb_conv.r, rgb_conv.g, rgb_conv.b);
+    }
+    return result;
+}
+
+int CWS2812Ctrl::add_segment(uint16_t endpoint_id, int pixel_start, int pixel_count)
+{
+    if (m_segment_count >= WS2812_SEGMENT_MAX) {
+        GetLogger(eLogType::Error)->Log("Segment table is full (%d)", WS2812_SEGMENT_MAX);
+        return -1;
+    }
+
+    // clipped to the strip (segment can be empty)
+    int pixel_total = (int)m_framebuffer.get_pixel_count();
+    pixel_start = MIN(MAX(pixel_start, 0), pixel_total);
+    pixel_count = MIN(MAX(pixel_count, 0), pixel_total - pixel_start);
+
+    portENTER_CRITICAL(&m_segment_lock);
+    int index = m_segment_count;
+    led_segment_t *segment = &m_segments[index];
+    segment->endpoint_id = endpoint_id;
+    segment->pixel_start = (uint16_t)pixel_start;
+    segment->pixel_count = (uint16_t)pixel_count;
+    segment->on = false;
+    segment->level = 254;
+    segment->color = rgb_t(255, 255, 255);
+    segment->dirty = true;
+    m_segment_count++;
+    portEXIT_CRITICAL(&m_segment_lock);
+    request_frame();
+
+    return index;
+}
+
+int CWS2812Ctrl::find_segment(uint16_t endpoint_id)
+{
+    for (int i = 0; i < m_segment_count; i++) {
+        if (m_segments[i].endpoint_id == endpoint_id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool CWS2812Ctrl::set_segment_state(int segment, bool on, uint8_t level)
+{
+    if (segment < 0 || segment >= m_segment_count) {
+        return false;
+    }
+
+    portENTER_CRITICAL(&m_segment_lock);
+    led_segment_t *item = &m_segments[segment];
+    bool changed = item->on != on || item->level != level;
+    item->on = on;
+    item->level = level;
+    item->dirty |= changed;
+    portEXIT_CRITICAL(&m_segment_lock);
+
+    if (!changed) {
+        m_stat_skip_color_count++;
+        return true;
+    }
+    m_stat_segment_update_count++;
+    return request_frame();
+}
+
+bool CWS2812Ctrl::set_segment_color(int segment, uint8_t red, uint8_t green, uint8_t blue)
+{
+    if (segment < 0 || segment >= m_segment_count) {
+        return false;
+    }
+
+    portENTER_CRITICAL(&m_segment_lock);
+    led_segment_t *item = &m_segments[segment];
+    bool changed = item->color.r != red || item->color.g != green || item->color.b != blue;
+    item->color = rgb_t(red, green, blue);
+    item->dirty |= changed;
+    portEXIT_CRITICAL(&m_segment_lock);
+
+    if (!changed) {
+        m_stat_skip_color_count++;
+        return true;
+    }
+    m_stat_segment_update_count++;
+    return request_frame();
+}
+
+void CWS2812Ctrl::begin_frame()
+{
+    portENTER_CRITICAL(&m_segment_lock);
+    m_frame_depth++;
+    portEXIT_CRITICAL(&m_segment_lock);
+}
+
+void CWS2812Ctrl::end_frame()
+{
+    bool send = false;
+
+    portENTER_CRITICAL(&m_segment_lock);
+    if (m_frame_depth > 0) {
+        m_frame_depth--;
+    }
+    if (!m_frame_depth && m_frame_requested) {
+        m_frame_requested = false;
+        send = true;
+    }
+    portEXIT_CRITICAL(&m_segment_lock);
+
+    if (send) {
+        request_frame();
+    }
+}
+
+bool CWS2812Ctrl::request_frame()
 {
-    /*
-    m_hsv_value = convert_temperature_to_hue_saturation(temperature);
-    rgb_t rgb_conv = m_hsv_value.conv2rgb();
-    return set_common_color(rgb_conv.r, rgb_conv.g, rgb_conv.b);
-    */
+    /**
+     * one frame command is in flight at a time, segment changes made before the realtime task
+     * renders (or while begin_frame() is held) go out in the same transmission
+     */
+    portENTER_CRITICAL(&m_segment_lock);
+    bool queue = !m_frame_requested && !m_frame_depth;
+    m_frame_requested = true;
+    portEXIT_CRITICAL(&m_segment_lock);
+
+    if (!queue) {
+        return true;
+    }
+    if (!update_color()) {
+        portENTER_CRITICAL(&m_segment_lock);
+        m_frame_requested = false;
+        portEXIT_CRITICAL(&m_segment_lock);
+        return false;
+    }
+
     return true;
 }
 
+void CWS2812Ctrl::render_segments()
+{
+    led_segment_t segments[WS2812_SEGMENT_MAX];
+    int count = 0;
+
+    // realtime task, changes after this point request the next frame
+    portENTER_CRITICAL(&m_segment_lock);
+    if (!m_frame_depth) {
+        m_frame_requested = false;
+    }
+    for (int i = 0; i < m_segment_count; i++) {
+        if (m_segments[i].dirty) {
+            segments[count++] = m_segments[i];
+            m_segments[i].dirty = false;
+        }
+    }
+    portEXIT_CRITICAL(&m_segment_lock);
+
+    xSemaphoreTake(m_framebuffer_mutex, portMAX_DELAY);
+    for (int i = 0; i < count; i++) {
+        led_segment_t *item = &segments[i];
+        uint32_t level = item->on ? item->level : 0;
+        uint8_t r = (uint8_t)((uint32_t)item->color.r * level / 254);
+        uint8_t g = (uint8_t)((uint32_t)item->color.g * level / 254);
+        uint8_t b = (uint8_t)((uint32_t)item->color.b * level / 254);
+        for (int p = item->pixel_start; p < item->pixel_start + item->pixel_count; p++) {
+            m_framebuffer.set_pixel(p, r, g, b);
+        }
+    }
+    xSemaphoreGive(m_framebuffer_mutex);
+    if (count) {
+        m_common_color_applied = false;
+        m_stat_segment_frame_count++;
+    }
+}
+
 bool CWS2812Ctrl::blink(uint32_t duration_ms/*=1000*/, uint32_t count/*=1*/)
 {
     if (!m_initialized) {
@@ -413,11 +676,7 @@ bool CWS2812Ctrl::blink(uint32_t duration_ms/*=1000*/, uint32_t count/*=1*/)
     m_blink_duration_ms = duration_ms;
     m_blink_count = count;
 
-    int *CMD = new int[1];
-    CMD[0] = BLINK;
-    if (xQueueSend(m_queue_command, (void *)&CMD, pdMS_TO_TICKS(10)) != pdTRUE) {
-        GetLogger(eLogType::Error)->Log("Failed to add command queue");
-        delete CMD;
+    if (!send_command(BLINK)) {
         return false;
     }
 
@@ -434,11 +693,7 @@ bool CWS2812Ctrl::blink_demo()
 
     m_blink_count = 10;
 
-    int *CMD = new int[1];
-    CMD[0] = BLINK_DEMO;
-    if (xQueueSend(m_queue_command, (void *)&CMD, pdMS_TO_TICKS(10)) != pdTRUE) {
-        GetLogger(eLogType::Error)->Log("Failed to add command queue");
-        delete CMD;
+    if (!send_command(BLINK_DEMO)) {
         return false;
     }
 
@@ -446,6 +701,116 @@ bool CWS2812Ctrl::blink_demo()
     return true;
 }
 
+bool CWS2812Ctrl::set_color_loop(bool active, uint8_t direction/*=1*/, uint16_t time_sec/*=25*/, uint16_t start_hue/*=0*/)
+{
+    if (!m_initialized) {
+        GetLogger(eLogType::Error)->Log("Not initialized!");
+        return false;
+    }
+
+    m_color_loop_direction = direction;
+    m_color_loop_start_hue = start_hue;
+    // one full hue cycle (2^32 in Q16.16) per time_sec seconds
+    m_color_loop_step = 0xFFFFFFFF / ((uint32_t)MAX(1, time_sec) * 1000);
+    m_color_loop_active = active;
+
+    if (!send_command(COLOR_LOOP)) {
+        return false;
+    }
+
+    GetLogger(eLogType::Info)->Log("set color loop(active: %d, direction: %d, time: %d, start hue: %d)", active, direction, time_sec, start_hue);
+    return true;
+}
+
+bool CWS2812Ctrl::is_color_loop_active()
+{
+    return m_color_loop_active;
+}
+
+void CWS2812Ctrl::set_color_loop_listener(color_loop_listener_t listener, void *context)
+{
+    m_color_loop_listener_context = context;
+    m_color_loop_listener = listener;
+}
+
+void CWS2812Ctrl::render_color_loop()
+{
+    int64_t now_us = esp_timer_get_time();
+    uint32_t elapsed_ms = (uint32_t)((now_us - m_color_loop_tick_us) / 1000);
+    m_color_loop_tick_us += (int64_t)elapsed_ms * 1000;   // keep sub-millisecond remainder
+
+    uint32_t step = m_color_loop_step * elapsed_ms;
+    if (m_color_loop_direction) {
+        m_color_loop_hue_acc += step;
+    } else {
+        m_color_loop_hue_acc -= step;
+    }
+
+    m_hsv_value.hue = (uint16_t)(m_color_loop_hue_acc >> 16);
+    m_common_color = m_hsv_value.conv2rgb();
+    set_pixel_rgb_value(LED_SET_ALL, m_common_color.r, m_common_color.g, m_common_color.b, false);
+
+    if (m_color_loop_listener) {
+        m_color_loop_listener(m_color_loop_listener_context, m_hsv_value.hue);
+    }
+}
+
+bool CWS2812Ctrl::transmit_pixel_values(int timeout_ms)
+{
+    esp_err_t ret;
+    rmt_transmit_config_t rmt_tx_cfg;
+    rmt_tx_cfg.loop_count = 0;
+    rmt_tx_cfg.flags.eot_level = 0;
+
+    /**
+     * rmt reads the framebuffer zero-copy (wire order pixel bytes or palette index) until rmt_tx_wait_all_done,
+     * drawing tasks wait for the end of the frame instead of tearing it
+     */
+    int64_t tick_us = esp_timer_get_time();
+    xSemaphoreTake(m_framebuffer_mutex, portMAX_DELAY);
+    set_rmt_state(0);
+    set_rmt_pixel_index(0);
+    ret = rmt_transmit(m_rmt_ch_handle, m_rmt_enc_base, m_framebuffer.data(), m_framebuffer.data_size(), &rmt_tx_cfg);
+    if (ret != ESP_OK) {
+        xSemaphoreGive(m_framebuffer_mutex);
+        GetLogger(eLogType::Error)->Log("Failed to transmit rmt (return code: %u)", ret);
+        return false;
+    }
+    ret = rmt_tx_wait_all_done(m_rmt_ch_handle, timeout_ms);
+    xSemaphoreGive(m_framebuffer_mutex);
+    if (ret != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to rmt wait all done (timeout: %d, return code: %u)", timeout_ms, ret);
+        return false;
+    }
+
+    uint32_t elapsed_us = (uint32_t)(esp_timer_get_time() - tick_us);
+    m_stat_frame_count++;
+    m_stat_transmit_us += elapsed_us;
+    m_stat_transmit_us_max = MAX(m_stat_transmit_us_max, elapsed_us);
+
+    return true;
+}
+
+void CWS2812Ctrl::print_framebuffer_info()
+{
+    size_t pixel_count = m_framebuffer.get_pixel_count();
+    GetLoggerM(eLogType::Info)->Log("----- WS2812 -----");
+    GetLoggerM(eLogType::Info)->Log("LED Chip: %s", led_chip_t::name);
+    GetLoggerM(eLogType::Info)->Log("Framebuffer Format: %s (%d bytes/pixel, %d wire bytes/pixel)", 
+        m_framebuffer.get_format_name(), (int)m_framebuffer.get_bytes_per_pixel(), (int)m_framebuffer.get_wire_bytes_per_pixel());
+    GetLoggerM(eLogType::Info)->Log("Framebuffer Memory: %d bytes (%d pixels)", (int)m_framebuffer.get_memory_size(), (int)pixel_count);
+    if (m_stat_frame_count && pixel_count) {
+        uint32_t cycles_per_pixel = (uint32_t)(m_stat_encode_cycles / m_stat_frame_count / pixel_count);
+        GetLoggerM(eLogType::Info)->Log("Encode Cost: %u cycles/pixel", cycles_per_pixel);
+        GetLoggerM(eLogType::Info)->Log("Frame Transmit Time: avg %u us, max %u us (%u frames)", 
+            (uint32_t)(m_stat_transmit_us / m_stat_frame_count), m_stat_transmit_us_max, m_stat_frame_count);
+    }
+    GetLoggerM(eLogType::Info)->Log("Unchanged Writes Skipped: pwm %u, color %u", m_stat_skip_duty_count, m_stat_skip_color_count);
+    if (m_segment_count) {
+        GetLoggerM(eLogType::Info)->Log("Segments: %d, Updates: %u merged into %u frames", m_segment_count, m_stat_segment_update_count, m_stat_segment_frame_count);
+    }
+}
+
 rmt_channel_handle_t CWS2812Ctrl::get_rmt_channel()
 {
     return m_rmt_ch_handle;
@@ -481,63 +846,84 @@ void CWS2812Ctrl::set_rmt_state(int value)
     m_rmt_state = value;
 }
 
+size_t CWS2812Ctrl::get_rmt_pixel_index()
+{
+    return m_rmt_pixel_index;
+}
+
+void CWS2812Ctrl::set_rmt_pixel_index(size_t value)
+{
+    m_rmt_pixel_index = value;
+}
+
+CFrameBuffer* CWS2812Ctrl::get_framebuffer()
+{
+    return &m_framebuffer;
+}
+
+void CWS2812Ctrl::add_rmt_encode_cycles(uint32_t cycles)
+{
+    m_stat_encode_cycles += cycles;
+}
+
 void CWS2812Ctrl::func_command(void *param)
 {
     CWS2812Ctrl *obj = static_cast<CWS2812Ctrl *>(param);
-    int *cmd_type = nullptr;
+    int cmd_type = 0;
     uint8_t brightness;
     uint32_t delay;
     bool blink_demo = false;
 
-    rmt_transmit_config_t rmt_tx_cfg;
-    rmt_tx_cfg.loop_count = 0;
-    rmt_tx_cfg.flags.eot_level = 0;
-    esp_err_t ret;
-    uint8_t conv_array[WS2812_ARRAY_COUNT * 3] = { 0, };
-    int timeout_ms = (int)(1.2 * WS2812_ARRAY_COUNT * 3 * 8 + 300);
+    TickType_t wait_ticks;
+    int timeout_ms = (int)(1.2 * WS2812_ARRAY_COUNT * obj->m_framebuffer.get_wire_bytes_per_pixel() * 8 + 300);
     timeout_ms = MAX(timeout_ms, 1);
 
     GetLogger(eLogType::Info)->Log("Realtime Task for WS2812 Module Started");
     while (obj->m_keep_task_alive) {
-        if (xQueueReceive(obj->m_queue_command, (void *)&cmd_type, pdMS_TO_TICKS(WS2812_REFRESH_TIME_MS)) == pdTRUE) {
-            if (*cmd_type == SETRGB) {
-                for (size_t i = 0; i < WS2812_ARRAY_COUNT; i++) {
-                    rgb_t rgb = obj->m_pixel_values[i];
-                    conv_array[i * 3 + 0] = rgb.g;
-                    conv_array[i * 3 + 1] = rgb.r;
-                    conv_array[i * 3 + 2] = rgb.b;
-                }
+        // color loop effect requires frame-rate wake up, otherwise wait for command
+        if (obj->m_color_loop_active) {
+            wait_ticks = pdMS_TO_TICKS(WS2812_FRAME_TIME_MS);
+        } else {
+            wait_ticks = pdMS_TO_TICKS(WS2812_REFRESH_TIME_MS);
+        }
 
-                obj->set_rmt_state(0);
-                ret = rmt_transmit(obj->m_rmt_ch_handle, obj->m_rmt_enc_base, conv_array, sizeof(conv_array), &rmt_tx_cfg);
-                if (ret != ESP_OK) {
-                    GetLogger(eLogType::Error)->Log("Failed to transmit rmt (return code: %u)", ret);
+        if (xQueueReceive(obj->m_queue_command, (void *)&cmd_type, wait_ticks) == pdTRUE) {
+            if (cmd_type == SETRGB) {
+                obj->render_segments();
+                if (!obj->m_color_loop_active) {
+                    obj->transmit_pixel_values(timeout_ms);
                 }
-                ret = rmt_tx_wait_all_done(obj->m_rmt_ch_handle, timeout_ms);
-                if (ret != ESP_OK) {
-                    GetLogger(eLogType::Error)->Log("Failed to rmt wait all done (timeout: %d, return code: %u)", timeout_ms, ret);
+            } else if (cmd_type == COLOR_LOOP) {
+                if (obj->m_color_loop_active) {
+                    obj->m_color_loop_hue_acc = (uint32_t)obj->m_color_loop_start_hue << 16;
+                    obj->m_color_loop_tick_us = esp_timer_get_time();
                 }
-            } else if (*cmd_type == BLINK) {
+            } else if (cmd_type == BLINK) {
                 delay = obj->m_blink_duration_ms / 42;
                 brightness = obj->get_brightness();
 
                 for (uint32_t i = 0; i < obj->m_blink_count; i++) {
                     for (int v = 0; v <= 100; v+=5) {
-                        obj->set_brightness(v, false, false);
+                        obj->set_brightness(v, false);
                         vTaskDelay(pdMS_TO_TICKS(delay));
                     }
                     for (int v = 100; v >= 0; v-=5) {
-                        obj->set_brightness(v, false, false);
+                        obj->set_brightness(v, false);
                         vTaskDelay(pdMS_TO_TICKS(delay));
                     }
                 }
 
-                obj->set_brightness(brightness, false, false);
-            } else if (*cmd_type == BLINK_DEMO) {
+                obj->set_brightness(brightness, false);
+            } else if (cmd_type == BLINK_DEMO) {
                 blink_demo = true;
             }
         }
         
+        if (obj->m_color_loop_active) {
+            obj->render_color_loop();
+            obj->transmit_pixel_values(timeout_ms);
+        }
+        
         if (blink_demo) {
             if (obj->m_blink_count > 0) {
                 rgb_t rgb;
@@ -562,30 +948,15 @@ void CWS2812Ctrl::func_command(void *param)
                     rgb = rgb_t(255, 255, 255);
                 }
 
-                for (size_t i = 0; i < WS2812_ARRAY_COUNT; i++) {
-                    rgb_t rgb = obj->m_pixel_values[i];
-                    conv_array[i * 3 + 0] = rgb.g;
-                    conv_array[i * 3 + 1] = rgb.r;
-                    conv_array[i * 3 + 2] = rgb.b;
-                }
-
-                obj->set_rmt_state(0);
-                ret = rmt_transmit(obj->m_rmt_ch_handle, obj->m_rmt_enc_base, conv_array, sizeof(conv_array), &rmt_tx_cfg);
-                if (ret != ESP_OK) {
-                    GetLogger(eLogType::Error)->Log("Failed to transmit rmt (return code: %u)", ret);
-                }
-                ret = rmt_tx_wait_all_done(obj->m_rmt_ch_handle, timeout_ms);
-                if (ret != ESP_OK) {
-                    GetLogger(eLogType::Error)->Log("Failed to rmt wait all done (timeout: %d, return code: %u)", timeout_ms, ret);
-                }
+                obj->transmit_pixel_values(timeout_ms);
 
                 delay = 25;
                 for (int v = 0; v <= 100; v+=5) {
-                    obj->set_brightness(v, false, false);
+                    obj->set_brightness(v, false);
                     vTaskDelay(pdMS_TO_TICKS(delay));
                 }
                 for (int v = 100; v >= 0; v-=5) {
-                    obj->set_brightness(v, false, false);
+                    obj->set_brightness(v, false);
                     vTaskDelay(pdMS_TO_TICKS(delay));
                 }
 
@@ -0,0 +1,96 @@
+#include "histogram.h"
+#include "logger.h"
+#include <string.h>
+
+CHistogram::CHistogram()
+{
+    reset();
+}
+
+CHistogram::~CHistogram()
+{
+
+}
+
+void CHistogram::add(uint32_t value_us)
+{
+    m_buckets[get_bucket_index(value_us)]++;
+    m_count++;
+    m_total += value_us;
+    if (value_us > m_max) {
+        m_max = value_us;
+    }
+}
+
+void CHistogram::reset()
+{
+    memset(m_buckets, 0, sizeof(m_buckets));
+    m_count = 0;
+    m_max = 0;
+    m_total = 0;
+}
+
+uint32_t CHistogram::get_average()
+{
+    return m_count ? (uint32_t)(m_total / m_count) : 0;
+}
+
+uint32_t CHistogram::get_percentile(uint32_t percent)
+{
+    if (!m_count) {
+        return 0;
+    }
+
+    uint64_t target = ((uint64_t)m_count * percent + 99) / 100;
+    uint64_t accumulated = 0;
+    for (uint32_t i = 0; i < HISTOGRAM_BUCKET_COUNT; i++) {
+        accumulated += m_buckets[i];
+        if (accumulated >= target) {
+            // last bucket has no upper bound
+            return i == HISTOGRAM_BUCKET_COUNT - 1 ? m_max : get_bucket_upper(i);
+        }
+    }
+
+    return m_max;
+}
+
+void CHistogram::print(const char *name)
+{
+    GetLoggerM(eLogType::Info)->Log("%s: %u times, avg %u us, max %u us, p50 < %u us, p99 < %u us",
+        name, m_count, get_average(), m_max, get_percentile(50), get_percentile(99));
+    if (!m_count) {
+        return;
+    }
+
+    /**
+     * non-empty buckets only, one line per bucket with integer arguments
+     * (a joined line would be cut at MAXLEN_LOG_ARG_STRING by the deferred %s encoding)
+     */
+    for (uint32_t i = 0; i < HISTOGRAM_BUCKET_COUNT; i++) {
+        if (!m_buckets[i]) {
+            continue;
+        }
+        if (i == 0) {
+            GetLoggerM(eLogType::Info)->Log("  0: %u", m_buckets[i]);
+        } else if (i == HISTOGRAM_BUCKET_COUNT - 1) {
+            GetLoggerM(eLogType::Info)->Log("  %u-: %u", get_bucket_upper(i - 1), m_buckets[i]);
+        } else {
+            GetLoggerM(eLogType::Info)->Log("  [%u-%u): %u", get_bucket_upper(i - 1), get_bucket_upper(i), m_buckets[i]);
+        }
+    }
+}
+
+uint32_t CHistogram::get_bucket_index(uint32_t value_us)
+{
+    if (!value_us) {
+        return 0;
+    }
+    uint32_t index = 32 - (uint32_t)__builtin_clz(value_us);
+    return index < HISTOGRAM_BUCKET_COUNT ? index : HISTOGRAM_BUCKET_COUNT - 1;
+}
+
+uint32_t CHistogram::get_bucket_upper(uint32_t index)
+{
+    // bucket 0 holds 0 us only
+    return index ? (1u << index) : 1;
+}
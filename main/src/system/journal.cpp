@@ -0,0 +1,353 @@
+#include "journal.h"
+#include "logger.h"
+#include "crc32.h"
+#include <string.h>
+#include <algorithm>
+
+CStateJournal::CStateJournal()
+{
+    m_flash = nullptr;
+    m_sector_size = 0;
+    m_sector_count = 0;
+    m_active_sector = -1;
+    m_sector_seq = 0;
+    m_record_seq = 0;
+    m_write_offset = 0;
+    m_append_count = 0;
+    m_compaction_count = 0;
+    m_bytes_written = 0;
+}
+
+CStateJournal::~CStateJournal()
+{
+}
+
+bool CStateJournal::initialize(CJournalFlash *flash)
+{
+    m_flash = flash;
+    m_sector_size = flash->get_sector_size();
+    m_sector_count = m_sector_size ? flash->get_size() / m_sector_size : 0;
+    if (m_sector_count < 2) {
+        // compaction needs a spare sector
+        GetLogger(eLogType::Error)->Log("Journal needs at least 2 sectors (size: %d)", (int)flash->get_size());
+        m_flash = nullptr;
+        return false;
+    }
+
+    // newest valid sector (by sector sequence number)
+    std::vector<std::pair<uint32_t, int>> candidates;
+    for (size_t i = 0; i < m_sector_count; i++) {
+        uint32_t sector_seq;
+        if (read_sector_header((int)i, &sector_seq)) {
+            candidates.push_back({sector_seq, (int)i});
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const std::pair<uint32_t, int> &a, const std::pair<uint32_t, int> &b) {
+        return a.first > b.first;
+    });
+
+    m_active_sector = -1;
+    m_sector_seq = candidates.empty() ? 0 : candidates[0].first;
+    for (auto &item : candidates) {
+        std::vector<uint8_t> state;
+        uint32_t last_seq;
+        size_t end_offset;
+        if (scan_sector(item.second, &state, &last_seq, &end_offset)) {
+            m_active_sector = item.second;
+            m_record_seq = last_seq;
+            m_write_offset = end_offset;
+            m_state = state;
+            break;
+        }
+    }
+
+    if (m_active_sector >= 0) {
+        size_t base = (size_t)m_active_sector * m_sector_size;
+        if (!is_erased(base + m_write_offset, m_sector_size - m_write_offset)) {
+            // torn write at the tail: continue in a clean sector
+            GetLogger(eLogType::Warning)->Log("Journal tail is not clean (sector: %d, offset: %d)", m_active_sector, (int)m_write_offset);
+            compact(m_state.data(), m_state.size());
+        }
+        GetLogger(eLogType::Info)->Log("Journal replayed (sector: %d, seq: %u, state: %d bytes)", m_active_sector, m_record_seq, (int)m_state.size());
+    } else {
+        GetLogger(eLogType::Info)->Log("Journal is empty");
+    }
+
+    return true;
+}
+
+bool CStateJournal::load(void *state, size_t size, size_t *read_size)
+{
+    if (m_state.empty() || m_state.size() > size) {
+        return false;
+    }
+
+    memcpy(state, m_state.data(), m_state.size());
+    *read_size = m_state.size();
+    return true;
+}
+
+bool CStateJournal::append(const void *state, size_t size)
+{
+    if (!m_flash || !size || size > JOURNAL_MAX_STATE_SIZE) {
+        return false;
+    }
+
+    /**
+     * m_state = state on flash, updated only after the record (or the snapshot) is written
+     * failed append leaves m_state as it was, so the retry of the same state is written again
+     */
+    const uint8_t *ptr = (const uint8_t *)state;
+    if (m_active_sector < 0 || size != m_state.size()) {
+        m_append_count++;
+        return compact(ptr, size);
+    }
+
+    /**
+     * delta = changed byte ranges [offset, length, data...]
+     * ranges closer than 3 bytes are merged (range header costs 2 bytes)
+     */
+    std::vector<uint8_t> delta;
+    size_t i = 0;
+    while (i < size) {
+        if (ptr[i] == m_state[i]) {
+            i++;
+            continue;
+        }
+        size_t start = i;
+        size_t end = i + 1;
+        size_t j = end;
+        while (j < size && j < end + 3 && j + 1 - start <= 255) {
+            if (ptr[j] != m_state[j]) {
+                end = j + 1;
+            }
+            j++;
+        }
+        delta.push_back((uint8_t)start);
+        delta.push_back((uint8_t)(end - start));
+        delta.insert(delta.end(), ptr + start, ptr + end);
+        i = end;
+    }
+    if (delta.empty()) {
+        return true;
+    }
+
+    m_append_count++;
+
+    uint8_t type = JOURNAL_RECORD_DELTA;
+    const uint8_t *payload = delta.data();
+    size_t length = delta.size();
+    if (length >= size) {
+        type = JOURNAL_RECORD_SNAPSHOT;
+        payload = ptr;
+        length = size;
+    }
+
+    if (m_write_offset + record_size(length) > m_sector_size) {
+        return compact(ptr, size);
+    }
+
+    if (!write_record(type, payload, length)) {
+        return false;
+    }
+
+    m_state.assign(ptr, ptr + size);
+    return true;
+}
+
+bool CStateJournal::has_state()
+{
+    return !m_state.empty();
+}
+
+void CStateJournal::print_journal_info()
+{
+    GetLoggerM(eLogType::Info)->Log("----- Journal -----");
+    if (!m_flash) {
+        GetLoggerM(eLogType::Info)->Log("Not available");
+        return;
+    }
+    GetLoggerM(eLogType::Info)->Log("Sectors: %d x %d bytes, Active: %d (offset: %d)", (int)m_sector_count, (int)m_sector_size, m_active_sector, (int)m_write_offset);
+    GetLoggerM(eLogType::Info)->Log("Record Seq: %u, Appends: %u, Compactions: %u", m_record_seq, m_append_count, m_compaction_count);
+    GetLoggerM(eLogType::Info)->Log("Bytes Written: %u", m_bytes_written);
+}
+
+bool CStateJournal::read_sector_header(int sector, uint32_t *sector_seq)
+{
+    journal_sector_header_t header;
+    if (!m_flash->read((size_t)sector * m_sector_size, &header, sizeof(header))) {
+        return false;
+    }
+
+    if (header.magic != JOURNAL_SECTOR_MAGIC || header.crc != calc_crc32(&header, offsetof(journal_sector_header_t, crc))) {
+        return false;
+    }
+
+    *sector_seq = header.sector_seq;
+    return true;
+}
+
+bool CStateJournal::scan_sector(int sector, std::vector<uint8_t> *state, uint32_t *last_seq, size_t *end_offset)
+{
+    size_t base = (size_t)sector * m_sector_size;
+    size_t offset = sizeof(journal_sector_header_t);
+    std::vector<uint8_t> current;
+    uint32_t seq = 0;
+    bool has_snapshot = false;
+    uint8_t payload[255];
+
+    while (offset + sizeof(journal_record_header_t) <= m_sector_size) {
+        journal_record_header_t header;
+        if (!m_flash->read(base + offset, &header, sizeof(header))) {
+            break;
+        }
+        if (header.type == 0xFF) {
+            break;  // erased
+        }
+        size_t size = record_size(header.length);
+        if (offset + size > m_sector_size) {
+            break;
+        }
+        if (!m_flash->read(base + offset + sizeof(header), payload, header.length)) {
+            break;
+        }
+        uint32_t crc = calc_crc32(&header, offsetof(journal_record_header_t, crc));
+        crc = calc_crc32(payload, header.length, crc);
+        if (crc != header.crc || (has_snapshot && header.seq <= seq)) {
+            break;  // torn or stale record
+        }
+
+        if (header.type == JOURNAL_RECORD_SNAPSHOT) {
+            current.assign(payload, payload + header.length);
+            has_snapshot = true;
+        } else if (header.type == JOURNAL_RECORD_DELTA && has_snapshot) {
+            std::vector<uint8_t> temp = current;
+            bool valid = true;
+            size_t pos = 0;
+            while (pos + 2 <= header.length) {
+                size_t range_offset = payload[pos];
+                size_t range_length = payload[pos + 1];
+                pos += 2;
+                if (pos + range_length > header.length || range_offset + range_length > temp.size()) {
+                    valid = false;
+                    break;
+                }
+                memcpy(&temp[range_offset], &payload[pos], range_length);
+                pos += range_length;
+            }
+            if (!valid || pos != header.length) {
+                break;
+            }
+            current = temp;
+        } else {
+            break;
+        }
+
+        seq = header.seq;
+        offset += size;
+    }
+
+    if (!has_snapshot) {
+        return false;
+    }
+
+    *state = current;
+    *last_seq = seq;
+    *end_offset = offset;
+    return true;
+}
+
+bool CStateJournal::is_erased(size_t offset, size_t size)
+{
+    uint8_t buffer[64];
+    while (size) {
+        size_t length = std::min(size, sizeof(buffer));
+        if (!m_flash->read(offset, buffer, length)) {
+            return false;
+        }
+        for (size_t i = 0; i < length; i++) {
+            if (buffer[i] != 0xFF) {
+                return false;
+            }
+        }
+        offset += length;
+        size -= length;
+    }
+
+    return true;
+}
+
+bool CStateJournal::write_record(uint8_t type, const uint8_t *payload, size_t length)
+{
+    size_t size = record_size(length);
+    std::vector<uint8_t> buffer(size, 0xFF);
+
+    journal_record_header_t header;
+    header.type = type;
+    header.length = (uint8_t)length;
+    header.reserved = 0xFFFF;
+    header.seq = m_record_seq + 1;
+    header.crc = calc_crc32(&header, offsetof(journal_record_header_t, crc));
+    header.crc = calc_crc32(payload, length, header.crc);
+    memcpy(buffer.data(), &header, sizeof(header));
+    memcpy(buffer.data() + sizeof(header), payload, length);
+
+    size_t base = (size_t)m_active_sector * m_sector_size;
+    if (!m_flash->write(base + m_write_offset, buffer.data(), size)) {
+        // unknown tail: next append moves to a clean sector
+        m_write_offset = m_sector_size;
+        return false;
+    }
+
+    m_record_seq++;
+    m_write_offset += size;
+    m_bytes_written += size;
+    return true;
+}
+
+bool CStateJournal::compact(const uint8_t *state, size_t size)
+{
+    int prev = m_active_sector;
+    int next = prev < 0 ? 0 : (prev + 1) % (int)m_sector_count;
+    size_t base = (size_t)next * m_sector_size;
+
+    if (!m_flash->erase_sector(base)) {
+        m_write_offset = m_sector_size;
+        return false;
+    }
+
+    // snapshot first, sector header last: sector is valid only after both are written
+    m_active_sector = next;
+    m_write_offset = sizeof(journal_sector_header_t);
+    if (!write_record(JOURNAL_RECORD_SNAPSHOT, state, size)) {
+        // previous sector still holds the newest valid state: retry compacts into the same sector again
+        m_active_sector = prev;
+        m_write_offset = m_sector_size;
+        return false;
+    }
+
+    journal_sector_header_t header;
+    header.magic = JOURNAL_SECTOR_MAGIC;
+    header.sector_seq = m_sector_seq + 1;
+    header.reserved = 0xFFFFFFFF;
+    header.crc = calc_crc32(&header, offsetof(journal_sector_header_t, crc));
+    if (!m_flash->write(base, &header, sizeof(header))) {
+        m_active_sector = prev;
+        m_write_offset = m_sector_size;
+        return false;
+    }
+
+    if (state != m_state.data()) {
+        m_state.assign(state, state + size);
+    }
+    m_sector_seq++;
+    m_compaction_count++;
+    m_bytes_written += sizeof(header);
+    return true;
+}
+
+size_t CStateJournal::record_size(size_t length)
+{
+    // 4 bytes aligned
+    return sizeof(journal_record_header_t) + ((length + 3) & ~(size_t)3);
+}
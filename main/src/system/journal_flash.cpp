@@ -0,0 +1,184 @@
+#include "journal_flash.h"
+#include "logger.h"
+#include <string.h>
+#include <stdio.h>
+#include <vector>
+
+#ifndef UNIT_TEST
+CJournalFlashPartition::CJournalFlashPartition()
+{
+    m_partition = nullptr;
+}
+
+CJournalFlashPartition::~CJournalFlashPartition()
+{
+}
+
+bool CJournalFlashPartition::initialize(const char *label)
+{
+    m_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (!m_partition) {
+        GetLogger(eLogType::Warning)->Log("Failed to find partition (%s)", label);
+        return false;
+    }
+
+    return true;
+}
+
+size_t CJournalFlashPartition::get_size()
+{
+    return m_partition ? m_partition->size : 0;
+}
+
+size_t CJournalFlashPartition::get_sector_size()
+{
+    return m_partition ? m_partition->erase_size : 0;
+}
+
+bool CJournalFlashPartition::read(size_t offset, void *out, size_t size)
+{
+    esp_err_t err = esp_partition_read(m_partition, offset, out, size);
+    if (err != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to read partition (offset: 0x%X, ret=%d)", (unsigned)offset, err);
+        return false;
+    }
+
+    return true;
+}
+
+bool CJournalFlashPartition::write(size_t offset, const void *data, size_t size)
+{
+    esp_err_t err = esp_partition_write(m_partition, offset, data, size);
+    if (err != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to write partition (offset: 0x%X, ret=%d)", (unsigned)offset, err);
+        return false;
+    }
+
+    return true;
+}
+
+bool CJournalFlashPartition::erase_sector(size_t offset)
+{
+    esp_err_t err = esp_partition_erase_range(m_partition, offset, m_partition->erase_size);
+    if (err != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to erase partition (offset: 0x%X, ret=%d)", (unsigned)offset, err);
+        return false;
+    }
+
+    return true;
+}
+#else
+CJournalFlashFile::CJournalFlashFile()
+{
+    m_size = 0;
+    m_sector_size = 0;
+    m_write_limit = (size_t)-1;
+}
+
+CJournalFlashFile::~CJournalFlashFile()
+{
+}
+
+bool CJournalFlashFile::initialize(const char *path, size_t size, size_t sector_size/*=4096*/)
+{
+    m_path = path;
+    m_size = size;
+    m_sector_size = sector_size;
+
+    // new image is filled with 0xFF (erased)
+    FILE *fp = fopen(path, "rb");
+    if (fp) {
+        fclose(fp);
+        return true;
+    }
+    fp = fopen(path, "wb");
+    if (!fp) {
+        return false;
+    }
+    std::vector<uint8_t> erased(size, 0xFF);
+    bool result = fwrite(erased.data(), 1, size, fp) == size;
+    fclose(fp);
+
+    return result;
+}
+
+size_t CJournalFlashFile::get_size()
+{
+    return m_size;
+}
+
+size_t CJournalFlashFile::get_sector_size()
+{
+    return m_sector_size;
+}
+
+bool CJournalFlashFile::read(size_t offset, void *out, size_t size)
+{
+    if (offset + size > m_size) {
+        return false;
+    }
+
+    FILE *fp = fopen(m_path.c_str(), "rb");
+    if (!fp) {
+        return false;
+    }
+    fseek(fp, (long)offset, SEEK_SET);
+    bool result = fread(out, 1, size, fp) == size;
+    fclose(fp);
+
+    return result;
+}
+
+bool CJournalFlashFile::write(size_t offset, const void *data, size_t size)
+{
+    if (offset + size > m_size) {
+        return false;
+    }
+
+    // power loss simulation: only the first write_limit bytes reach the flash
+    size_t length = size < m_write_limit ? size : m_write_limit;
+    m_write_limit -= length;
+
+    std::vector<uint8_t> buffer(length);
+    if (!read(offset, buffer.data(), length)) {
+        return false;
+    }
+    const uint8_t *ptr = (const uint8_t *)data;
+    for (size_t i = 0; i < length; i++) {
+        buffer[i] &= ptr[i];    // NOR flash: bits can only be cleared
+    }
+
+    FILE *fp = fopen(m_path.c_str(), "r+b");
+    if (!fp) {
+        return false;
+    }
+    fseek(fp, (long)offset, SEEK_SET);
+    bool result = fwrite(buffer.data(), 1, length, fp) == length;
+    fclose(fp);
+
+    return result && length == size;
+}
+
+bool CJournalFlashFile::erase_sector(size_t offset)
+{
+    if (offset % m_sector_size || offset + m_sector_size > m_size || !m_write_limit) {
+        return false;
+    }
+
+    std::vector<uint8_t> erased(m_sector_size, 0xFF);
+    FILE *fp = fopen(m_path.c_str(), "r+b");
+    if (!fp) {
+        return false;
+    }
+    fseek(fp, (long)offset, SEEK_SET);
+    bool result = fwrite(erased.data(), 1, m_sector_size, fp) == m_sector_size;
+    fclose(fp);
+
+    return result;
+}
+
+void CJournalFlashFile::set_write_limit(size_t bytes)
+{
+    m_write_limit = bytes;
+}
+#endif
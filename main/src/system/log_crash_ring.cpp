@@ -0,0 +1,190 @@
+#include "log_crash_ring.h"
+#include "crc32.h"
+#include <string.h>
+#include <atomic>
+
+#define RECORD_HEADER_SIZE  4
+
+static inline uint32_t align_record_size(size_t size)
+{
+    return (uint32_t)((RECORD_HEADER_SIZE + size + 3) & ~(size_t)3);
+}
+
+CLogCrashRing::CLogCrashRing()
+{
+    m_header = nullptr;
+    m_data = nullptr;
+    m_size = 0;
+}
+
+CLogCrashRing::~CLogCrashRing()
+{
+}
+
+bool CLogCrashRing::attach(void *memory, size_t size, uint32_t app_id)
+{
+    if (size < sizeof(log_crash_ring_header_t) + 64) {
+        return false;
+    }
+
+    m_header = (log_crash_ring_header_t *)memory;
+    m_data = (uint8_t *)memory + sizeof(log_crash_ring_header_t);
+    // power of 2: free running counters wrap around consistently
+    m_size = 64;
+    while (m_size * 2 <= size - sizeof(log_crash_ring_header_t)) {
+        m_size *= 2;
+    }
+
+    bool valid = m_header->magic == LOG_CRASH_RING_MAGIC
+        && m_header->size == m_size
+        && m_header->app_id == app_id
+        && m_header->crc == calc_crc32(m_header, offsetof(log_crash_ring_header_t, crc))
+        && validate();
+    if (!valid) {
+        m_header->magic = LOG_CRASH_RING_MAGIC;
+        m_header->size = (uint32_t)m_size;
+        m_header->app_id = app_id;
+        m_header->crc = calc_crc32(m_header, offsetof(log_crash_ring_header_t, crc));
+        m_header->head = 0;
+        m_header->tail = 0;
+    }
+
+    return valid;
+}
+
+bool CLogCrashRing::append(const void *data1, size_t size1, const void *data2, size_t size2)
+{
+    size_t length = size1 + size2;
+    uint32_t record_size = align_record_size(length);
+    if (!m_header || length > 0xFFFF || record_size > m_size) {
+        return false;
+    }
+
+    // drop oldest records
+    uint32_t head = m_header->head;
+    uint32_t tail = m_header->tail;
+    while (m_size - (head - tail) < record_size) {
+        uint16_t old_length;
+        copy_out(tail, &old_length, sizeof(old_length));
+        tail += align_record_size(old_length);
+    }
+    m_header->tail = tail;
+
+    uint8_t record_header[RECORD_HEADER_SIZE];
+    memcpy(record_header, &length, 2);
+    uint8_t checksum = calc_checksum(0, record_header, 2);
+    checksum = calc_checksum(checksum, data1, size1);
+    record_header[2] = calc_checksum(checksum, data2, size2);
+    record_header[3] = 0;
+    copy_in(head, record_header, sizeof(record_header));
+    copy_in(head + RECORD_HEADER_SIZE, data1, size1);
+    copy_in(head + RECORD_HEADER_SIZE + size1, data2, size2);
+
+    // commit: record is complete before head moves
+    std::atomic_signal_fence(std::memory_order_release);
+    m_header->head = head + record_size;
+
+    return true;
+}
+
+int CLogCrashRing::read(uint32_t *cursor, uint32_t end, void *out, size_t out_size)
+{
+    if (!m_header) {
+        return -1;
+    }
+
+    uint32_t head = m_header->head;
+    uint32_t tail = m_header->tail;
+    if ((int32_t)(*cursor - tail) < 0) {
+        *cursor = tail;     // overwritten meanwhile
+    }
+    if (*cursor == end || (int32_t)(end - *cursor) < 0 || (int32_t)(head - *cursor) <= 0) {
+        return -1;
+    }
+
+    uint8_t record_header[RECORD_HEADER_SIZE];
+    copy_out(*cursor, record_header, sizeof(record_header));
+    uint16_t length;
+    memcpy(&length, record_header, 2);
+    uint32_t record_size = align_record_size(length);
+    if (length > out_size || record_size > head - *cursor) {
+        return -1;
+    }
+    copy_out(*cursor + RECORD_HEADER_SIZE, out, length);
+    if (calc_checksum(calc_checksum(0, record_header, 2), out, length) != record_header[2]) {
+        return -1;
+    }
+
+    *cursor += record_size;
+    return length;
+}
+
+void CLogCrashRing::discard(uint32_t end)
+{
+    if (m_header && (int32_t)(end - m_header->tail) > 0 && (int32_t)(m_header->head - end) >= 0) {
+        m_header->tail = end;
+    }
+}
+
+uint32_t CLogCrashRing::get_head()
+{
+    return m_header ? m_header->head : 0;
+}
+
+uint32_t CLogCrashRing::get_tail()
+{
+    return m_header ? m_header->tail : 0;
+}
+
+size_t CLogCrashRing::get_size()
+{
+    return m_size;
+}
+
+bool CLogCrashRing::validate()
+{
+    // walk every record: lengths must chain exactly from tail to head
+    uint32_t head = m_header->head;
+    uint32_t tail = m_header->tail;
+    if (head - tail > m_size || (head & 3) || (tail & 3)) {
+        return false;
+    }
+
+    uint32_t pos = tail;
+    while (pos != head) {
+        uint16_t length;
+        copy_out(pos, &length, sizeof(length));
+        uint32_t record_size = align_record_size(length);
+        if (record_size > head - pos) {
+            return false;
+        }
+        pos += record_size;
+    }
+
+    return true;
+}
+
+void CLogCrashRing::copy_in(uint32_t pos, const void *data, size_t size)
+{
+    size_t offset = pos & (m_size - 1);
+    size_t first = size < m_size - offset ? size : m_size - offset;
+    memcpy(&m_data[offset], data, first);
+    memcpy(&m_data[0], (const uint8_t *)data + first, size - first);
+}
+
+void CLogCrashRing::copy_out(uint32_t pos, void *out, size_t size)
+{
+    size_t offset = pos & (m_size - 1);
+    size_t first = size < m_size - offset ? size : m_size - offset;
+    memcpy(out, &m_data[offset], first);
+    memcpy((uint8_t *)out + first, &m_data[0], size - first);
+}
+
+uint8_t CLogCrashRing::calc_checksum(uint8_t checksum, const void *data, size_t size)
+{
+    const uint8_t *ptr = (const uint8_t *)data;
+    for (size_t i = 0; i < size; i++) {
+        checksum = (uint8_t)((checksum << 1) | (checksum >> 7)) ^ ptr[i];
+    }
+    return checksum;
+}
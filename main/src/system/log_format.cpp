@@ -0,0 +1,325 @@
+#include "log_format.h"
+#include <stdio.h>
+
+typedef struct log_arg_t {
+    uint8_t type;       // eLogArgType (0 = missing)
+    int64_t i;
+    double d;
+    const char *s;
+    uint8_t s_length;
+} log_arg_t;
+
+static bool decode_arg(const uint8_t *args, size_t size, size_t *pos, log_arg_t *arg)
+{
+    arg->type = 0;
+    if (*pos >= size) {
+        return false;
+    }
+
+    uint8_t tag = args[(*pos)++];
+    switch (tag) {
+    case LOG_ARG_INT32:
+    case LOG_ARG_POINTER: {
+        int32_t temp;
+        if (*pos + sizeof(temp) > size) {
+            return false;
+        }
+        memcpy(&temp, &args[*pos], sizeof(temp));
+        *pos += sizeof(temp);
+        arg->i = tag == LOG_ARG_POINTER ? (int64_t)(uint32_t)temp : temp;
+        arg->d = (double)arg->i;
+        break;
+    }
+    case LOG_ARG_INT64:
+        if (*pos + sizeof(arg->i) > size) {
+            return false;
+        }
+        memcpy(&arg->i, &args[*pos], sizeof(arg->i));
+        *pos += sizeof(arg->i);
+        arg->d = (double)arg->i;
+        break;
+    case LOG_ARG_DOUBLE:
+        if (*pos + sizeof(arg->d) > size) {
+            return false;
+        }
+        memcpy(&arg->d, &args[*pos], sizeof(arg->d));
+        *pos += sizeof(arg->d);
+        arg->i = (int64_t)arg->d;
+        break;
+    case LOG_ARG_STRING:
+        if (*pos + 1 > size || *pos + 1 + args[*pos] > size) {
+            return false;
+        }
+        arg->s_length = args[*pos];
+        arg->s = (const char *)&args[*pos + 1];
+        *pos += 1 + arg->s_length;
+        arg->i = 0;
+        arg->d = 0;
+        break;
+    default:
+        // LOG_ARG_TRUNCATED or corrupted
+        *pos = size;
+        return false;
+    }
+
+    arg->type = tag;
+    return true;
+}
+
+size_t log_encode_args(const char *format, va_list args, uint8_t *buffer, size_t capacity)
+{
+    CLogArgEncoder encoder(buffer, capacity);
+
+    const char *p = format;
+    while (*p) {
+        if (*p++ != '%') {
+            continue;
+        }
+        if (*p == '%') {
+            p++;
+            continue;
+        }
+
+        // "%[flags][width][.precision][length]conversion", '*' takes an int argument
+        while (*p && strchr("-+ #0123456789.*", *p)) {
+            if (*p == '*') {
+                encoder.add(va_arg(args, int));
+            }
+            p++;
+        }
+        char modifier[2] = {0, 0};
+        while (*p && strchr("hlLqjzt", *p)) {
+            modifier[modifier[0] ? 1 : 0] = *p++;
+        }
+        bool is_long_long = (modifier[0] == 'l' && modifier[1] == 'l') || modifier[0] == 'q' || modifier[0] == 'L';
+        char conversion = *p;
+        if (!conversion) {
+            break;
+        }
+        p++;
+
+        switch (conversion) {
+        case 'd':
+        case 'i':
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+            if (is_long_long) {
+                encoder.add(va_arg(args, long long));
+            } else if (modifier[0] == 'l') {
+                encoder.add(va_arg(args, long));
+            } else if (modifier[0] == 'j') {
+                encoder.add(va_arg(args, intmax_t));
+            } else if (modifier[0] == 'z') {
+                encoder.add(va_arg(args, size_t));
+            } else if (modifier[0] == 't') {
+                encoder.add(va_arg(args, ptrdiff_t));
+            } else {
+                encoder.add(va_arg(args, int));
+            }
+            break;
+        case 'c':
+            encoder.add(va_arg(args, int));
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            if (modifier[0] == 'L') {
+                encoder.add((double)va_arg(args, long double));
+            } else {
+                encoder.add(va_arg(args, double));
+            }
+            break;
+        case 's':
+            encoder.add(va_arg(args, const char *));
+            break;
+        case 'p':
+        case 'n':
+            encoder.add(va_arg(args, void *));
+            break;
+        default:
+            // unknown conversion: the argument types after it can't be known
+            return encoder.size();
+        }
+    }
+
+    return encoder.size();
+}
+
+int log_render(const char *format, const uint8_t *args, size_t size, char *out, size_t out_size)
+{
+    size_t length = 0;
+    size_t pos = 0;
+
+    if (!out_size) {
+        return 0;
+    }
+
+    auto append = [&](int written) {
+        if (written > 0) {
+            length += (size_t)written;
+            if (length >= out_size) {
+                length = out_size - 1;
+            }
+        }
+    };
+
+    const char *p = format;
+    while (*p && length + 1 < out_size) {
+        if (*p != '%') {
+            out[length++] = *p++;
+            continue;
+        }
+        if (p[1] == '%') {
+            out[length++] = '%';
+            p += 2;
+            continue;
+        }
+
+        /**
+         * "%[flags][width][.precision][length]conversion"
+         * length modifier is replaced by the one of the stored argument type
+         */
+        char spec[24];
+        size_t spec_length = 0;
+        spec[spec_length++] = *p++;
+        int star_values[2];
+        int star_count = 0;
+        while (*p && strchr("-+ #0123456789.*", *p)) {
+            if (*p == '*') {
+                log_arg_t star;
+                decode_arg(args, size, &pos, &star);
+                if (star_count < 2) {
+                    star_values[star_count++] = (int)star.i;
+                }
+            }
+            if (spec_length < sizeof(spec) - 4) {
+                spec[spec_length++] = *p;
+            }
+            p++;
+        }
+        while (*p && strchr("hlLqjzt", *p)) {
+            p++;
+        }
+        char conversion = *p;
+        if (!conversion) {
+            break;
+        }
+        p++;
+
+        log_arg_t arg;
+        if (!decode_arg(args, size, &pos, &arg)) {
+            append(snprintf(&out[length], out_size - length, "<?>"));
+            continue;
+        }
+
+        char *dst = &out[length];
+        size_t remain = out_size - length;
+        switch (conversion) {
+        case 'd':
+        case 'i':
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+        case 'c':
+            if ((arg.type == LOG_ARG_INT64 || arg.type == LOG_ARG_DOUBLE) && conversion != 'c') {
+                spec[spec_length++] = 'l';
+                spec[spec_length++] = 'l';
+                spec[spec_length++] = conversion;
+                spec[spec_length] = '\0';
+                if (star_count == 2) {
+                    append(snprintf(dst, remain, spec, star_values[0], star_values[1], (long long)arg.i));
+                } else if (star_count == 1) {
+                    append(snprintf(dst, remain, spec, star_values[0], (long long)arg.i));
+                } else {
+                    append(snprintf(dst, remain, spec, (long long)arg.i));
+                }
+            } else {
+                spec[spec_length++] = conversion;
+                spec[spec_length] = '\0';
+                if (star_count == 2) {
+                    append(snprintf(dst, remain, spec, star_values[0], star_values[1], (int)arg.i));
+                } else if (star_count == 1) {
+                    append(snprintf(dst, remain, spec, star_values[0], (int)arg.i));
+                } else {
+                    append(snprintf(dst, remain, spec, (int)arg.i));
+                }
+            }
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            spec[spec_length++] = conversion;
+            spec[spec_length] = '\0';
+            if (star_count == 2) {
+                append(snprintf(dst, remain, spec, star_values[0], star_values[1], arg.d));
+            } else if (star_count == 1) {
+                append(snprintf(dst, remain, spec, star_values[0], arg.d));
+            } else {
+                append(snprintf(dst, remain, spec, arg.d));
+            }
+            break;
+        case 's': {
+            char temp[MAXLEN_LOG_ARG_STRING + 1];
+            if (arg.type == LOG_ARG_STRING) {
+                memcpy(temp, arg.s, arg.s_length);
+                temp[arg.s_length] = '\0';
+            } else {
+                temp[0] = '\0';
+            }
+            spec[spec_length++] = 's';
+            spec[spec_length] = '\0';
+            if (star_count == 2) {
+                append(snprintf(dst, remain, spec, star_values[0], star_values[1], temp));
+            } else if (star_count == 1) {
+                append(snprintf(dst, remain, spec, star_values[0], temp));
+            } else {
+                append(snprintf(dst, remain, spec, temp));
+            }
+            break;
+        }
+        case 'p':
+            append(snprintf(dst, remain, "0x%08x", (unsigned)arg.i));
+            break;
+        default:
+            append(snprintf(dst, remain, "<%c?>", conversion));
+            break;
+        }
+    }
+
+    out[length] = '\0';
+    return (int)length;
+}
+
+static_assert(12 + MAXLEN_LOG_ARGS <= 255, "binary frame length must fit in 1 byte");
+
+size_t log_encode_frame(uint32_t site, uint32_t format, uint32_t timestamp_ms, const uint8_t *args, size_t size, uint8_t *frame)
+{
+    size_t length = 12 + size;
+    frame[0] = LOG_FRAME_SYNC_0;
+    frame[1] = LOG_FRAME_SYNC_1;
+    frame[2] = (uint8_t)length;
+    memcpy(&frame[3], &site, sizeof(site));
+    memcpy(&frame[7], &format, sizeof(format));
+    memcpy(&frame[11], &timestamp_ms, sizeof(timestamp_ms));
+    memcpy(&frame[LOG_FRAME_HEADER_SIZE], args, size);
+    uint8_t checksum = 0;
+    for (size_t i = 2; i < 3 + length; i++) {
+        checksum += frame[i];
+    }
+    frame[3 + length] = checksum;
+
+    return 4 + length;
+}
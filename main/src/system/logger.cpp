@@ -1,52 +1,162 @@
 #include "logger.h"
+#include "definition.h"
 #ifndef UNIT_TEST
-#include "freertos/FreeRTOS.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_cpu.h"
+#include "esp_rom_uart.h"
+#include "esp_attr.h"
+#include "esp_app_desc.h"
+#else
+#include <chrono>
 #endif
-#include <vector>
-#include <cstdarg>
+#include <cstring>
 
 CLogger* CLogger::_instance;
+#ifndef UNIT_TEST
 static const char *TAG = "logger";
+#endif
+
+/**
+ * @brief 각 task가 처음 로그를 남길 때 pool에서 ring buffer 하나를 점유한다
+ */
+static thread_local log_ring_t *t_ring = nullptr;
+
+#define LOG_DRAIN_PERIOD_MS         20
+#define LOG_RATE_SUMMARY_PERIOD_MS  1000    // pending "suppressed" summary is printed after this idle time
+#define LOG_RING_MASK           (LOG_RING_SIZE - 1)
+static_assert((LOG_RING_SIZE & LOG_RING_MASK) == 0, "LOG_RING_SIZE must be power of 2");
+
+#if LOG_CRASH_RING_SIZE > 0
+/**
+ * @brief 리셋 후에도 유지되는 로그 영역 (power-on 리셋 시에는 쓰레기값, header 검증으로 걸러진다)
+ */
+#ifndef UNIT_TEST
+RTC_NOINIT_ATTR
+#endif
+static uint32_t s_crash_ring_memory[(sizeof(log_crash_ring_header_t) + LOG_CRASH_RING_SIZE) / sizeof(uint32_t)];
+#endif
+
+static inline uint32_t align_record_size(uint32_t size)
+{
+    return (size + 3) & ~(uint32_t)3;
+}
+
+static inline uint32_t get_timestamp_ms()
+{
+#ifndef UNIT_TEST
+    return esp_log_timestamp();
+#else
+    return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+uint32_t log_get_cycle_count()
+{
+#ifndef UNIT_TEST
+    return esp_cpu_get_cycle_count();
+#else
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+static void ring_copy_in(log_ring_t *ring, uint32_t pos, const void *data, uint32_t size)
+{
+    uint32_t offset = pos & LOG_RING_MASK;
+    uint32_t first = MIN(size, (uint32_t)LOG_RING_SIZE - offset);
+    memcpy(&ring->buffer[offset], data, first);
+    memcpy(&ring->buffer[0], (const uint8_t *)data + first, size - first);
+}
+
+static void ring_copy_out(const log_ring_t *ring, uint32_t pos, void *out, uint32_t size)
+{
+    uint32_t offset = pos & LOG_RING_MASK;
+    uint32_t first = MIN(size, (uint32_t)LOG_RING_SIZE - offset);
+    memcpy(out, &ring->buffer[offset], first);
+    memcpy((uint8_t *)out + first, &ring->buffer[0], size - first);
+}
+
+static inline int log_severity(uint8_t type)
+{
+    switch (type) {
+    case eLogType::Debug:
+        return 0;
+    case eLogType::Info:
+        return 1;
+    case eLogType::Warning:
+        return 2;
+    case eLogType::Error:
+        return 3;
+    case eLogType::Exception:
+    default:
+        return 4;
+    }
+}
 
 CLogger::CLogger()
 {
-    m_eLogType = eLogType::Info;
-    m_funcname = "";
-    m_filename = "";
-    m_fileline = 0;
-    m_valid_funcinfo = false;
+    for (int i = 0; i < LOG_RING_COUNT; i++) {
+        m_rings[i].used = false;
+        m_rings[i].head = 0;
+        m_rings[i].tail = 0;
+        m_rings[i].dropped = 0;
+        m_rings[i].dropped_total = 0;
+        m_rings[i].high_water = 0;
+        m_rings[i].task_name[0] = '\0';
+    }
+    m_dropped_no_ring = 0;
+    m_write_count = 0;
+    m_write_cycles_max = 0;
+    m_write_cycles_total = 0;
+    m_output_count = 0;
+    m_output_bytes_total = 0;
+    m_output_cycles_total = 0;
+    m_sites = nullptr;
+    m_level = (uint8_t)LOG_LEVEL_DEFAULT;
+    m_module_count = 0;
+    m_suppressed_count = 0;
+    m_summary_ms = 0;
+    m_crash_ring_valid = false;
+    m_crash_ring_boot_head = 0;
+    m_crash_ring_dump_count = 0;
+#ifndef UNIT_TEST
+    m_drain_task_handle = nullptr;
+    m_drain_mutex = xSemaphoreCreateMutex();
+    portMUX_INITIALIZE(&m_crash_ring_lock);
+#endif
+
+#if LOG_CRASH_RING_SIZE > 0
+    // records hold flash addresses (site, format): valid only with the same firmware image
+    uint32_t app_id = 0;
+#ifndef UNIT_TEST
+    memcpy(&app_id, esp_app_get_description()->app_elf_sha256, sizeof(app_id));
+#endif
+    m_crash_ring_valid = m_crash_ring.attach(s_crash_ring_memory, sizeof(s_crash_ring_memory), app_id);
+    m_crash_ring_boot_head = m_crash_ring.get_head();
+#endif
 }
 
 CLogger::~CLogger()
 {
-    
+#ifndef UNIT_TEST
+    if (m_drain_task_handle) {
+        vTaskDelete(m_drain_task_handle);
+        m_drain_task_handle = nullptr;
+    }
+    if (m_drain_mutex) {
+        vSemaphoreDelete(m_drain_mutex);
+        m_drain_mutex = nullptr;
+    }
+#endif
 }
 
-CLogger* CLogger::Instance(eLogType logtype, const char* funcname, const char* filename, const unsigned long fileline)
+CLogger* CLogger::Instance()
 {
     if (!_instance) {
         _instance = new CLogger();
     }
 
-    _instance->m_eLogType = logtype;
-    if (funcname) {
-        _instance->m_valid_funcinfo = true;
-        _instance->m_funcname.assign(funcname, strlen(funcname));
-        _instance->m_fileline = fileline;
-
-        std::string temp;
-        temp.assign(filename, strlen(filename));
-        size_t pos = temp.rfind("/");
-        if (pos != std::string::npos) {
-            _instance->m_filename.assign(temp.substr(pos + 1, temp.length()));
-        } else {
-            _instance->m_filename.assign("?");
-        }
-    } else {
-        _instance->m_valid_funcinfo = false;
-    }
-
     return _instance;
 }
 
@@ -58,93 +168,579 @@ void CLogger::Release()
     }
 }
 
-void CLogger::Log(const char* msg, ...)
+bool CLogger::start()
 {
-    va_list vaArgs;
-    va_start(vaArgs, msg);
+    // one batch, before logging becomes asynchronous
+    dump_crash_log();
+
+#ifndef UNIT_TEST
+    if (m_drain_task_handle) {
+        return true;
+    }
+    if (!m_drain_mutex) {
+        return false;
+    }
+
+    xTaskCreate(func_drain, "TASK_LOGGER_DRAIN", TASK_STACK_DEPTH, this, TASK_PRIORITY_LOGGER, &m_drain_task_handle);
+    if (!m_drain_task_handle) {
+        ESP_LOGE(TAG, "Failed to create logger drain task");
+        return false;
+    }
 
-    va_list vaArgsCopy;
-    va_copy(vaArgsCopy, vaArgs);
-    const int len = vsnprintf(nullptr, 0, msg, vaArgsCopy);
-    va_end(vaArgsCopy);
+    // print pending messages before esp_restart
+    esp_err_t err = esp_register_shutdown_handler(func_shutdown_handler);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to register shutdown handler (ret=%d)", err);
+    }
+#endif
 
-    std::vector<char> zc(len + 1);
-    vsnprintf(zc.data(), zc.size(), msg, vaArgs);
-    va_end(vaArgs);
+    return true;
+}
 
-    Process(std::string(zc.data(), len));
+void CLogger::flush()
+{
+    drain();
 }
 
-void CLogger::Process(std::string msg)
+void CLogger::write(const log_site_info_t *site, const char *format, const uint8_t *args, size_t size, uint32_t start_cycles)
 {
-    std::string fullmsg;
-    std::string funcname;
-    size_t colons, begin, end;
-    char szlog[256]{0,};
+    log_record_header_t header;
+    header.length = (uint16_t)size;
+    header.type = site->type;
+    header.reserved = 0;
+    header.timestamp_ms = get_timestamp_ms();
+    header.site = site;
+    header.format = format;
+
+#if LOG_CRASH_RING_SIZE > 0
+    // plain memcpy into RTC memory, same cost as the task ring
+#ifndef UNIT_TEST
+    portENTER_CRITICAL(&m_crash_ring_lock);
+#endif
+    m_crash_ring.append(&header, sizeof(header), args, size);
+#ifndef UNIT_TEST
+    portEXIT_CRITICAL(&m_crash_ring_lock);
+#endif
+#endif
+
+#ifndef UNIT_TEST
+    bool async = m_drain_task_handle != nullptr;
+#else
+    bool async = false;
+#endif
+    if (!async) {
+        // drain task is not running yet (early boot) or host build
+        Process(&header, args);
+        return;
+    }
+
+    log_ring_t *ring = get_task_ring();
+    if (!ring) {
+        m_dropped_no_ring.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    uint32_t record_size = align_record_size(sizeof(header) + size);
+    uint32_t head = ring->head.load(std::memory_order_relaxed);
+    uint32_t tail = ring->tail.load(std::memory_order_acquire);
+    uint32_t used = head - tail;
+    if (LOG_RING_SIZE - used < record_size) {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    ring_copy_in(ring, head, &header, sizeof(header));
+    ring_copy_in(ring, head + sizeof(header), args, size);
+    ring->head.store(head + record_size, std::memory_order_release);
+    ring->high_water = MAX(ring->high_water, used + record_size);
+
+    uint32_t cycles = log_get_cycle_count() - start_cycles;
+    m_write_count.fetch_add(1, std::memory_order_relaxed);
+    m_write_cycles_total.fetch_add(cycles, std::memory_order_relaxed);
+    uint32_t prev_max = m_write_cycles_max.load(std::memory_order_relaxed);
+    while (cycles > prev_max && !m_write_cycles_max.compare_exchange_weak(prev_max, cycles, std::memory_order_relaxed)) {}
+}
+
+void CLogContext::Log(const char* msg, ...)
+{
+    // filtering before encoding: one relaxed load on the fast path
+    uint8_t flags = m_site->flags.load(std::memory_order_relaxed);
+    if (!(flags & LOG_SITE_REGISTERED)) {
+        flags = CLogger::Instance()->register_site(m_site);
+    }
+    if (!(flags & LOG_SITE_ACTIVE)) {
+        return;
+    }
+    if ((flags & LOG_SITE_LIMITED) && !CLogger::Instance()->acquire_token(m_site)) {
+        return;
+    }
+
+    uint32_t start_cycles = log_get_cycle_count();
+    uint8_t buffer[MAXLEN_LOG_ARGS];
+    va_list args;
+    va_start(args, msg);
+    size_t size = log_encode_args(msg, args, buffer, sizeof(buffer));
+    va_end(args);
+    CLogger::Instance()->write(m_site->info, msg, buffer, size, start_cycles);
+}
+
+void CLogger::print_logger_info()
+{
+    GetLoggerM(eLogType::Info)->Log("----- Logger -----");
+    uint32_t write_count = m_write_count.load();
+    uint32_t write_cycles_avg = write_count ? (uint32_t)(m_write_cycles_total.load() / write_count) : 0;
+    uint32_t output_bytes_avg = m_output_count ? (uint32_t)(m_output_bytes_total / m_output_count) : 0;
+    uint32_t output_cycles_avg = m_output_count ? (uint32_t)(m_output_cycles_total / m_output_count) : 0;
+    GetLoggerM(eLogType::Info)->Log("Output Format: %s", LOG_OUTPUT_FORMAT ? "binary" : "text");
+    GetLoggerM(eLogType::Info)->Log("Caller: %u messages, %u cycles (avg), %u cycles (max)", write_count, write_cycles_avg, m_write_cycles_max.load());
+    GetLoggerM(eLogType::Info)->Log("Output: %u messages, %u bytes/msg, %u cycles/msg (format + uart)", m_output_count, output_bytes_avg, output_cycles_avg);
+    int site_count = 0, site_active_count = 0;
+    for (log_site_t *site = m_sites.load(std::memory_order_acquire); site; site = site->next) {
+        site_count++;
+        if (site->flags.load() & LOG_SITE_ACTIVE) {
+            site_active_count++;
+        }
+    }
+    GetLoggerM(eLogType::Info)->Log("Call Sites: %d registered, %d active", site_count, site_active_count);
+    GetLoggerM(eLogType::Info)->Log("Rate Limit: %u message(s) suppressed", m_suppressed_count.load());
+    GetLoggerM(eLogType::Info)->Log("Crash Ring: %u bytes, %u bytes used, %u records dumped at boot",
+        (unsigned)m_crash_ring.get_size(), (unsigned)(m_crash_ring.get_head() - m_crash_ring.get_tail()), m_crash_ring_dump_count);
+    for (int i = 0; i < LOG_RING_COUNT; i++) {
+        log_ring_t *ring = &m_rings[i];
+        if (!ring->used.load()) {
+            continue;
+        }
+        GetLoggerM(eLogType::Info)->Log("Ring[%d] %s: high water %u/%d bytes, dropped %u",
+            i, ring->task_name, ring->high_water, LOG_RING_SIZE, ring->dropped_total + ring->dropped.load());
+    }
+    if (m_dropped_no_ring.load()) {
+        GetLoggerM(eLogType::Info)->Log("Dropped (no free ring): %u", m_dropped_no_ring.load());
+    }
+}
+
+void CLogger::dump_crash_log()
+{
+    if (!m_crash_ring_valid) {
+        return;
+    }
+    m_crash_ring_valid = false;
+
+    char text[96];
+#ifndef UNIT_TEST
+    const char *reason;
+    switch (esp_reset_reason()) {
+    case ESP_RST_POWERON:   reason = "power on"; break;
+    case ESP_RST_EXT:       reason = "external pin"; break;
+    case ESP_RST_SW:        reason = "software (esp_restart)"; break;
+    case ESP_RST_PANIC:     reason = "panic"; break;
+    case ESP_RST_INT_WDT:   reason = "interrupt watchdog"; break;
+    case ESP_RST_TASK_WDT:  reason = "task watchdog"; break;
+    case ESP_RST_WDT:       reason = "other watchdog"; break;
+    case ESP_RST_DEEPSLEEP: reason = "deep sleep"; break;
+    case ESP_RST_BROWNOUT:  reason = "brownout"; break;
+    case ESP_RST_SDIO:      reason = "sdio"; break;
+    default:                reason = "unknown"; break;
+    }
+#else
+    const char *reason = "unit test";
+#endif
+    snprintf(text, sizeof(text), "----- Previous Boot Log (reset reason: %s) -----", reason);
+    output_text(eLogType::Warning, get_timestamp_ms(), text);
+
+    log_record_header_t header;
+    uint8_t record[sizeof(log_record_header_t) + MAXLEN_LOG_ARGS];
+    uint32_t cursor = m_crash_ring.get_tail();
+    int length;
+    int count = 0;
+    while ((length = m_crash_ring.read(&cursor, m_crash_ring_boot_head, record, sizeof(record))) >= (int)sizeof(header)) {
+        memcpy(&header, record, sizeof(header));
+        if (header.length != length - sizeof(header)) {
+            break;
+        }
+        Process(&header, record + sizeof(header));
+        count++;
+    }
+    m_crash_ring_dump_count = count;
+
+    snprintf(text, sizeof(text), "----- End of Previous Boot Log (%d records) -----", count);
+    output_text(eLogType::Warning, get_timestamp_ms(), text);
+
+    // dumped only once
+    m_crash_ring.discard(m_crash_ring_boot_head);
+}
+
+uint8_t CLogger::register_site(log_site_t *site)
+{
+    uint8_t flags = apply_site_config(site, LOG_SITE_REGISTERED | LOG_SITE_ENABLED);
+
+    uint8_t expected = 0;
+    if (site->flags.compare_exchange_strong(expected, flags)) {
+        // lock-free push, sites are never removed
+        log_site_t *head = m_sites.load(std::memory_order_relaxed);
+        do {
+            site->next = head;
+        } while (!m_sites.compare_exchange_weak(head, site, std::memory_order_release, std::memory_order_relaxed));
+        return flags;
+    }
+
+    // registered by another task at the same time
+    return expected;
+}
+
+void CLogger::set_level(eLogType type)
+{
+    m_level = (uint8_t)type;
+    update_sites();
+}
+
+bool CLogger::set_module_level(const char *module, eLogType type)
+{
+    int index = find_module(module, true);
+    if (index < 0) {
+        return false;
+    }
+
+    m_modules[index].type = (int8_t)type;
+    update_sites();
+    return true;
+}
+
+bool CLogger::set_module_rate_limit(const char *module, uint16_t rate, uint16_t burst)
+{
+    int index = find_module(module, true);
+    if (index < 0) {
+        return false;
+    }
+
+    m_modules[index].has_rate_limit = true;
+    m_modules[index].rate = rate;
+    m_modules[index].burst = MAX(burst, (uint16_t)1);
+    update_sites();
+    return true;
+}
 
-    if (m_valid_funcinfo) {
-        colons = m_funcname.find("::");
-        if (colons != std::string::npos) {
-            begin = m_funcname.substr(0, colons).rfind(" ") + 1;
-            end = m_funcname.rfind("(") - begin;
+bool CLogger::acquire_token(log_site_t *site)
+{
+    uint32_t now_ms = get_timestamp_ms();
+    uint32_t capacity = (uint32_t)site->burst * 1000;
+    uint64_t tokens = site->tokens + (uint64_t)(now_ms - site->refill_ms) * site->rate;
+    site->refill_ms = now_ms;
+    if (tokens < 1000) {
+        site->tokens = (uint32_t)tokens;
+        site->suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    site->tokens = (uint32_t)MIN(tokens, (uint64_t)capacity) - 1000;
+
+    uint32_t suppressed = site->suppressed.exchange(0, std::memory_order_relaxed);
+    if (suppressed) {
+        write_suppressed(site, suppressed);
+    }
+    return true;
+}
+
+int CLogger::set_site_enabled(const char *filename, uint32_t fileline, bool enabled)
+{
+    int count = 0;
+    for (log_site_t *site = m_sites.load(std::memory_order_acquire); site; site = site->next) {
+        if (strcmp(site->info->filename, filename) || (fileline && site->info->fileline != fileline)) {
+            continue;
+        }
+        if (enabled) {
+            site->flags.fetch_or(LOG_SITE_ENABLED);
         } else {
-            begin = m_funcname.substr(0, colons).find(" ") + 1;
-            end = m_funcname.rfind("(") - begin;
+            site->flags.fetch_and((uint8_t)~LOG_SITE_ENABLED);
         }
+        count++;
+    }
+    update_sites();
+
+    return count;
+}
+
+int CLogger::find_module(const char *module, bool create)
+{
+    for (int i = 0; i < m_module_count; i++) {
+        if (!strcmp(m_modules[i].name, module)) {
+            return i;
+        }
+    }
+    if (!create) {
+        return -1;
+    }
+    if (m_module_count >= LOG_MODULE_COUNT) {
+        GetLogger(eLogType::Warning)->Log("Too many module settings (max: %d)", LOG_MODULE_COUNT);
+        return -1;
+    }
 
-        if (begin != std::string::npos && end != std::string::npos) {
-            funcname = m_funcname.substr(begin, end);
+    auto &item = m_modules[m_module_count];
+    strncpy(item.name, module, sizeof(item.name) - 1);
+    item.name[sizeof(item.name) - 1] = '\0';
+    item.type = -1;
+    item.has_rate_limit = false;
+    item.rate = 0;
+    item.burst = 0;
+
+    return m_module_count++;
+}
+
+uint8_t CLogger::apply_site_config(log_site_t *site, uint8_t flags)
+{
+    const log_site_info_t *info = site->info;
+    uint8_t level = m_level.load(std::memory_order_relaxed);
+    uint16_t rate = LOG_RATE_LIMIT_DEFAULT;
+    uint16_t burst = LOG_RATE_LIMIT_BURST_DEFAULT;
+    bool level_found = false, rate_found = false;
+
+    // exact name or prefix ("device_*"), first match wins
+    for (int i = 0; i < m_module_count; i++) {
+        const char *name = m_modules[i].name;
+        size_t length = strlen(name);
+        bool match;
+        if (length && name[length - 1] == '*') {
+            match = length - 1 <= info->module_length && !strncmp(name, info->filename, length - 1);
         } else {
-            funcname = m_funcname;
+            match = length == info->module_length && !strncmp(name, info->filename, length);
+        }
+        if (!match) {
+            continue;
+        }
+        if (!level_found && m_modules[i].type >= 0) {
+            level = (uint8_t)m_modules[i].type;
+            level_found = true;
+        }
+        if (!rate_found && m_modules[i].has_rate_limit) {
+            rate = m_modules[i].rate;
+            burst = m_modules[i].burst;
+            rate_found = true;
         }
+    }
 
-        snprintf(szlog, sizeof(szlog), "[%s] %s [%s:%lu]", funcname.c_str(), msg.c_str(), m_filename.c_str(), m_fileline);
-    } else {
-        snprintf(szlog, sizeof(szlog), "%s", msg.c_str());
+    flags &= ~(LOG_SITE_ACTIVE | LOG_SITE_LIMITED);
+    if ((flags & LOG_SITE_ENABLED) && log_severity(info->type) >= log_severity(level)) {
+        flags |= LOG_SITE_ACTIVE;
     }
-    
-    switch (m_eLogType) {
-	case eLogType::Info:
+    if (rate) {
+        if (!(site->flags.load() & LOG_SITE_LIMITED) || site->rate != rate || site->burst != burst) {
+            // start with a full bucket
+            site->rate = rate;
+            site->burst = burst;
+            site->tokens = (uint32_t)burst * 1000;
+            site->refill_ms = get_timestamp_ms();
+        }
+        flags |= LOG_SITE_LIMITED;
+    }
+
+    return flags;
+}
+
+void CLogger::update_sites()
+{
+    for (log_site_t *site = m_sites.load(std::memory_order_acquire); site; site = site->next) {
+        site->flags.store(apply_site_config(site, site->flags.load()));
+    }
+}
+
+void CLogger::write_suppressed(log_site_t *site, uint32_t count)
+{
+    uint8_t buffer[8];
+    CLogArgEncoder encoder(buffer, sizeof(buffer));
+    encoder.add(count);
+    write(site->info, "suppressed %u similar messages", buffer, encoder.size(), log_get_cycle_count());
+    m_suppressed_count.fetch_add(count, std::memory_order_relaxed);
+}
+
+void CLogger::flush_suppressed()
+{
+    // summary of a burst which is not followed by another message
+    uint32_t now_ms = get_timestamp_ms();
+    for (log_site_t *site = m_sites.load(std::memory_order_acquire); site; site = site->next) {
+        if (!(site->flags.load(std::memory_order_relaxed) & LOG_SITE_LIMITED) || !site->suppressed.load(std::memory_order_relaxed)) {
+            continue;
+        }
+        if (now_ms - site->refill_ms < LOG_RATE_SUMMARY_PERIOD_MS) {
+            continue;
+        }
+        uint32_t suppressed = site->suppressed.exchange(0, std::memory_order_relaxed);
+        if (suppressed) {
+            write_suppressed(site, suppressed);
+        }
+    }
+}
+
+void CLogger::print_log_sites()
+{
+    GetLoggerM(eLogType::Info)->Log("----- Log Sites -----");
+    for (log_site_t *site = m_sites.load(std::memory_order_acquire); site; site = site->next) {
+        const log_site_info_t *info = site->info;
+        uint8_t flags = site->flags.load();
+        GetLoggerM(eLogType::Info)->Log("%s:%u [%.*s] %s%s%s", info->filename, (unsigned)info->fileline, info->funcname_length, info->funcname,
+            (flags & LOG_SITE_ENABLED) ? "enabled" : "disabled", (flags & LOG_SITE_ACTIVE) ? "" : " (filtered)", (flags & LOG_SITE_LIMITED) ? " (rate limited)" : "");
+        flush();
+    }
+}
+
+log_ring_t* CLogger::get_task_ring()
+{
+    if (t_ring) {
+        return t_ring;
+    }
+
+    for (int i = 0; i < LOG_RING_COUNT; i++) {
+        bool expected = false;
+        if (m_rings[i].used.compare_exchange_strong(expected, true)) {
 #ifndef UNIT_TEST
-		ESP_LOGI(TAG, "%s", szlog);
-#else
-        printf("[I] %s\n", szlog);
+            strncpy(m_rings[i].task_name, pcTaskGetName(nullptr), sizeof(m_rings[i].task_name) - 1);
+            m_rings[i].task_name[sizeof(m_rings[i].task_name) - 1] = '\0';
 #endif
-		break;
-	case eLogType::Warning:
+            t_ring = &m_rings[i];
+            return t_ring;
+        }
+    }
+
+    return nullptr;
+}
+
+void CLogger::drain()
+{
 #ifndef UNIT_TEST
-        ESP_LOGW(TAG, "%s", szlog);
-#else
-        printf("[W] %s\n", szlog);
+    if (!m_drain_mutex || xSemaphoreTake(m_drain_mutex, portMAX_DELAY) != pdTRUE) {
+        return;
+    }
 #endif
-		break;
-	case eLogType::Error:
+
+    for (int i = 0; i < LOG_RING_COUNT; i++) {
+        if (m_rings[i].used.load(std::memory_order_acquire)) {
+            drain_ring(&m_rings[i]);
+        }
+    }
+
 #ifndef UNIT_TEST
-        ESP_LOGE(TAG, "%s", szlog);
-#else
-        printf("[E] %s\n", szlog);
+    xSemaphoreGive(m_drain_mutex);
 #endif
-		break;
-	case eLogType::Debug:
+}
+
+void CLogger::drain_ring(log_ring_t *ring)
+{
+    log_record_header_t header;
+    uint8_t args[MAXLEN_LOG_ARGS];
+    uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+    uint32_t head = ring->head.load(std::memory_order_acquire);
+
+    while (tail != head) {
+        ring_copy_out(ring, tail, &header, sizeof(header));
+        ring_copy_out(ring, tail + sizeof(header), args, header.length);
+        Process(&header, args);
+        tail += align_record_size(sizeof(header) + header.length);
+        ring->tail.store(tail, std::memory_order_release);
+    }
+
+    uint32_t dropped = ring->dropped.exchange(0, std::memory_order_relaxed);
+    if (dropped) {
+        ring->dropped_total += dropped;
+        char text[96];
+        snprintf(text, sizeof(text), "%u message(s) dropped (task: %s, ring buffer full)", (unsigned)dropped, ring->task_name);
+        output_text(eLogType::Warning, get_timestamp_ms(), text);
+    }
+}
+
+void CLogger::Process(const log_record_header_t *header, const uint8_t *args)
+{
+    uint32_t start_cycles = log_get_cycle_count();
+    size_t output_size;
+
+#if LOG_OUTPUT_FORMAT == 1
+    uint8_t frame[LOG_FRAME_SIZE_MAX];
+    output_size = log_encode_frame((uint32_t)(uintptr_t)header->site, (uint32_t)(uintptr_t)header->format, header->timestamp_ms, args, header->length, frame);
 #ifndef UNIT_TEST
-        ESP_LOGD(TAG, "%s", szlog);
+    // raw bytes: stdout would translate LF to CRLF
+    for (size_t i = 0; i < output_size; i++) {
+        esp_rom_uart_tx_one_char(frame[i]);
+    }
 #else
-        printf("[D] %s\n", szlog);
+    fwrite(frame, 1, output_size, stdout);
 #endif
-		break;
-	case eLogType::Exception:
-#ifndef UNIT_TEST
-        ESP_LOGE(TAG, "%s", szlog);
 #else
-        printf("[E] %s\n", szlog);
+    char text[MAXLEN_LOG_MSG];
+    char szlog[256]{0,};
+    log_render(header->format, args, header->length, text, sizeof(text));
+
+    const log_site_info_t *site = header->site;
+    if (site && site->funcname_length) {
+        snprintf(szlog, sizeof(szlog), "[%.*s] %s [%s:%u]", site->funcname_length, site->funcname, text, site->filename, (unsigned)site->fileline);
+    } else {
+        snprintf(szlog, sizeof(szlog), "%s", text);
+    }
+    output_text(header->type, header->timestamp_ms, szlog);
+    output_size = strlen(szlog);
 #endif
+
+    m_output_count++;
+    m_output_bytes_total += output_size;
+    m_output_cycles_total += log_get_cycle_count() - start_cycles;
+}
+
+void CLogger::output_text(uint8_t type, uint32_t timestamp_ms, const char *text)
+{
+#ifndef UNIT_TEST
+    // timestamp of the call site, not of the drain task
+    switch (type) {
+	case eLogType::Warning:
+        esp_log_write(ESP_LOG_WARN, TAG, LOG_COLOR_W "W (%lu) %s: %s" LOG_RESET_COLOR "\n", (unsigned long)timestamp_ms, TAG, text);
+		break;
+	case eLogType::Error:
+    case eLogType::Exception:
+        esp_log_write(ESP_LOG_ERROR, TAG, LOG_COLOR_E "E (%lu) %s: %s" LOG_RESET_COLOR "\n", (unsigned long)timestamp_ms, TAG, text);
 		break;
+	case eLogType::Debug:
+        esp_log_write(ESP_LOG_DEBUG, TAG, LOG_COLOR_D "D (%lu) %s: %s" LOG_RESET_COLOR "\n", (unsigned long)timestamp_ms, TAG, text);
+		break;
+    case eLogType::Info:
     default:
-#ifndef UNIT_TEST
-        ESP_LOGI(TAG, "%s", szlog);
+        esp_log_write(ESP_LOG_INFO, TAG, LOG_COLOR_I "I (%lu) %s: %s" LOG_RESET_COLOR "\n", (unsigned long)timestamp_ms, TAG, text);
+        break;
+	}
 #else
-        printf("[I] %s\n", szlog);
-#endif
+    (void)timestamp_ms;
+    switch (type) {
+	case eLogType::Warning:
+        printf("[W] %s\n", text);
+		break;
+	case eLogType::Error:
+	case eLogType::Exception:
+        printf("[E] %s\n", text);
+		break;
+	case eLogType::Debug:
+        printf("[D] %s\n", text);
+		break;
+	case eLogType::Info:
+    default:
+        printf("[I] %s\n", text);
         break;
 	}
+#endif
+}
+
+#ifndef UNIT_TEST
+void CLogger::func_drain(void *param)
+{
+    CLogger *obj = static_cast<CLogger *>(param);
+    while (1) {
+        obj->drain();
+        uint32_t now_ms = get_timestamp_ms();
+        if (now_ms - obj->m_summary_ms >= LOG_RATE_SUMMARY_PERIOD_MS) {
+            obj->m_summary_ms = now_ms;
+            obj->flush_suppressed();
+        }
+        vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_PERIOD_MS));
+    }
+    vTaskDelete(nullptr);
+}
+
+void CLogger::func_shutdown_handler()
+{
+    if (_instance) {
+        _instance->flush();
+    }
 }
+#endif
@@ -1,20 +1,77 @@
 #include "memory.h"
-#include "nvs_flash.h"
-#include "nvs.h"
 #include "logger.h"
-#include "cJSON.h"
-#include "ws2812.h"
+#include "crc32.h"
+#include <string.h>
+#ifdef UNIT_TEST
+#include <chrono>
+#else
+#include "esp_timer.h"
+#include "esp_system.h"
+#endif
 
 #define MEMORY_NAMESPACE "yogyui"
 
 CMemory* CMemory::_instance;
 
+static int64_t get_time_us()
+{
+#ifdef UNIT_TEST
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#else
+    return esp_timer_get_time();
+#endif
+}
+
 CMemory::CMemory()
 {
+#ifndef UNIT_TEST
+    m_mutex = xSemaphoreCreateMutex();
+    m_flush_mutex = xSemaphoreCreateMutex();
+    m_flush_task_handle = nullptr;
+#endif
+    m_backend = nullptr;
+    m_backend_owned = false;
+    m_batch_depth = 0;
+    m_journal_flash = nullptr;
+    m_journal_flash_owned = false;
+    m_journal_ready = false;
+    m_light_state_loaded = false;
+    m_light_state_dirty = false;
+    m_write_request_count = 0;
+    m_commit_count = 0;
+    m_flush_us_max = 0;
 }
 
 CMemory::~CMemory()
 {
+    flush();
+#ifndef UNIT_TEST
+    if (m_flush_task_handle) {
+        vTaskDelete(m_flush_task_handle);
+        m_flush_task_handle = nullptr;
+    }
+#endif
+    if (m_backend) {
+        m_backend->close();
+        if (m_backend_owned) {
+            delete m_backend;
+        }
+        m_backend = nullptr;
+    }
+    if (m_journal_flash_owned) {
+        delete m_journal_flash;
+    }
+    m_journal_flash = nullptr;
+#ifndef UNIT_TEST
+    if (m_mutex) {
+        vSemaphoreDelete(m_mutex);
+        m_mutex = nullptr;
+    }
+    if (m_flush_mutex) {
+        vSemaphoreDelete(m_flush_mutex);
+        m_flush_mutex = nullptr;
+    }
+#endif
 }
 
 CMemory* CMemory::Instance()
@@ -34,103 +91,484 @@ void CMemory::Release()
     }
 }
 
-bool CMemory::read_nvs(const char *key, void *out, size_t data_size)
+bool CMemory::initialize(CMemoryBackend *backend/*=nullptr*/, CJournalFlash *journal_flash/*=nullptr*/)
 {
-    nvs_handle handle;
+    if (m_backend) {
+        return true;
+    }
 
-    esp_err_t err = nvs_open(MEMORY_NAMESPACE, NVS_READWRITE, &handle);
-    if (err != ESP_OK) {
-        GetLogger(eLogType::Error)->Log("Failed to open nvs (ret=%d)", err);
+    if (backend) {
+        m_backend = backend;
+        m_backend_owned = false;
+    } else {
+#ifdef UNIT_TEST
+        m_backend = new CMemoryBackendRam();
+#else
+        m_backend = new CMemoryBackendNvs(MEMORY_NAMESPACE);
+#endif
+        m_backend_owned = true;
+    }
+
+    // storage handle is opened once and kept until release
+    if (!m_backend->open()) {
+        GetLogger(eLogType::Error)->Log("Failed to open memory backend (%s)", m_backend->get_name());
         return false;
     }
 
-    size_t temp = data_size;
-    err = nvs_get_blob(handle, key, out, &temp);
-    if (err != ESP_OK) {
-        GetLogger(eLogType::Error)->Log("Failed to get blob (%s, ret=%d)", key, err);
-        nvs_close(handle);
+    // light state journal (devices updated by ota may not have the partition)
+#ifndef UNIT_TEST
+    if (!journal_flash) {
+        CJournalFlashPartition *partition = new CJournalFlashPartition();
+        if (partition->initialize(JOURNAL_PARTITION_LABEL)) {
+            journal_flash = partition;
+            m_journal_flash_owned = true;
+        } else {
+            delete partition;
+        }
+    }
+#endif
+    if (journal_flash) {
+        m_journal_flash = journal_flash;
+        m_journal_ready = m_journal.initialize(journal_flash);
+    }
+    if (!m_journal_ready) {
+        GetLogger(eLogType::Warning)->Log("Journal is not available, light state is stored in nvs");
+    }
+
+#ifndef UNIT_TEST
+    xTaskCreate(func_flush, "TASK_MEMORY_FLUSH", TASK_STACK_DEPTH, this, TASK_PRIORITY_MEMORY, &m_flush_task_handle);
+    if (!m_flush_task_handle) {
+        GetLogger(eLogType::Error)->Log("Failed to create flush task");
         return false;
     }
 
-    nvs_close(handle);
+    // flush pending data before esp_restart (factory reset, ota reboot, ...)
+    esp_err_t err = esp_register_shutdown_handler(func_shutdown_handler);
+    if (err != ESP_OK) {
+        GetLogger(eLogType::Warning)->Log("Failed to register shutdown handler (ret=%d)", err);
+    }
+
+    // entries saved before initialization
+    request_flush();
+#endif
+
+    GetLogger(eLogType::Info)->Log("Initialized (backend: %s, write-behind delay: %d ms)", m_backend->get_name(), MEMORY_FLUSH_DELAY_MS);
     return true;
 }
 
-bool CMemory::write_nvs(const char *key, const void *data, const size_t data_size)
+void CMemory::lock()
 {
-    nvs_handle handle;
+#ifdef UNIT_TEST
+    m_mutex.lock();
+#else
+    xSemaphoreTake(m_mutex, portMAX_DELAY);
+#endif
+}
 
-    esp_err_t err = nvs_open(MEMORY_NAMESPACE, NVS_READWRITE, &handle);
-    if (err != ESP_OK) {
-        GetLogger(eLogType::Error)->Log("Failed to open nvs (ret=%d)", err);
+void CMemory::unlock()
+{
+#ifdef UNIT_TEST
+    m_mutex.unlock();
+#else
+    xSemaphoreGive(m_mutex);
+#endif
+}
+
+void CMemory::lock_flush()
+{
+#ifdef UNIT_TEST
+    m_flush_mutex.lock();
+#else
+    xSemaphoreTake(m_flush_mutex, portMAX_DELAY);
+#endif
+}
+
+void CMemory::unlock_flush()
+{
+#ifdef UNIT_TEST
+    m_flush_mutex.unlock();
+#else
+    xSemaphoreGive(m_flush_mutex);
+#endif
+}
+
+void CMemory::request_flush()
+{
+    /**
+     * without flush task (before initialization, host unit test),
+     * dirty entries are committed by explicit flush()
+     */
+#ifndef UNIT_TEST
+    if (m_flush_task_handle) {
+        xTaskNotifyGive(m_flush_task_handle);
+    }
+#endif
+}
+
+CMemory::cache_entry_t* CMemory::find_cache_entry(const memory_key_t &key)
+{
+    for (auto &entry : m_cache) {
+        if (entry.key.hash == key.hash && !strcmp(entry.key.name, key.name)) {
+            return &entry;
+        }
+    }
+
+    return nullptr;
+}
+
+bool CMemory::read_entry(const memory_key_t &key, void *out, size_t data_size, size_t *read_size/*=nullptr*/)
+{
+    // read-through cache (pending dirty value is newer than storage)
+    lock();
+    cache_entry_t *entry = find_cache_entry(key);
+    if (entry) {
+        bool result = read_size ? entry->data.size() <= data_size : entry->data.size() == data_size;
+        if (result) {
+            memcpy(out, entry->data.data(), entry->data.size());
+            if (read_size) {
+                *read_size = entry->data.size();
+            }
+        }
+        unlock();
+        return result;
+    }
+    unlock();
+
+    if (!m_backend) {
+        GetLogger(eLogType::Error)->Log("Not initialized!");
         return false;
     }
 
-    err = nvs_set_blob(handle, key, data, data_size);
-    if (err != ESP_OK) {
-        GetLogger(eLogType::Error)->Log("Failed to set nvs blob (%s, ret=%d)", key, err);
-        nvs_close(handle);
+    size_t temp = data_size;
+    if (!m_backend->read(key.name, out, &temp)) {
         return false;
     }
 
-    err = nvs_commit(handle);
-    if (err != ESP_OK) {
-        GetLogger(eLogType::Error)->Log("Failed to commit nvs (ret=%d)", err);
-        nvs_close(handle);
+    if (read_size) {
+        *read_size = temp;
+    } else if (temp != data_size) {
+        GetLogger(eLogType::Error)->Log("Blob size mismatch (%s, %d != %d)", key.name, (int)temp, (int)data_size);
         return false;
     }
 
-    nvs_close(handle);
+    lock();
+    if (!find_cache_entry(key)) {
+        const uint8_t *ptr = (const uint8_t *)out;
+        m_cache.push_back({key, std::vector<uint8_t>(ptr, ptr + temp), false});
+    }
+    unlock();
+
     return true;
 }
 
-bool CMemory::load_ws2812_brightness(uint8_t *brightness)
+bool CMemory::write_entry(const memory_key_t &key, const void *data, const size_t data_size)
 {
-    uint8_t temp;
-    if (read_nvs("ws2812_br", &temp, sizeof(uint8_t))) {
-        GetLogger(eLogType::Info)->Log("load <ws2812 brightness> from memory: %d", temp);
-        *brightness = temp;
-    } else{
-        return false;
+    /**
+     * write-behind: only RAM cache is updated here (called from CHIP/button task),
+     * storage commit is deferred to the flush task
+     */
+    const uint8_t *ptr = (const uint8_t *)data;
+
+    lock();
+    m_write_request_count++;
+    cache_entry_t *entry = find_cache_entry(key);
+    if (entry) {
+        if (entry->data.size() == data_size && !memcmp(entry->data.data(), data, data_size)) {
+            // same value (already committed or pending)
+            unlock();
+            return true;
+        }
+        entry->data.assign(ptr, ptr + data_size);
+        entry->dirty = true;
+    } else {
+        m_cache.push_back({key, std::vector<uint8_t>(ptr, ptr + data_size), true});
+    }
+    bool batching = m_batch_depth > 0;
+    unlock();
+
+    if (!batching) {
+        request_flush();
     }
 
     return true;
 }
 
-bool CMemory::save_ws2812_brightness(const uint8_t brightness)
+void CMemory::begin_batch()
 {
-    if (write_nvs("ws2812_br", &brightness, sizeof(uint8_t))) {
-        GetLogger(eLogType::Info)->Log("save <ws2812 brightness> to memory: %d", brightness);
-    } else {
-        return false;
+    lock();
+    m_batch_depth++;
+    unlock();
+}
+
+void CMemory::end_batch()
+{
+    lock();
+    if (m_batch_depth > 0) {
+        m_batch_depth--;
     }
+    bool done = m_batch_depth == 0;
+    unlock();
 
-    return true;
+    if (done) {
+        request_flush();
+    }
 }
 
-bool CMemory::load_ws2812_color(uint8_t *red, uint8_t *green, uint8_t *blue)
+bool CMemory::flush(bool force/*=true*/)
 {
-    rgb_t rgb;
-    if (read_nvs("ws2812_rgb", &rgb, sizeof(rgb_t))) {
-        GetLogger(eLogType::Info)->Log("load <ws2812 rgb> from memory");
-        *red = rgb.r;
-        *green = rgb.g;
-        *blue = rgb.b;
-    } else{
+    if (!m_backend) {
         return false;
     }
 
+    lock_flush();
+
+    // copy dirty entries and release lock before touching flash
+    std::vector<cache_entry_t> pending;
+    light_state_t light_state;
+    bool light_state_dirty = false;
+    lock();
+    if (!force && m_batch_depth > 0) {
+        // end_batch() requests flush again
+        unlock();
+        unlock_flush();
+        return true;
+    }
+    for (auto &entry : m_cache) {
+        if (entry.dirty) {
+            pending.push_back(entry);
+            entry.dirty = false;
+        }
+    }
+    if (m_light_state_dirty) {
+        light_state = m_light_state;
+        light_state_dirty = true;
+        m_light_state_dirty = false;
+    }
+    unlock();
+
+    if (pending.empty() && !light_state_dirty) {
+        unlock_flush();
+        return true;
+    }
+
+    int64_t tm_begin = get_time_us();
+    bool result = true;
+    for (auto &entry : pending) {
+        if (!m_backend->write(entry.key.name, entry.data.data(), entry.data.size())) {
+            result = false;
+            break;
+        }
+    }
+    if (result && !pending.empty()) {
+        // single commit for every dirty key
+        result = m_backend->commit();
+    }
+    bool journal_result = true;
+    if (light_state_dirty) {
+        journal_result = m_journal.append(&light_state, sizeof(light_state_t));
+    }
+    uint32_t elapsed_us = (uint32_t)(get_time_us() - tm_begin);
+
+    lock();
+    m_flush_us_max = MAX(m_flush_us_max, elapsed_us);
+    if (result && !pending.empty()) {
+        m_commit_count++;
+    }
+    if (!result) {
+        // mark dirty again unless newer value is already pending
+        for (auto &item : pending) {
+            cache_entry_t *entry = find_cache_entry(item.key);
+            if (entry && !entry->dirty) {
+                entry->dirty = true;
+            }
+        }
+    }
+    if (!journal_result) {
+        m_light_state_dirty = true;
+    }
+    unlock();
+    unlock_flush();
+
+    if (result && journal_result) {
+        GetLogger(eLogType::Info)->Log("flushed %d key(s) to %s%s (%u us)", (int)pending.size(), m_backend->get_name(), light_state_dirty ? " + journal" : "", elapsed_us);
+    }
+
+    return result && journal_result;
+}
+
+void CMemory::print_memory_info()
+{
+    int64_t uptime_us = get_time_us();
+    uint32_t commit_per_min_x100 = uptime_us > 0 ? (uint32_t)((uint64_t)m_commit_count * 6000000000ULL / uptime_us) : 0;
+
+    GetLoggerM(eLogType::Info)->Log("----- Memory -----");
+    GetLoggerM(eLogType::Info)->Log("Backend: %s, Cached Keys: %d", m_backend ? m_backend->get_name() : "-", (int)m_cache.size());
+    GetLoggerM(eLogType::Info)->Log("Write Requests: %u, Commits: %u", m_write_request_count, m_commit_count);
+    GetLoggerM(eLogType::Info)->Log("Commits per Minute: %u.%02u", commit_per_min_x100 / 100, commit_per_min_x100 % 100);
+    GetLoggerM(eLogType::Info)->Log("Flush Time (max): %u us", m_flush_us_max);
+    m_journal.print_journal_info();
+}
+
+#ifndef UNIT_TEST
+void CMemory::func_flush(void *param)
+{
+    CMemory *obj = static_cast<CMemory *>(param);
+
+    while (1) {
+        // wait for first dirty entry
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // debounce: flush after MEMORY_FLUSH_DELAY_MS without new write request
+        // (bounded by MEMORY_FLUSH_MAX_DELAY_MS during continuous changes such as dimming sweep)
+        int64_t tm_first = esp_timer_get_time();
+        while (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MEMORY_FLUSH_DELAY_MS))) {
+            if (esp_timer_get_time() - tm_first >= (int64_t)MEMORY_FLUSH_MAX_DELAY_MS * 1000) {
+                break;
+            }
+        }
+
+        obj->flush(false);
+    }
+
+    vTaskDelete(nullptr);
+}
+
+void CMemory::func_shutdown_handler()
+{
+    if (_instance) {
+        _instance->flush();
+    }
+}
+#endif
+
+uint32_t CMemory::calc_light_state_crc(const void *data, size_t size)
+{
+    return calc_crc32(data, size);
+}
+
+bool CMemory::read_light_state()
+{
+    light_state_t state;
+    uint8_t buffer[sizeof(light_state_t)] = {0, };
+    size_t read_size = 0;
+
+    m_light_state_loaded = true;
+    bool from_journal = m_journal_ready && m_journal.load(buffer, sizeof(buffer), &read_size);
+    if (!from_journal && !read_entry(MEMORY_KEY_LIGHT_STATE, buffer, sizeof(buffer), &read_size)) {
+        return migrate_legacy_light_state();
+    }
+
+    // validate header & crc (crc is always the last 4 bytes of the record)
+    const size_t header_size = sizeof(state.version) + sizeof(state.size);
+    uint16_t version, size;
+    uint32_t crc;
+    memcpy(&version, &buffer[0], sizeof(version));
+    memcpy(&size, &buffer[sizeof(version)], sizeof(size));
+    if (read_size < header_size + sizeof(crc) || size != read_size || version == 0 || version > LIGHT_STATE_VERSION) {
+        GetLogger(eLogType::Error)->Log("Invalid light state record (version: %d, size: %d)", version, (int)read_size);
+        return migrate_legacy_light_state();
+    }
+    memcpy(&crc, &buffer[size - sizeof(crc)], sizeof(crc));
+    if (crc != calc_light_state_crc(buffer, size - sizeof(crc))) {
+        GetLogger(eLogType::Error)->Log("Light state record crc mismatch");
+        return migrate_legacy_light_state();
+    }
+
+    // older schema: fields appended afterward keep default value
+    memcpy(&state, buffer, size - sizeof(crc));
+    if (version != LIGHT_STATE_VERSION) {
+        GetLogger(eLogType::Info)->Log("Migrate light state record (version %d -> %d)", version, LIGHT_STATE_VERSION);
+        save_light_state(&state);
+    } else if (m_journal_ready && !from_journal) {
+        // first boot with journal partition: nvs record becomes the first snapshot
+        GetLogger(eLogType::Info)->Log("Move light state record to journal");
+        save_light_state(&state);
+    }
+
+    lock();
+    m_light_state = state;
+    m_light_state.version = LIGHT_STATE_VERSION;
+    m_light_state.size = sizeof(light_state_t);
+    m_light_state.crc = calc_light_state_crc(&m_light_state, sizeof(light_state_t) - sizeof(m_light_state.crc));
+    unlock();
+    GetLogger(eLogType::Info)->Log("load <light state> from %s (version: %d)", from_journal ? "journal" : "nvs", version);
+
     return true;
 }
 
-bool CMemory::save_ws2812_color(const uint8_t red, uint8_t green, uint8_t blue)
+bool CMemory::migrate_legacy_light_state()
 {
-    rgb_t rgb = rgb_t(red, green, blue);
-    if (write_nvs("ws2812_rgb", &rgb, sizeof(rgb_t))) {
-        GetLogger(eLogType::Info)->Log("save <ws2812 rgb> to memory");
-    } else {
+    // version 0: separated brightness, color blobs
+    light_state_t state;
+    bool found = false;
+
+    uint8_t brightness;
+    if (load(MEMORY_KEY_LEGACY_BRIGHTNESS, &brightness)) {
+        state.brightness = brightness;
+        state.onoff = brightness ? 1 : 0;
+        state.level = MAX(1, brightness);
+        found = true;
+    }
+
+    uint8_t rgb[3];
+    if (load(MEMORY_KEY_LEGACY_RGB, &rgb)) {
+        state.red = rgb[0];
+        state.green = rgb[1];
+        state.blue = rgb[2];
+        found = true;
+    }
+
+    lock();
+    m_light_state = state;
+    unlock();
+
+    if (!found) {
         return false;
     }
 
-    return true;
-}
\ No newline at end of file
+    GetLogger(eLogType::Info)->Log("Migrate legacy light state (version 0 -> %d)", LIGHT_STATE_VERSION);
+    return save_light_state(&state);
+}
+
+bool CMemory::load_light_state(light_state_t *state)
+{
+    // only the first call (at boot) accesses nvs
+    bool result = m_light_state_loaded ? true : read_light_state();
+
+    lock();
+    *state = m_light_state;
+    unlock();
+
+    return result;
+}
+
+bool CMemory::save_light_state(const light_state_t *state)
+{
+    light_state_t temp = *state;
+    temp.version = LIGHT_STATE_VERSION;
+    temp.size = sizeof(light_state_t);
+    temp.crc = calc_light_state_crc(&temp, sizeof(light_state_t) - sizeof(temp.crc));
+
+    lock();
+    if (m_journal_ready) {
+        m_write_request_count++;
+        if (m_light_state_loaded && !memcmp(&m_light_state, &temp, sizeof(light_state_t))) {
+            unlock();
+            return true;
+        }
+        m_light_state = temp;
+        m_light_state_loaded = true;
+        m_light_state_dirty = true;
+        bool batching = m_batch_depth > 0;
+        unlock();
+        if (!batching) {
+            request_flush();
+        }
+        return true;
+    }
+    m_light_state = temp;
+    m_light_state_loaded = true;
+    unlock();
+
+    return save(MEMORY_KEY_LIGHT_STATE, temp);
+}
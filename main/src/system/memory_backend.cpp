@@ -0,0 +1,185 @@
+#include "memory_backend.h"
+#include "logger.h"
+#include <string.h>
+
+#ifndef UNIT_TEST
+CMemoryBackendNvs::CMemoryBackendNvs(const char *name_space)
+{
+    m_namespace = name_space;
+    m_handle = 0;
+    m_opened = false;
+}
+
+CMemoryBackendNvs::~CMemoryBackendNvs()
+{
+    close();
+}
+
+const char* CMemoryBackendNvs::get_name()
+{
+    return "NVS";
+}
+
+bool CMemoryBackendNvs::open()
+{
+    if (m_opened) {
+        return true;
+    }
+
+    esp_err_t err = nvs_open(m_namespace.c_str(), NVS_READWRITE, &m_handle);
+    if (err != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to open nvs (ret=%d)", err);
+        return false;
+    }
+
+    m_opened = true;
+    return true;
+}
+
+void CMemoryBackendNvs::close()
+{
+    if (m_opened) {
+        nvs_close(m_handle);
+        m_opened = false;
+    }
+}
+
+bool CMemoryBackendNvs::read(const char *key, void *out, size_t *size)
+{
+    if (!m_opened) {
+        return false;
+    }
+
+    esp_err_t err = nvs_get_blob(m_handle, key, out, size);
+    if (err != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to get blob (%s, ret=%d)", key, err);
+        return false;
+    }
+
+    return true;
+}
+
+bool CMemoryBackendNvs::write(const char *key, const void *data, size_t size)
+{
+    if (!m_opened) {
+        return false;
+    }
+
+    esp_err_t err = nvs_set_blob(m_handle, key, data, size);
+    if (err != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to set nvs blob (%s, ret=%d)", key, err);
+        return false;
+    }
+
+    return true;
+}
+
+bool CMemoryBackendNvs::commit()
+{
+    if (!m_opened) {
+        return false;
+    }
+
+    esp_err_t err = nvs_commit(m_handle);
+    if (err != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to commit nvs (ret=%d)", err);
+        return false;
+    }
+
+    return true;
+}
+#endif
+
+CMemoryBackendRam::CMemoryBackendRam()
+{
+    m_opened = false;
+    m_write_count = 0;
+    m_commit_count = 0;
+}
+
+CMemoryBackendRam::~CMemoryBackendRam()
+{
+}
+
+const char* CMemoryBackendRam::get_name()
+{
+    return "RAM";
+}
+
+bool CMemoryBackendRam::open()
+{
+    m_opened = true;
+    return true;
+}
+
+void CMemoryBackendRam::close()
+{
+    m_opened = false;
+}
+
+bool CMemoryBackendRam::read(const char *key, void *out, size_t *size)
+{
+    if (!m_opened) {
+        return false;
+    }
+
+    auto it = m_pending.find(key);
+    if (it == m_pending.end()) {
+        it = m_storage.find(key);
+        if (it == m_storage.end()) {
+            return false;
+        }
+    }
+
+    // same as nvs_get_blob: buffer should be large enough
+    if (it->second.size() > *size) {
+        return false;
+    }
+    memcpy(out, it->second.data(), it->second.size());
+    *size = it->second.size();
+
+    return true;
+}
+
+bool CMemoryBackendRam::write(const char *key, const void *data, size_t size)
+{
+    if (!m_opened) {
+        return false;
+    }
+
+    const uint8_t *ptr = (const uint8_t *)data;
+    m_pending[key].assign(ptr, ptr + size);
+    m_write_count++;
+
+    return true;
+}
+
+bool CMemoryBackendRam::commit()
+{
+    if (!m_opened) {
+        return false;
+    }
+
+    for (auto &item : m_pending) {
+        m_storage[item.first] = item.second;
+    }
+    m_pending.clear();
+    m_commit_count++;
+
+    return true;
+}
+
+void CMemoryBackendRam::discard_uncommitted()
+{
+    m_pending.clear();
+}
+
+uint32_t CMemoryBackendRam::get_write_count()
+{
+    return m_write_count;
+}
+
+uint32_t CMemoryBackendRam::get_commit_count()
+{
+    return m_commit_count;
+}
@@ -4,6 +4,7 @@
 #include "definition.h"
 #include "util.h"
 #include "cJSON.h"
+#include <string.h>
 #include <nvs_flash.h>
 #include <esp_matter_bridge.h>
 #include <esp_matter_feature.h>
@@ -12,16 +13,34 @@
 #include <esp_chip_info.h>
 #include <esp_flash.h>
 #include <esp_app_desc.h>
+#include <esp_timer.h>
 #include <app/server/Server.h>
 #include <esp_matter_providers.h>
 #include "ws2812.h"
-#include "device_onoff_light.h"
-#include "device_levelcontrol_light.h"
-#include "device_colorcontrol_light.h"
+#include "device_light.h"
 
 CSystem* CSystem::_instance = nullptr;
 bool CSystem::m_default_btn_pressed_long = false;
+CHistogram CSystem::m_button_press_histogram;
+CHistogram CSystem::m_button_light_histogram;
+uint32_t CSystem::m_button_drop_count = 0;
 bool CSystem::m_commisioning_session_working = false;
+QueueHandle_t CSystem::m_queue_attribute = nullptr;
+CHistogram CSystem::m_callback_histogram;
+CHistogram CSystem::m_queue_latency_histogram;
+CHistogram CSystem::m_handle_histogram;
+CHistogram CSystem::m_commit_histogram;
+uint32_t CSystem::m_attribute_sync_count = 0;
+uint32_t CSystem::m_attribute_queue_full_count = 0;
+uint32_t CSystem::m_attribute_drop_count = 0;
+matter_attribute_event_t CSystem::m_attribute_overflow[DEVICE_ATTRIBUTE_OVERFLOW_MAX];
+size_t CSystem::m_attribute_overflow_count = 0;
+portMUX_TYPE CSystem::m_attribute_overflow_lock = portMUX_INITIALIZER_UNLOCKED;
+
+#if BRIDGE_MODE && defined(CONFIG_ESP_MATTER_MAX_DYNAMIC_ENDPOINT_COUNT)
+// root node + aggregator + bridged lights
+static_assert(BRIDGE_ENDPOINT_COUNT + 2 <= CONFIG_ESP_MATTER_MAX_DYNAMIC_ENDPOINT_COUNT, "raise CONFIG_ESP_MATTER_MAX_DYNAMIC_ENDPOINT_COUNT for BRIDGE_ENDPOINT_COUNT");
+#endif
 
 typedef struct matter_node {
     void *endpoint_list;
@@ -32,7 +51,10 @@ CSystem::CSystem()
 {
     m_root_node = nullptr;
     m_handle_default_btn = nullptr;
+    m_task_handle_device = nullptr;
+    m_endpoint_aggregator = nullptr;
     m_device_list.clear();
+    memset(m_device_index, 0, sizeof(m_device_index));
 }
 
 CSystem::~CSystem()
@@ -54,6 +76,12 @@ CSystem* CSystem::Instance()
 
 bool CSystem::initialize()
 {
+    if (!CLogger::Instance()->start()) {
+        GetLogger(eLogType::Warning)->Log("Failed to start logger, logging is synchronous");
+    }
+    // attribute change, color and pwm duty logs flood the console during transitions and scene sweeps
+    CLogger::Instance()->set_module_rate_limit("device*", LOG_RATE_LIMIT_HOT, LOG_RATE_LIMIT_BURST_HOT);
+    CLogger::Instance()->set_module_rate_limit("ws2812", LOG_RATE_LIMIT_HOT, LOG_RATE_LIMIT_BURST_HOT);
     GetLogger(eLogType::Info)->Log("Start Initializing System");
     
     esp_err_t ret = nvs_flash_init();
@@ -65,11 +93,17 @@ bool CSystem::initialize()
         GetLogger(eLogType::Error)->Log("Failed to initialize nsv flash (%d)", ret);
         return false;
     }
+    GetMemory()->initialize();
 
     if (!init_default_button()) {
         GetLogger(eLogType::Warning)->Log("Failed to init default on-board button");
     }
 
+    // should be ready before matter starts (attribute callback)
+    if (!start_device_worker()) {
+        GetLogger(eLogType::Warning)->Log("Failed to start device worker, attribute changes are handled in CHIP task");
+    }
+
     // create matter root node
     esp_matter::node::config_t node_config;
     snprintf(node_config.root_node.basic_information.node_label, sizeof(node_config.root_node.basic_information.node_label), PRODUCT_NAME);
@@ -97,6 +131,11 @@ bool CSystem::initialize()
 
     GetWS2812Ctrl()->initialize();
     // set matter endpoints
+#if BRIDGE_MODE
+    if (!create_bridged_devices()) {
+        return false;
+    }
+#else
     CDevice *dev = nullptr;
 #if LIGHT_TYPE == 0
     dev = new CDeviceOnOffLight();
@@ -105,11 +144,10 @@ bool CSystem::initialize()
 #elif LIGHT_TYPE == 2
     dev = new CDeviceColorControlLight();
 #endif
-    if (dev && dev->matter_add_endpoint()) {
-        m_device_list.push_back(dev);
-    } else {
+    if (!dev || !dev->matter_add_endpoint() || !add_device(dev)) {
         return false;
     }
+#endif
 
     GetLogger(eLogType::Info)->Log("System Initialized");
     print_system_info();
@@ -130,6 +168,12 @@ void CSystem::callback_default_button(void *arg, void *data)
 //  GetLogger(eLogType::Info)->Log("button callback event: %d", event);
     switch (event) {
     case BUTTON_PRESS_DOWN: // 0
+        /**
+         * toggle on press down (no click detection window), the device worker changes the light
+         * (esp_timer task doesn't touch the devices) and prints system info after the light has changed
+         */
+        _instance->request_toggle();
+        _instance->request_system_info();
         break;
     case BUTTON_PRESS_UP:   // 1
         if (m_default_btn_pressed_long) {
@@ -137,13 +181,6 @@ void CSystem::callback_default_button(void *arg, void *data)
         }
         m_default_btn_pressed_long = false;
         break;
-    case BUTTON_SINGLE_CLICK:   // 4
-        _instance->print_system_info();
-        _instance->toggle_device_state_action();
-        break;
-    case BUTTON_DOUBLE_CLICK:   // 5
-        _instance->print_matter_endpoints_info();
-        break;
     case BUTTON_LONG_PRESS_START:   // 6
         m_default_btn_pressed_long = true;
         GetLogger(eLogType::Info)->Log("ready to factory reset");
@@ -173,8 +210,6 @@ bool CSystem::init_default_button()
 
     iot_button_register_cb(m_handle_default_btn, BUTTON_PRESS_DOWN, callback_default_button, nullptr);
     iot_button_register_cb(m_handle_default_btn, BUTTON_PRESS_UP, callback_default_button, nullptr);
-    iot_button_register_cb(m_handle_default_btn, BUTTON_SINGLE_CLICK, callback_default_button, nullptr);
-    iot_button_register_cb(m_handle_default_btn, BUTTON_DOUBLE_CLICK, callback_default_button, nullptr);
     iot_button_register_cb(m_handle_default_btn, BUTTON_LONG_PRESS_START, callback_default_button, nullptr);
     iot_button_register_cb(m_handle_default_btn, BUTTON_LONG_PRESS_HOLD, callback_default_button, nullptr);
     
@@ -191,6 +226,232 @@ bool CSystem::deinit_default_button()
     return false;
 }
 
+bool CSystem::start_device_worker()
+{
+    m_queue_attribute = xQueueCreate(DEVICE_ATTRIBUTE_QUEUE_LENGTH, sizeof(matter_attribute_event_t));
+    if (!m_queue_attribute) {
+        GetLogger(eLogType::Error)->Log("Failed to create attribute queue");
+        return false;
+    }
+
+    BaseType_t ret = xTaskCreate(func_device_worker, "TASK_DEVICE_WORKER", TASK_STACK_DEPTH, this, TASK_PRIORITY_DEVICE, &m_task_handle_device);
+    if (ret != pdPASS) {
+        GetLogger(eLogType::Error)->Log("Failed to create device worker task (%d)", ret);
+        vQueueDelete(m_queue_attribute);
+        m_queue_attribute = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+void CSystem::request_system_info()
+{
+    if (!m_queue_attribute) {
+        print_system_info();
+        return;
+    }
+
+    matter_attribute_event_t event = matter_attribute_event_t();
+    event.request = eWorkerRequest::SystemInfo;
+    event.tm_queued = esp_timer_get_time();
+    // queue full: attribute changes come first, the dump is skipped
+    xQueueSend(m_queue_attribute, &event, 0);
+}
+
+void CSystem::request_toggle()
+{
+    if (!m_queue_attribute) {
+        toggle_device_state_action();
+        return;
+    }
+
+    matter_attribute_event_t event = matter_attribute_event_t();
+    event.request = eWorkerRequest::Toggle;
+    event.tm_queued = esp_timer_get_time();
+    // local control goes ahead of the pending attribute changes
+    if (xQueueSendToFront(m_queue_attribute, &event, 0) != pdTRUE) {
+        m_button_drop_count++;
+    }
+}
+
+void CSystem::func_device_worker(void *param)
+{
+    CSystem *obj = static_cast<CSystem *>(param);
+    matter_attribute_event_t event;
+    static matter_attribute_event_t overflow[DEVICE_ATTRIBUTE_OVERFLOW_MAX];
+    int64_t tm_staged = 0;  // first change of the pending commit (0 = nothing pending)
+    TickType_t wait_ticks = portMAX_DELAY;
+
+    auto handle_attribute = [&](matter_attribute_event_t *item) {
+        int64_t tm_begin = esp_timer_get_time();
+        m_queue_latency_histogram.add((uint32_t)(tm_begin - item->tm_queued));
+        matter_handle_attribute_event(item);
+        m_handle_histogram.add((uint32_t)(esp_timer_get_time() - tm_begin));
+        if (!tm_staged && item->device->has_staged_changes()) {
+            tm_staged = tm_begin;
+        }
+    };
+
+    /**
+     * changes of one interaction (ex: MoveToHueAndSaturation -> CurrentHue, CurrentSaturation)
+     * arrive back to back, handlers only stage the hardware work and the worker commits
+     * once the queue stays idle for DEVICE_COMMIT_WINDOW_MS
+     */
+    while (1) {
+        if (xQueueReceive(m_queue_attribute, &event, wait_ticks) == pdTRUE) {
+            switch (event.request) {
+            case eWorkerRequest::Attribute:
+                handle_attribute(&event);
+                break;
+            case eWorkerRequest::Toggle: {
+                int64_t tm_begin = esp_timer_get_time();
+                obj->toggle_device_state_action();
+                m_button_light_histogram.add((uint32_t)(esp_timer_get_time() - tm_begin));
+                m_button_press_histogram.add((uint32_t)(esp_timer_get_time() - event.tm_queued));
+                break;
+            }
+            case eWorkerRequest::SystemInfo:
+                obj->print_system_info();
+                break;
+            case eWorkerRequest::Overflow:
+                break;
+            }
+            // changes coalesced while the queue was full are newer than every queued one
+            if (!uxQueueMessagesWaiting(m_queue_attribute)) {
+                size_t count = matter_take_overflow_events(overflow);
+                for (size_t i = 0; i < count; i++) {
+                    handle_attribute(&overflow[i]);
+                }
+            }
+        } else if (tm_staged) {
+            // window expired without further change
+            obj->commit_staged_changes();
+            tm_staged = 0;
+        }
+
+        if (!tm_staged) {
+            wait_ticks = portMAX_DELAY;
+            continue;
+        }
+        int64_t elapsed_ms = (esp_timer_get_time() - tm_staged) / 1000;
+        if (elapsed_ms >= DEVICE_COMMIT_WINDOW_MAX_MS) {
+            obj->commit_staged_changes();
+            tm_staged = 0;
+            wait_ticks = portMAX_DELAY;
+        } else {
+            uint32_t window_ms = MIN(DEVICE_COMMIT_WINDOW_MS, DEVICE_COMMIT_WINDOW_MAX_MS - (uint32_t)elapsed_ms);
+            wait_ticks = MAX(pdMS_TO_TICKS(window_ms), 1);
+        }
+    }
+
+    vTaskDelete(nullptr);
+}
+
+void CSystem::commit_staged_changes()
+{
+    int64_t tm_begin = esp_timer_get_time();
+    // segments of several devices go out in one frame
+    GetWS2812Ctrl()->begin_frame();
+    for (auto &device : m_device_list) {
+        device->commit_staged_changes();
+    }
+    GetWS2812Ctrl()->end_frame();
+    m_commit_histogram.add((uint32_t)(esp_timer_get_time() - tm_begin));
+}
+
+bool CSystem::matter_is_attribute_value_copyable(const esp_matter_attr_val_t *val)
+{
+    // string, array values point to the buffer of esp_matter (valid during the callback only)
+    switch (val->type) {
+    case ESP_MATTER_VAL_TYPE_BOOLEAN:
+    case ESP_MATTER_VAL_TYPE_INTEGER:
+    case ESP_MATTER_VAL_TYPE_FLOAT:
+    case ESP_MATTER_VAL_TYPE_INT8:
+    case ESP_MATTER_VAL_TYPE_UINT8:
+    case ESP_MATTER_VAL_TYPE_INT16:
+    case ESP_MATTER_VAL_TYPE_UINT16:
+    case ESP_MATTER_VAL_TYPE_INT32:
+    case ESP_MATTER_VAL_TYPE_UINT32:
+    case ESP_MATTER_VAL_TYPE_INT64:
+    case ESP_MATTER_VAL_TYPE_UINT64:
+    case ESP_MATTER_VAL_TYPE_ENUM8:
+    case ESP_MATTER_VAL_TYPE_ENUM16:
+    case ESP_MATTER_VAL_TYPE_BITMAP8:
+    case ESP_MATTER_VAL_TYPE_BITMAP16:
+    case ESP_MATTER_VAL_TYPE_BITMAP32:
+    case ESP_MATTER_VAL_TYPE_NULLABLE_INTEGER:
+    case ESP_MATTER_VAL_TYPE_NULLABLE_FLOAT:
+    case ESP_MATTER_VAL_TYPE_NULLABLE_INT8:
+    case ESP_MATTER_VAL_TYPE_NULLABLE_UINT8:
+    case ESP_MATTER_VAL_TYPE_NULLABLE_INT16:
+    case ESP_MATTER_VAL_TYPE_NULLABLE_UINT16:
+    case ESP_MATTER_VAL_TYPE_NULLABLE_INT32:
+    case ESP_MATTER_VAL_TYPE_NULLABLE_UINT32:
+    case ESP_MATTER_VAL_TYPE_NULLABLE_INT64:
+    case ESP_MATTER_VAL_TYPE_NULLABLE_UINT64:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void CSystem::matter_handle_attribute_event(matter_attribute_event_t *event)
+{
+    event->device->matter_on_change_attribute_value(event->type, event->cluster_id, event->attribute_id, &event->value, event->echo_generation);
+}
+
+void CSystem::matter_post_attribute_event(const matter_attribute_event_t *event)
+{
+    portENTER_CRITICAL(&m_attribute_overflow_lock);
+    bool overflow = m_attribute_overflow_count > 0;
+    portEXIT_CRITICAL(&m_attribute_overflow_lock);
+    if (!overflow && xQueueSend(m_queue_attribute, event, 0) == pdTRUE) {
+        return;
+    }
+
+    // queue full: the latest value per attribute is kept (CHIP task never waits for the worker)
+    bool first = false;
+    portENTER_CRITICAL(&m_attribute_overflow_lock);
+    m_attribute_queue_full_count++;
+    size_t i = 0;
+    for (; i < m_attribute_overflow_count; i++) {
+        matter_attribute_event_t *item = &m_attribute_overflow[i];
+        if (item->device == event->device && item->cluster_id == event->cluster_id && item->attribute_id == event->attribute_id) {
+            break;
+        }
+    }
+    if (i < m_attribute_overflow_count) {
+        m_attribute_overflow[i] = *event;
+    } else if (m_attribute_overflow_count < DEVICE_ATTRIBUTE_OVERFLOW_MAX) {
+        first = m_attribute_overflow_count == 0;
+        m_attribute_overflow[m_attribute_overflow_count++] = *event;
+    } else {
+        m_attribute_drop_count++;
+    }
+    portEXIT_CRITICAL(&m_attribute_overflow_lock);
+
+    if (first) {
+        // worker may have emptied the queue in the meantime (queue full: the worker takes it after the queue anyway)
+        matter_attribute_event_t wakeup = matter_attribute_event_t();
+        wakeup.request = eWorkerRequest::Overflow;
+        xQueueSend(m_queue_attribute, &wakeup, 0);
+    }
+}
+
+size_t CSystem::matter_take_overflow_events(matter_attribute_event_t *events)
+{
+    portENTER_CRITICAL(&m_attribute_overflow_lock);
+    size_t count = m_attribute_overflow_count;
+    for (size_t i = 0; i < count; i++) {
+        events[i] = m_attribute_overflow[i];
+    }
+    m_attribute_overflow_count = 0;
+    portEXIT_CRITICAL(&m_attribute_overflow_lock);
+
+    return count;
+}
+
 /** 
 * matter cd info (vendor id, product id)
 * [reference]
@@ -285,7 +546,9 @@ void CSystem::print_system_info()
         GetLoggerM(eLogType::Info)->Log("Flash Size: %g MB (%s)", flash_size_mb, (chip_info.features & CHIP_FEATURE_EMB_FLASH) ? "embedded" : "external");
     }
     size_t heap_free_size = heap_caps_get_free_size(MALLOC_CAP_8BIT);
-    GetLoggerM(eLogType::Info)->Log("Heap Free Size: %d", heap_free_size);
+    GetLoggerM(eLogType::Info)->Log("Heap Free Size: %d", (int)heap_free_size);
+    // info dump is larger than a log ring buffer
+    CLogger::Instance()->flush();
 
     // network interface
     GetLoggerM(eLogType::Info)->Log("----- Network -----");
@@ -297,6 +560,7 @@ void CSystem::print_system_info()
     unsigned char mac[6] = {0};
     esp_read_mac(mac, ESP_MAC_WIFI_STA);
     GetLoggerM(eLogType::Info)->Log("MAC Address: %02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    CLogger::Instance()->flush();
 
     // matter related information
     GetLoggerM(eLogType::Info)->Log("----- Matter -----");
@@ -304,6 +568,34 @@ void CSystem::print_system_info()
     GetLoggerM(eLogType::Info)->Log("Product ID: 0x%04X", matter_get_product_id());
     // GetLoggerM(eLogType::Info)->Log("Setup Passcode: %d", matter_get_setup_passcode());
     GetLoggerM(eLogType::Info)->Log("Setup Discriminator: %d", matter_get_setup_discriminator());
+    CLogger::Instance()->flush();
+    m_callback_histogram.print("Attribute Callback (CHIP task)");
+    m_queue_latency_histogram.print("Attribute Queue Latency");
+    m_handle_histogram.print("Attribute Handler (worker)");
+    m_commit_histogram.print("Staged Commit (worker)");
+    GetLoggerM(eLogType::Info)->Log("Attribute Handled in Callback: %u, Queue Full (coalesced): %u, Dropped: %u", m_attribute_sync_count, m_attribute_queue_full_count, m_attribute_drop_count);
+    m_button_press_histogram.print("Button Press -> Light");
+    m_button_light_histogram.print("Button Toggle (worker)");
+    GetLoggerM(eLogType::Info)->Log("Button Press Dropped (queue full): %u", m_button_drop_count);
+    CLogger::Instance()->flush();
+
+    // device state
+    for (auto & dev : m_device_list) {
+        dev->print_state_info();
+        CLogger::Instance()->flush();
+    }
+
+    // led strip
+    GetWS2812Ctrl()->print_framebuffer_info();
+    CLogger::Instance()->flush();
+
+    // nvs write-behind
+    GetMemory()->print_memory_info();
+    CLogger::Instance()->flush();
+
+    // logger
+    CLogger::Instance()->print_logger_info();
+    CLogger::Instance()->flush();
 }
 
 void CSystem::print_matter_endpoints_info()
@@ -356,8 +648,73 @@ bool CSystem::matter_align_endpoint_id()
     return matter_set_min_endpoint_id(max_endpoint_id + 1);
 }
 
+bool CSystem::add_device(CDevice *device)
+{
+    m_device_list.push_back(device);
+    uint16_t endpoint_id = device->matter_get_endpoint_id();
+    if (endpoint_id < DEVICE_ENDPOINT_INDEX_SIZE) {
+        m_device_index[endpoint_id] = device;
+    }
+
+    return true;
+}
+
+bool CSystem::create_bridged_devices()
+{
+    int64_t tm_begin = esp_timer_get_time();
+
+    esp_matter::endpoint::aggregator::config_t config_aggregator;
+    m_endpoint_aggregator = esp_matter::endpoint::aggregator::create(m_root_node, &config_aggregator, esp_matter::ENDPOINT_FLAG_NONE, nullptr);
+    if (!m_endpoint_aggregator) {
+        GetLogger(eLogType::Error)->Log("Failed to create aggregator endpoint");
+        return false;
+    }
+    esp_err_t ret = esp_matter::endpoint::enable(m_endpoint_aggregator);
+    if (ret != ESP_OK) {
+        GetLogger(eLogType::Error)->Log("Failed to enable aggregator endpoint (ret: %d)", ret);
+        return false;
+    }
+
+    /**
+     * every bridged endpoint is created in one pass with the chip stack locked once
+     * (endpoint enable does not wait for the lock per endpoint, no attribute callback in between),
+     * segments are sent as one frame at the end
+     */
+    int created = 0;
+    m_device_list.reserve(BRIDGE_ENDPOINT_COUNT);
+    // brightness of each segment is rendered into the pixel color
+    GetWS2812Ctrl()->set_brightness(255, false);
+    GetWS2812Ctrl()->begin_frame();
+    esp_matter::lock::status_t lock_status = esp_matter::lock::chip_stack_lock(portMAX_DELAY);
+    for (int i = 0; i < BRIDGE_ENDPOINT_COUNT; i++) {
+        int pixel_start = i * WS2812_ARRAY_COUNT / BRIDGE_ENDPOINT_COUNT;
+        int pixel_end = (i + 1) * WS2812_ARRAY_COUNT / BRIDGE_ENDPOINT_COUNT;
+        CDevice *dev = new CDeviceBridgedLight(m_endpoint_aggregator, pixel_start, pixel_end - pixel_start);
+        if (!dev->matter_add_endpoint()) {
+            delete dev;
+            continue;
+        }
+        add_device(dev);
+        created++;
+    }
+    if (lock_status == esp_matter::lock::SUCCESS) {
+        esp_matter::lock::chip_stack_unlock();
+    }
+    GetWS2812Ctrl()->end_frame();
+
+    GetLogger(eLogType::Info)->Log("Bridged endpoints: %d/%d created in %d ms (aggregator endpoint %u)", 
+        created, BRIDGE_ENDPOINT_COUNT, (int)((esp_timer_get_time() - tm_begin) / 1000), esp_matter::endpoint::get_id(m_endpoint_aggregator));
+
+    return created > 0;
+}
+
 CDevice* CSystem::find_device_by_endpoint_id(uint16_t endpoint_id)
 {
+    // endpoint ids start from 1 at every boot (matter_set_min_endpoint_id), dense table covers them
+    if (endpoint_id < DEVICE_ENDPOINT_INDEX_SIZE) {
+        return m_device_index[endpoint_id];
+    }
+
     for (auto & dev : m_device_list) {
         if (dev->matter_get_endpoint_id() == endpoint_id) {
             return dev;
@@ -369,9 +726,11 @@ CDevice* CSystem::find_device_by_endpoint_id(uint16_t endpoint_id)
 
 void CSystem::toggle_device_state_action()
 {
+    GetWS2812Ctrl()->begin_frame();
     for (auto & dev : m_device_list) {
         dev->toggle_state_action();
     }
+    GetWS2812Ctrl()->end_frame();
 }
 
 void CSystem::matter_event_callback(const ChipDeviceEvent *event, intptr_t arg)
@@ -407,6 +766,10 @@ void CSystem::matter_event_callback(const ChipDeviceEvent *event, intptr_t arg)
     case chip::DeviceLayer::DeviceEventType::kCommissioningWindowClosed:
         GetLogger(eLogType::Info)->Log("Commissioning window closed");
         break;
+    case chip::DeviceLayer::DeviceEventType::kOtaStateChanged:
+        // new image may be applied (reboot) soon, write pending data
+        GetMemory()->flush();
+        break;
     default:
         break;
     }
@@ -438,10 +801,42 @@ esp_err_t CSystem::matter_attribute_update_callback(esp_matter::attribute::callb
     GetLogger(eLogType::Info)->Log("attribute update callback > type: %d, endpoint_id: %d, cluster_id: 0x%04X(%s), attribute_id: 0x%04X(%s)", 
         type, endpoint_id, cluster_id, get_matter_cluster_name(cluster_id), attribute_id, get_matter_attribute_name(cluster_id, attribute_id));
     */
+    /**
+     * CHIP task only validates and copies the change (device handlers run in device worker task),
+     * devices handle PRE_UPDATE only
+     */
+    if (type != esp_matter::attribute::callback_type_t::PRE_UPDATE) {
+        return ESP_OK;
+    }
+
+    int64_t tm_begin = esp_timer_get_time();
+
     CDevice *device = GetSystem()->find_device_by_endpoint_id(endpoint_id);
-    if (device){
-        device->matter_on_change_attribute_value(type, cluster_id, attribute_id, val);
+    if (device) {
+        matter_attribute_event_t event;
+        event.request = eWorkerRequest::Attribute;
+        event.device = device;
+        event.type = type;
+        event.cluster_id = cluster_id;
+        event.attribute_id = attribute_id;
+        event.value = *val;
+        // echo is recognized here, in the task writing the attribute
+        event.echo_generation = device->matter_get_echo_generation(cluster_id, attribute_id);
+        event.tm_queued = tm_begin;
+        if (!matter_is_attribute_value_copyable(val)) {
+            // device state holds scalar values only, the pointer is valid during the callback only
+            event.value = esp_matter_invalid(NULL);
+        }
+        if (!m_queue_attribute) {
+            matter_handle_attribute_event(&event);
+            device->commit_staged_changes();
+            m_attribute_sync_count++;
+        } else {
+            matter_post_attribute_event(&event);
+        }
     }
+
+    m_callback_histogram.add((uint32_t)(esp_timer_get_time() - tm_begin));
     
     return ESP_OK;
 }
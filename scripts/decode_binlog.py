@@ -0,0 +1,209 @@
+#!/usr/bin/env python3
+# decode_binlog.py
+# purpose: decode binary log frames (LOG_OUTPUT_FORMAT = 1) with the application ELF file
+# usage:
+#   python3 decode_binlog.py build/matter-esp32-ws2812.elf capture.bin
+#   python3 decode_binlog.py build/matter-esp32-ws2812.elf --port /dev/ttyUSB0 [--baud 115200]
+# requires: pyelftools (pyserial for --port)
+#
+# frame (main/include/system/logger.h):
+#   [0xA5][0x5A][length][site (4)][format (4)][timestamp_ms (4)][arguments...][checksum]
+# arguments (main/include/system/log_format.h):
+#   'i' int32 (4), 'I' int64 (8), 'd' double (8), 's' [length][bytes], 'p' pointer (4), 't' truncated
+# log_site_info_t (32-bit target):
+#   funcname (4), funcname_length (2), module_length (2), filename (4), fileline (4), type (1)
+# bytes outside of frames (ROM/IDF/CHIP text logs) are passed through
+
+import argparse
+import re
+import struct
+import sys
+
+from elftools.elf.elffile import ELFFile
+
+FRAME_SYNC = b'\xA5\x5A'
+SITE_STRUCT = struct.Struct('<IHHIIB')
+LOG_TYPES = {0: 'I', 1: 'W', 2: 'E', 3: 'D', 4: 'E'}
+SPEC_PATTERN = re.compile(r'%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d+))?[hlLqjzt]*([diuxXocfFeEgGaAsp%])')
+
+
+class ElfMemory:
+    def __init__(self, path):
+        self._file = open(path, 'rb')
+        elf = ELFFile(self._file)
+        self._sections = []
+        for section in elf.iter_sections():
+            if section['sh_addr'] and section['sh_type'] != 'SHT_NOBITS':
+                self._sections.append((section['sh_addr'], section['sh_size'], section.data()))
+        self._strings = {}
+        self._sites = {}
+
+    def read(self, address, size):
+        for base, length, data in self._sections:
+            if base <= address and address + size <= base + length:
+                return data[address - base:address - base + size]
+        return None
+
+    def string(self, address):
+        if address not in self._strings:
+            text = None
+            for base, length, data in self._sections:
+                if base <= address < base + length:
+                    end = data.find(b'\0', address - base)
+                    text = data[address - base:end if end >= 0 else length].decode('utf-8', 'replace')
+                    break
+            self._strings[address] = text
+        return self._strings[address]
+
+    def site(self, address):
+        if address not in self._sites:
+            raw = self.read(address, SITE_STRUCT.size)
+            site = None
+            if raw:
+                funcname, funcname_length, _, filename, fileline, log_type = SITE_STRUCT.unpack(raw)
+                func = self.string(funcname) or '?'
+                site = (func[:funcname_length], self.string(filename) or '?', fileline, log_type)
+            self._sites[address] = site
+        return self._sites[address]
+
+
+def decode_args(data):
+    args = []
+    pos = 0
+    while pos < len(data):
+        tag = chr(data[pos])
+        pos += 1
+        if tag in 'ip':
+            args.append((tag, struct.unpack_from('<i', data, pos)[0]))
+            pos += 4
+        elif tag == 'I':
+            args.append((tag, struct.unpack_from('<q', data, pos)[0]))
+            pos += 8
+        elif tag == 'd':
+            args.append((tag, struct.unpack_from('<d', data, pos)[0]))
+            pos += 8
+        elif tag == 's':
+            length = data[pos]
+            args.append((tag, data[pos + 1:pos + 1 + length].decode('utf-8', 'replace')))
+            pos += 1 + length
+        else:
+            break
+    return args
+
+
+def render(fmt, args):
+    """same rule as log_render(): length modifier follows the stored argument type"""
+    args = list(args)
+
+    def next_value():
+        return args.pop(0) if args else (None, None)
+
+    def replace(match):
+        flags, width, precision, conversion = match.groups()
+        if conversion == '%':
+            return '%'
+        if width == '*':
+            width = str(next_value()[1] or 0)
+        if precision == '*':
+            precision = str(next_value()[1] or 0)
+        tag, value = next_value()
+        if tag is None:
+            return '<?>'
+        spec = '%' + flags + (width or '') + ('.' + precision if precision is not None else '')
+        try:
+            if conversion in 'diuxXoc':
+                value = int(value) if tag != 's' else 0
+                if conversion in 'uxXo' and tag in 'ip':
+                    value &= 0xFFFFFFFF
+                if conversion == 'c':
+                    return chr(value & 0xFF)
+                return (spec + ('d' if conversion in 'iu' else conversion)) % value
+            if conversion in 'fFeEgG':
+                return (spec + conversion) % float(value if tag != 's' else 0)
+            if conversion in 'aA':
+                return float(value).hex()
+            if conversion == 's':
+                return (spec + 's') % (value if tag == 's' else '')
+            if conversion == 'p':
+                return '0x%08x' % (int(value) & 0xFFFFFFFF)
+        except (TypeError, ValueError):
+            pass
+        return '<%s?>' % conversion
+
+    return SPEC_PATTERN.sub(replace, fmt)
+
+
+def decode_frame(elf, body):
+    site_address, format_address, timestamp = struct.unpack_from('<III', body, 0)
+    fmt = elf.string(format_address)
+    if fmt is None:
+        return 'E (%u) logger: <unknown format 0x%08x>' % (timestamp, format_address)
+    text = render(fmt, decode_args(body[12:]))
+    site = elf.site(site_address)
+    if site is None:
+        return 'I (%u) logger: %s' % (timestamp, text)
+    funcname, filename, fileline, log_type = site
+    if funcname:
+        text = '[%s] %s [%s:%u]' % (funcname, text, filename, fileline)
+    return '%s (%u) logger: %s' % (LOG_TYPES.get(log_type, 'I'), timestamp, text)
+
+
+def decode_stream(elf, read, write):
+    buffer = b''
+    while True:
+        chunk = read()
+        if chunk is None:
+            break
+        buffer += chunk
+        while True:
+            index = buffer.find(FRAME_SYNC)
+            if index < 0:
+                # keep a possible partial sync byte
+                keep = 1 if buffer.endswith(FRAME_SYNC[:1]) else 0
+                write(buffer[:len(buffer) - keep].decode('utf-8', 'replace'))
+                buffer = buffer[len(buffer) - keep:]
+                break
+            if index:
+                write(buffer[:index].decode('utf-8', 'replace'))
+                buffer = buffer[index:]
+            if len(buffer) < 3 or len(buffer) < 4 + buffer[2]:
+                break   # incomplete frame
+            length = buffer[2]
+            checksum = sum(buffer[2:3 + length]) & 0xFF
+            if length < 12 or checksum != buffer[3 + length]:
+                # not a frame (or corrupted): pass the sync byte through and resync
+                write(buffer[:1].decode('utf-8', 'replace'))
+                buffer = buffer[1:]
+                continue
+            write(decode_frame(elf, buffer[3:3 + length]) + '\n')
+            buffer = buffer[4 + length:]
+
+
+def main():
+    parser = argparse.ArgumentParser(description='decode binary log frames')
+    parser.add_argument('elf', help='application ELF file')
+    parser.add_argument('input', nargs='?', help='captured binary log (default: stdin)')
+    parser.add_argument('--port', help='serial port')
+    parser.add_argument('--baud', type=int, default=115200)
+    args = parser.parse_args()
+
+    elf = ElfMemory(args.elf)
+
+    def write(text):
+        sys.stdout.write(text)
+        sys.stdout.flush()
+
+    if args.port:
+        import serial
+        with serial.Serial(args.port, args.baud, timeout=0.1) as port:
+            # read timeout returns empty bytes, stream never ends
+            decode_stream(elf, lambda: port.read(256), write)
+    elif args.input:
+        with open(args.input, 'rb') as fp:
+            decode_stream(elf, lambda: fp.read(4096) or None, write)
+    else:
+        decode_stream(elf, lambda: sys.stdin.buffer.read1(4096) or None, write)
+
+
+if __name__ == '__main__':
+    main()
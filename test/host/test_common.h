@@ -0,0 +1,48 @@
+#ifndef _TEST_COMMON_H_
+#define _TEST_COMMON_H_
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @brief minimal assertion helpers (no test framework dependency)
+ * failed check is printed and counted, main() returns TEST_RESULT()
+ */
+static int g_test_failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+        g_test_failures++; \
+    } \
+} while (0)
+
+#define CHECK_EQ(a, b) do { \
+    long long _a = (long long)(a), _b = (long long)(b); \
+    if (_a != _b) { \
+        printf("%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", __FILE__, __LINE__, #a, #b, _a, _b); \
+        g_test_failures++; \
+    } \
+} while (0)
+
+static inline void check_str(const char *a, const char *b, const char *expr_a, const char *expr_b, const char *file, int line)
+{
+    if (strcmp(a, b) != 0) {
+        printf("%s:%d: CHECK_STR(%s, %s) failed: \"%s\" != \"%s\"\n", file, line, expr_a, expr_b, a, b);
+        g_test_failures++;
+    }
+}
+
+// temporaries of the arguments (ex: std::string::c_str()) live until check_str returns
+#define CHECK_STR(a, b) check_str((a), (b), #a, #b, __FILE__, __LINE__)
+
+#define RUN_TEST(func) do { \
+    int _before = g_test_failures; \
+    func(); \
+    printf("[%s] %s\n", g_test_failures == _before ? "PASS" : "FAIL", #func); \
+} while (0)
+
+#define TEST_RESULT() (g_test_failures ? 1 : 0)
+
+#endif
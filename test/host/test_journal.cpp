@@ -0,0 +1,310 @@
+#include "test_common.h"
+#include "journal.h"
+#include "logger.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#define IMAGE_PATH      "test_journal.bin"
+#define SECTOR_SIZE     512
+#define SECTOR_COUNT    4
+#define STATE_SIZE      24
+#define APPEND_COUNT    160
+
+typedef std::vector<uint8_t> state_t;
+
+/**
+ * @brief append sequence: single byte changes, scattered changes (delta merge), full rewrite (snapshot)
+ * and one state size change (forced compaction)
+ */
+static std::vector<state_t> make_states()
+{
+    std::vector<state_t> states;
+    state_t state(STATE_SIZE, 0);
+    for (int i = 0; i < APPEND_COUNT; i++) {
+        if (i % 17 == 16) {
+            for (size_t j = 0; j < state.size(); j++) {
+                state[j] = (uint8_t)(i * 31 + j);
+            }
+        } else if (i % 5 == 4) {
+            state[i % state.size()] ^= 0x5A;
+            state[(i * 7 + 3) % state.size()] += 1;
+            state[(i * 13 + 1) % state.size()] -= 1;
+        } else {
+            state[i % state.size()] = (uint8_t)i;
+        }
+        if (i == APPEND_COUNT / 2) {
+            state.push_back((uint8_t)i);
+        }
+        states.push_back(state);
+    }
+    return states;
+}
+
+static void new_image()
+{
+    remove(IMAGE_PATH);
+}
+
+static bool open_journal(CJournalFlashFile *flash, CStateJournal *journal)
+{
+    if (!flash->initialize(IMAGE_PATH, SECTOR_SIZE * SECTOR_COUNT, SECTOR_SIZE)) {
+        return false;
+    }
+    return journal->initialize(flash);
+}
+
+static bool load_state(CStateJournal *journal, state_t *state)
+{
+    uint8_t buffer[JOURNAL_MAX_STATE_SIZE];
+    size_t read_size = 0;
+    if (!journal->load(buffer, sizeof(buffer), &read_size)) {
+        return false;
+    }
+    state->assign(buffer, buffer + read_size);
+    return true;
+}
+
+static void test_empty()
+{
+    new_image();
+    CJournalFlashFile flash;
+    CStateJournal journal;
+    CHECK(open_journal(&flash, &journal));
+    CHECK(!journal.has_state());
+    state_t state;
+    CHECK(!load_state(&journal, &state));
+
+    // compaction needs a spare sector
+    CJournalFlashFile small;
+    CStateJournal journal_small;
+    remove("test_journal_small.bin");
+    CHECK(small.initialize("test_journal_small.bin", SECTOR_SIZE, SECTOR_SIZE));
+    CHECK(!journal_small.initialize(&small));
+    CHECK(!journal_small.append("x", 1));
+    remove("test_journal_small.bin");
+}
+
+static void test_replay()
+{
+    std::vector<state_t> states = make_states();
+    new_image();
+    {
+        CJournalFlashFile flash;
+        CStateJournal journal;
+        CHECK(open_journal(&flash, &journal));
+        for (size_t i = 0; i < states.size(); i++) {
+            CHECK(journal.append(states[i].data(), states[i].size()));
+            // unchanged state is not written
+            CHECK(journal.append(states[i].data(), states[i].size()));
+
+            // every intermediate state is replayed by a fresh instance (sector wrap included)
+            if (i % 7 == 0) {
+                CJournalFlashFile flash_reopen;
+                CStateJournal journal_reopen;
+                state_t state;
+                CHECK(open_journal(&flash_reopen, &journal_reopen));
+                CHECK(load_state(&journal_reopen, &state));
+                CHECK(state == states[i]);
+            }
+        }
+        CHECK(!journal.append(states[0].data(), JOURNAL_MAX_STATE_SIZE + 1));
+    }
+
+    CJournalFlashFile flash;
+    CStateJournal journal;
+    state_t state;
+    CHECK(open_journal(&flash, &journal));
+    CHECK(load_state(&journal, &state));
+    CHECK(state == states.back());
+
+    // output buffer too small
+    uint8_t small[4];
+    size_t read_size;
+    CHECK(!journal.load(small, sizeof(small), &read_size));
+}
+
+static void test_corrupted_record()
+{
+    std::vector<state_t> states = make_states();
+    new_image();
+    {
+        CJournalFlashFile flash;
+        CStateJournal journal;
+        CHECK(open_journal(&flash, &journal));
+        for (int i = 0; i < 4; i++) {
+            CHECK(journal.append(states[i].data(), states[i].size()));
+        }
+    }
+
+    // clear bits in the payload of the last record (crc mismatch)
+    FILE *fp = fopen(IMAGE_PATH, "r+b");
+    CHECK(fp != nullptr);
+    std::vector<uint8_t> image(SECTOR_SIZE);
+    CHECK(fread(image.data(), 1, image.size(), fp) == image.size());
+    size_t last = 0;
+    for (size_t offset = sizeof(journal_sector_header_t); offset + sizeof(journal_record_header_t) <= SECTOR_SIZE;) {
+        journal_record_header_t header;
+        memcpy(&header, &image[offset], sizeof(header));
+        if (header.type == 0xFF) {
+            break;
+        }
+        last = offset;
+        offset += sizeof(header) + ((header.length + 3) & ~3);
+    }
+    CHECK(last > sizeof(journal_sector_header_t));
+    image[last + sizeof(journal_record_header_t)] &= 0x7F;
+    image[last + sizeof(journal_record_header_t) + 1] &= 0xFE;
+    fseek(fp, 0, SEEK_SET);
+    CHECK(fwrite(image.data(), 1, image.size(), fp) == image.size());
+    fclose(fp);
+
+    // torn record is dropped, dirty tail moves the journal to a clean sector
+    {
+        CJournalFlashFile flash;
+        CStateJournal journal;
+        state_t state;
+        CHECK(open_journal(&flash, &journal));
+        CHECK(load_state(&journal, &state));
+        CHECK(state == states[2]);
+        CHECK(journal.append(states[5].data(), states[5].size()));
+    }
+    CJournalFlashFile flash;
+    CStateJournal journal;
+    state_t state;
+    CHECK(open_journal(&flash, &journal));
+    CHECK(load_state(&journal, &state));
+    CHECK(state == states[5]);
+}
+
+/**
+ * @brief write failure (flash error, not power loss) at every byte offset, then the same state is appended again
+ * - failed append must not be taken as written: retry reaches the flash (delta, snapshot, compaction)
+ */
+static void test_write_failure_retry()
+{
+    std::vector<state_t> states = make_states();
+    states.resize(APPEND_COUNT / 3);    // one compaction at least
+    bool completed = false;
+
+    for (size_t cut = 0; !completed; cut++) {
+        new_image();
+        CJournalFlashFile flash;
+        CStateJournal journal;
+        if (!open_journal(&flash, &journal)) {
+            CHECK(false);
+            break;
+        }
+        flash.set_write_limit(cut);
+        size_t failed = states.size();
+        for (size_t i = 0; i < states.size(); i++) {
+            if (!journal.append(states[i].data(), states[i].size())) {
+                failed = i;
+                break;
+            }
+        }
+        if (failed == states.size()) {
+            completed = true;
+            continue;
+        }
+
+        // flash works again: retry of the same state
+        flash.set_write_limit((size_t)-1);
+        CHECK(journal.append(states[failed].data(), states[failed].size()));
+
+        CJournalFlashFile flash_reopen;
+        CStateJournal journal_reopen;
+        state_t state;
+        CHECK(open_journal(&flash_reopen, &journal_reopen));
+        CHECK(load_state(&journal_reopen, &state));
+        if (state != states[failed]) {
+            printf("cut at %d bytes: retried state not on flash (failed: %d)\n", (int)cut, (int)failed);
+            CHECK(false);
+            break;
+        }
+    }
+}
+
+/**
+ * @brief power loss at every byte offset of the append sequence
+ * - recovered state is the last acknowledged one, or the one in flight if it reached the flash completely
+ * - journal keeps working after recovery (torn tail, half written sector)
+ */
+static void test_power_loss()
+{
+    std::vector<state_t> states = make_states();
+    int runs = 0;
+    bool completed = false;
+
+    for (size_t cut = 0; !completed; cut++) {
+        new_image();
+        int acknowledged = -1;
+        {
+            CJournalFlashFile flash;
+            CStateJournal journal;
+            if (!open_journal(&flash, &journal)) {
+                CHECK(false);
+                break;
+            }
+            flash.set_write_limit(cut);
+            completed = true;
+            for (size_t i = 0; i < states.size(); i++) {
+                if (!journal.append(states[i].data(), states[i].size())) {
+                    completed = false;
+                    break;
+                }
+                acknowledged = (int)i;
+            }
+        }
+        runs++;
+
+        CJournalFlashFile flash;
+        CStateJournal journal;
+        state_t state;
+        CHECK(open_journal(&flash, &journal));
+        if (load_state(&journal, &state)) {
+            bool last = acknowledged >= 0 && state == states[acknowledged];
+            bool in_flight = acknowledged + 1 < (int)states.size() && state == states[acknowledged + 1];
+            if (!last && !in_flight) {
+                printf("cut at %d bytes: unexpected state (acknowledged: %d)\n", (int)cut, acknowledged);
+                CHECK(false);
+                break;
+            }
+        } else if (acknowledged >= 0) {
+            printf("cut at %d bytes: state lost (acknowledged: %d)\n", (int)cut, acknowledged);
+            CHECK(false);
+            break;
+        }
+
+        // recovered journal accepts new states
+        const state_t &next = states[(acknowledged + 2) % states.size()];
+        CHECK(journal.append(next.data(), next.size()));
+        CJournalFlashFile flash_reopen;
+        CStateJournal journal_reopen;
+        CHECK(open_journal(&flash_reopen, &journal_reopen));
+        CHECK(load_state(&journal_reopen, &state));
+        CHECK(state == next);
+        if (g_test_failures) {
+            printf("cut at %d bytes: journal not usable after recovery\n", (int)cut);
+            break;
+        }
+    }
+
+    printf("power loss simulated at %d offsets\n", runs);
+    CHECK(runs > SECTOR_SIZE * 2);
+}
+
+int main()
+{
+    // replay / compaction messages of thousands of runs
+    CLogger::Instance()->set_level(eLogType::Error);
+
+    RUN_TEST(test_empty);
+    RUN_TEST(test_replay);
+    RUN_TEST(test_corrupted_record);
+    RUN_TEST(test_write_failure_retry);
+    RUN_TEST(test_power_loss);
+
+    remove(IMAGE_PATH);
+    return TEST_RESULT();
+}
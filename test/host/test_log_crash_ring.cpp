@@ -0,0 +1,228 @@
+#include "test_common.h"
+#include "log_crash_ring.h"
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#define APP_ID      0x1234ABCD
+
+/**
+ * @brief memory that survives the reset (RTC_NOINIT on target), data area = 256 bytes
+ */
+static uint32_t s_memory[(sizeof(log_crash_ring_header_t) + 256 + 20) / sizeof(uint32_t)];
+
+static log_crash_ring_header_t *header()
+{
+    return (log_crash_ring_header_t *)s_memory;
+}
+
+static void power_on()
+{
+    // uninitialized memory after power on
+    for (size_t i = 0; i < sizeof(s_memory); i++) {
+        ((uint8_t *)s_memory)[i] = (uint8_t)(i * 37 + 11);
+    }
+}
+
+static bool append_text(CLogCrashRing *ring, const std::string &prefix, const std::string &text)
+{
+    return ring->append(prefix.data(), prefix.size(), text.data(), text.size());
+}
+
+static std::vector<std::string> read_all(CLogCrashRing *ring, uint32_t end)
+{
+    std::vector<std::string> records;
+    uint32_t cursor = ring->get_tail();
+    char buffer[256];
+    int length;
+    while ((length = ring->read(&cursor, end, buffer, sizeof(buffer))) >= 0) {
+        records.push_back(std::string(buffer, length));
+    }
+    return records;
+}
+
+static void test_attach()
+{
+    power_on();
+    CLogCrashRing ring;
+    CHECK(!ring.attach(s_memory, sizeof(s_memory), APP_ID));
+    CHECK_EQ(ring.get_size(), 256);     // rounded down to power of 2
+    CHECK_EQ(ring.get_head(), 0);
+    CHECK_EQ(ring.get_tail(), 0);
+    CHECK(read_all(&ring, ring.get_head()).empty());
+
+    CHECK(append_text(&ring, "a", "bc"));
+    CHECK(append_text(&ring, "", "def"));
+
+    // software reset: records of the previous boot are kept
+    CLogCrashRing reset;
+    CHECK(reset.attach(s_memory, sizeof(s_memory), APP_ID));
+    std::vector<std::string> records = read_all(&reset, reset.get_head());
+    CHECK_EQ(records.size(), 2);
+    CHECK(records.size() == 2 && records[0] == "abc" && records[1] == "def");
+
+    // firmware change: addresses in the records are meaningless
+    CLogCrashRing updated;
+    CHECK(!updated.attach(s_memory, sizeof(s_memory), APP_ID + 1));
+    CHECK(read_all(&updated, updated.get_head()).empty());
+
+    // too small
+    CLogCrashRing small;
+    CHECK(!small.attach(s_memory, sizeof(log_crash_ring_header_t) + 63, APP_ID));
+    CHECK(!small.append("x", 1, nullptr, 0));
+    uint32_t cursor = 0;
+    char buffer[4];
+    CHECK_EQ(small.read(&cursor, 4, buffer, sizeof(buffer)), -1);
+}
+
+static void test_append_read()
+{
+    power_on();
+    CLogCrashRing ring;
+    ring.attach(s_memory, sizeof(s_memory), APP_ID);
+
+    uint32_t value = 0xDEADBEEF;
+    CHECK(ring.append(&value, sizeof(value), "xyz", 3));
+    CHECK(ring.append(nullptr, 0, nullptr, 0));     // empty record
+    CHECK_EQ(ring.get_head(), 12 + 4);              // 4 bytes aligned records
+
+    uint32_t cursor = ring.get_tail();
+    uint8_t buffer[16];
+    CHECK_EQ(ring.read(&cursor, ring.get_head(), buffer, sizeof(buffer)), 7);
+    CHECK(memcmp(buffer, &value, 4) == 0 && memcmp(buffer + 4, "xyz", 3) == 0);
+    CHECK_EQ(ring.read(&cursor, ring.get_head(), buffer, sizeof(buffer)), 0);
+    CHECK_EQ(ring.read(&cursor, ring.get_head(), buffer, sizeof(buffer)), -1);
+    CHECK_EQ(cursor, ring.get_head());
+
+    // output buffer too small: record is not consumed
+    cursor = ring.get_tail();
+    CHECK_EQ(ring.read(&cursor, ring.get_head(), buffer, 6), -1);
+    CHECK_EQ(cursor, ring.get_tail());
+
+    // end stops before head
+    cursor = ring.get_tail();
+    CHECK_EQ(ring.read(&cursor, 12, buffer, sizeof(buffer)), 7);
+    CHECK_EQ(ring.read(&cursor, 12, buffer, sizeof(buffer)), -1);
+
+    // record larger than the data area
+    std::string huge(ring.get_size(), 'h');
+    CHECK(!append_text(&ring, "", huge));
+    CHECK_EQ(ring.get_head(), 16);
+
+    // discard up to end
+    ring.discard(12);
+    CHECK_EQ(ring.get_tail(), 12);
+    ring.discard(100);      // beyond head: ignored
+    CHECK_EQ(ring.get_tail(), 12);
+    CHECK_EQ(read_all(&ring, ring.get_head()).size(), 1);
+}
+
+static void test_wrap()
+{
+    power_on();
+    CLogCrashRing ring;
+    ring.attach(s_memory, sizeof(s_memory), APP_ID);
+
+    // records of different sizes cross the end of the data area many times
+    std::vector<std::string> appended;
+    for (int i = 0; i < 200; i++) {
+        std::string text = "record " + std::to_string(i) + std::string(i % 23, '.');
+        CHECK(append_text(&ring, "#", text));
+        appended.push_back("#" + text);
+        CHECK(ring.get_head() - ring.get_tail() <= ring.get_size());
+    }
+    CHECK(ring.get_head() > 4 * ring.get_size());
+
+    // newest records survive in order, oldest were overwritten
+    std::vector<std::string> records = read_all(&ring, ring.get_head());
+    CHECK(records.size() > 4);
+    CHECK(records.size() < appended.size());
+    bool match = true;
+    for (size_t i = 0; i < records.size(); i++) {
+        match &= records[i] == appended[appended.size() - records.size() + i];
+    }
+    CHECK(match);
+
+    // wrapped ring is still valid after reset
+    CLogCrashRing reset;
+    CHECK(reset.attach(s_memory, sizeof(s_memory), APP_ID));
+    CHECK(read_all(&reset, reset.get_head()) == records);
+
+    // cursor overtaken by the writer restarts at tail
+    uint32_t cursor = ring.get_tail();
+    for (int i = 0; i < 40; i++) {
+        append_text(&ring, "", "overwrite");
+    }
+    char buffer[64];
+    CHECK_EQ(ring.read(&cursor, ring.get_head(), buffer, sizeof(buffer)), 9);
+    CHECK_EQ(cursor, ring.get_tail() + 16);
+}
+
+static void test_torn_record()
+{
+    power_on();
+    CLogCrashRing ring;
+    ring.attach(s_memory, sizeof(s_memory), APP_ID);
+    append_text(&ring, "", "first");
+    append_text(&ring, "", "second");
+
+    // reset during append: data is written, head is not advanced yet
+    uint32_t head = header()->head;
+    append_text(&ring, "", "in flight");
+    header()->head = head;
+
+    CLogCrashRing reset;
+    CHECK(reset.attach(s_memory, sizeof(s_memory), APP_ID));
+    std::vector<std::string> records = read_all(&reset, reset.get_head());
+    CHECK(records.size() == 2 && records[0] == "first" && records[1] == "second");
+
+    // head doesn't chain with the record lengths (corrupted counter): ring is reset
+    header()->head = head + 4;
+    CLogCrashRing broken;
+    CHECK(!broken.attach(s_memory, sizeof(s_memory), APP_ID));
+    CHECK(read_all(&broken, broken.get_head()).empty());
+
+    // unaligned / oversized counters
+    append_text(&broken, "", "x");
+    header()->tail = 2;
+    CHECK(!CLogCrashRing().attach(s_memory, sizeof(s_memory), APP_ID));
+    append_text(&broken, "", "x");
+    header()->head = header()->tail + 512;
+    CHECK(!CLogCrashRing().attach(s_memory, sizeof(s_memory), APP_ID));
+}
+
+static void test_bad_crc()
+{
+    power_on();
+    CLogCrashRing ring;
+    ring.attach(s_memory, sizeof(s_memory), APP_ID);
+    append_text(&ring, "", "kept");
+
+    // header crc mismatch: ring is reset
+    CHECK(CLogCrashRing().attach(s_memory, sizeof(s_memory), APP_ID));
+    header()->crc ^= 1;
+    CLogCrashRing reset;
+    CHECK(!reset.attach(s_memory, sizeof(s_memory), APP_ID));
+    CHECK(read_all(&reset, reset.get_head()).empty());
+
+    // record checksum mismatch: reading stops at the damaged record
+    append_text(&reset, "", "good");
+    append_text(&reset, "", "damaged");
+    append_text(&reset, "", "after");
+    uint8_t *data = (uint8_t *)s_memory + sizeof(log_crash_ring_header_t);
+    data[8 + 4] ^= 0x20;
+    std::vector<std::string> records = read_all(&reset, reset.get_head());
+    CHECK(records.size() == 1 && records[0] == "good");
+}
+
+int main()
+{
+    RUN_TEST(test_attach);
+    RUN_TEST(test_append_read);
+    RUN_TEST(test_wrap);
+    RUN_TEST(test_torn_record);
+    RUN_TEST(test_bad_crc);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,232 @@
+#include "test_common.h"
+#include "log_format.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * @brief 인자를 encode해서 log_render로 다시 문자열을 만든다 (CLogContext::Log, logger drain task와 같은 경로)
+ */
+static std::string render(const char *format, ...) __attribute__((format(printf, 1, 2)));
+static std::string render(const char *format, ...)
+{
+    uint8_t buffer[MAXLEN_LOG_ARGS];
+    va_list args;
+    va_start(args, format);
+    size_t size = log_encode_args(format, args, buffer, sizeof(buffer));
+    va_end(args);
+
+    char out[256];
+    log_render(format, buffer, size, out, sizeof(out));
+    return out;
+}
+
+/**
+ * @brief 포맷과 다른 타입으로 인코딩된 인자 (renderer는 저장된 타입을 따른다)
+ */
+template<typename... Args>
+static std::string render_encoded(const char *format, Args... args)
+{
+    uint8_t buffer[MAXLEN_LOG_ARGS];
+    CLogArgEncoder encoder(buffer, sizeof(buffer));
+    (encoder.add(args), ...);
+
+    char out[256];
+    log_render(format, buffer, encoder.size(), out, sizeof(out));
+    return out;
+}
+
+static void test_int32()
+{
+    CHECK_STR(render("%d", 0).c_str(), "0");
+    CHECK_STR(render("%d %i", INT32_MIN, INT32_MAX).c_str(), "-2147483648 2147483647");
+    CHECK_STR(render("%u 0x%08X", (uint32_t)0xFFFFFFFF, (uint32_t)0xBEEF).c_str(), "4294967295 0x0000BEEF");
+    CHECK_STR(render("%5d|%-5d|%05d", 42, 42, -42).c_str(), "   42|42   |-0042");
+    CHECK_STR(render("%c%c", 'o', 'k').c_str(), "ok");
+    CHECK_STR(render("%d %d", (int8_t)-1, (uint16_t)65535).c_str(), "-1 65535");
+    CHECK_STR(render("%d", true).c_str(), "1");
+    // argument size follows the length modifier
+    CHECK_STR(render("%zu %ld %hhu %jd", (size_t)4000000000U, -5L, (unsigned char)200, (intmax_t)-7).c_str(), "4000000000 -5 200 -7");
+    // length modifier of the format string is ignored, stored type decides
+    CHECK_STR(render_encoded("%ld %hd", 123456, 7).c_str(), "123456 7");
+}
+
+static void test_int64()
+{
+    CHECK_STR(render("%lld", (long long)INT64_MIN).c_str(), "-9223372036854775808");
+    CHECK_STR(render("%llu", (unsigned long long)UINT64_MAX).c_str(), "18446744073709551615");
+    CHECK_STR(render_encoded("%d", (int64_t)1 << 40).c_str(), "1099511627776");
+    CHECK_STR(render("%llx", 0x123456789ABCDEFULL).c_str(), "123456789abcdef");
+
+    uint8_t buffer[MAXLEN_LOG_ARGS];
+    CLogArgEncoder encoder(buffer, sizeof(buffer));
+    encoder.add((int64_t)-2);
+    CHECK_EQ(encoder.size(), 9);
+    CHECK_EQ(buffer[0], LOG_ARG_INT64);
+}
+
+static void test_double()
+{
+    CHECK_STR(render("%f", 1.5).c_str(), "1.500000");
+    CHECK_STR(render("%.2f %e", -3.14159, 1e-3).c_str(), "-3.14 1.000000e-03");
+    CHECK_STR(render("%g", 0.25f).c_str(), "0.25");
+    CHECK_STR(render("%8.3f|", 2.0).c_str(), "   2.000|");
+    // integer conversion of a double argument
+    CHECK_STR(render_encoded("%d", 12.9).c_str(), "12");
+}
+
+static void test_string()
+{
+    CHECK_STR(render("[%s]", "hello").c_str(), "[hello]");
+    CHECK_STR(render("[%s]", "").c_str(), "[]");
+    CHECK_STR(render_encoded("[%s]", (const char *)nullptr).c_str(), "[(null)]");
+    CHECK_STR(render("[%8s|%-8s]", "ab", "cd").c_str(), "[      ab|cd      ]");
+    CHECK_STR(render("[%.3s]", "abcdef").c_str(), "[abc]");
+    char text[] = "mutable";
+    CHECK_STR(render("%s", text).c_str(), "mutable");
+
+    // long string is cut at MAXLEN_LOG_ARG_STRING
+    std::string long_text(MAXLEN_LOG_ARG_STRING + 20, 'x');
+    CHECK_STR(render("%s", long_text.c_str()).c_str(), std::string(MAXLEN_LOG_ARG_STRING, 'x').c_str());
+}
+
+static void test_pointer()
+{
+    CHECK_STR(render("%p", (void *)0x3FC81234).c_str(), "0x3fc81234");
+    CHECK_STR(render("%p", (void *)nullptr).c_str(), "0x00000000");
+
+    uint8_t buffer[MAXLEN_LOG_ARGS];
+    CLogArgEncoder encoder(buffer, sizeof(buffer));
+    encoder.add((const void *)0x40080000);
+    CHECK_EQ(encoder.size(), 5);    // target address (4 bytes) even on a 64 bit host
+    CHECK_EQ(buffer[0], LOG_ARG_POINTER);
+}
+
+static void test_star()
+{
+    CHECK_STR(render("[%*d]", 6, 42).c_str(), "[    42]");
+    CHECK_STR(render("[%-*d]", 4, 7).c_str(), "[7   ]");
+    CHECK_STR(render("[%.*f]", 1, 2.25).c_str(), "[2.2]");
+    CHECK_STR(render("[%*.*s]", 5, 2, "abcdef").c_str(), "[   ab]");
+    CHECK_STR(render("[%*lld]", 4, -5LL).c_str(), "[  -5]");
+}
+
+static void test_truncation()
+{
+    // second string doesn't fit: replaced by the truncated tag, the rest is dropped
+    std::string text(MAXLEN_LOG_ARG_STRING, 'a');
+    uint8_t buffer[MAXLEN_LOG_ARGS];
+    CLogArgEncoder encoder(buffer, sizeof(buffer));
+    encoder.add(text.c_str());
+    encoder.add(text.c_str());
+    encoder.add(1);
+    CHECK_EQ(encoder.size(), 2 + MAXLEN_LOG_ARG_STRING + 1);
+    CHECK_EQ(buffer[encoder.size() - 1], LOG_ARG_TRUNCATED);
+
+    char out[256];
+    log_render("%s|%s|%d", buffer, encoder.size(), out, sizeof(out));
+    CHECK_STR(out, (text + "|<?>|<?>").c_str());
+
+    // exactly full buffer: no truncated tag
+    uint8_t small[10];
+    CLogArgEncoder exact(small, sizeof(small));
+    exact.add(1);
+    exact.add(2);
+    CHECK_EQ(exact.size(), 10);
+    exact.add(3);
+    CHECK_EQ(exact.size(), 10);
+    log_render("%d %d %d", small, exact.size(), out, sizeof(out));
+    CHECK_STR(out, "1 2 <?>");
+
+    // missing argument, corrupted tag
+    CHECK_STR(render_encoded("%d %s", 1).c_str(), "1 <?>");
+    uint8_t corrupted[] = { 'z', 0, 0, 0, 0 };
+    log_render("%d", corrupted, sizeof(corrupted), out, sizeof(out));
+    CHECK_STR(out, "<?>");
+
+    // output buffer is always null-terminated
+    char tiny[8];
+    int length = log_render("%s", (const uint8_t *)"\x73\x0a" "0123456789", 12, tiny, sizeof(tiny));
+    CHECK_EQ(length, 7);
+    CHECK_STR(tiny, "0123456");
+    CHECK_STR(render("100%% %d", 5).c_str(), "100% 5");
+}
+
+/**
+ * @brief scripts/decode_binlog.py (decode_stream)와 같은 규칙으로 frame을 검사한다
+ * sync, length = buffer[2] (>= 12), checksum = sum(buffer[2:3+length]) & 0xFF, body = '<III' + arguments
+ */
+static void check_frame(const uint8_t *frame, size_t frame_size, uint32_t site, uint32_t format, uint32_t timestamp_ms, const uint8_t *args, size_t size)
+{
+    CHECK_EQ(frame[0], 0xA5);
+    CHECK_EQ(frame[1], 0x5A);
+    size_t length = frame[2];
+    CHECK(length >= 12);
+    CHECK_EQ(length, 12 + size);
+    CHECK_EQ(frame_size, 3 + length + 1);
+
+    uint8_t checksum = 0;
+    for (size_t i = 2; i < 3 + length; i++) {
+        checksum += frame[i];
+    }
+    CHECK_EQ(frame[3 + length], checksum);
+
+    auto u32 = [&](size_t offset) {
+        return (uint32_t)frame[offset] | (uint32_t)frame[offset + 1] << 8 | (uint32_t)frame[offset + 2] << 16 | (uint32_t)frame[offset + 3] << 24;
+    };
+    CHECK_EQ(u32(3), site);
+    CHECK_EQ(u32(7), format);
+    CHECK_EQ(u32(11), timestamp_ms);
+    CHECK(memcmp(&frame[LOG_FRAME_HEADER_SIZE], args, size) == 0);
+}
+
+static void test_frame()
+{
+    uint8_t frame[LOG_FRAME_SIZE_MAX];
+
+    // byte exact frame without arguments
+    size_t frame_size = log_encode_frame(0x3C0A1234, 0x3C0B0010, 1000, nullptr, 0, frame);
+    const uint8_t expected[] = {
+        0xA5, 0x5A, 0x0C,
+        0x34, 0x12, 0x0A, 0x3C,
+        0x10, 0x00, 0x0B, 0x3C,
+        0xE8, 0x03, 0x00, 0x00,
+        0x00,
+    };
+    uint8_t checksum = 0;
+    for (size_t i = 2; i < sizeof(expected) - 1; i++) {
+        checksum += expected[i];
+    }
+    CHECK_EQ(frame_size, sizeof(expected));
+    CHECK(memcmp(frame, expected, sizeof(expected) - 1) == 0);
+    CHECK_EQ(frame[sizeof(expected) - 1], checksum);
+
+    // encoded arguments
+    uint8_t args[MAXLEN_LOG_ARGS];
+    CLogArgEncoder encoder(args, sizeof(args));
+    encoder.add(-1);
+    encoder.add("frame");
+    encoder.add(2.5);
+    frame_size = log_encode_frame(0xDEADBEEF, 0x12345678, 0xFFFFFFFF, args, encoder.size(), frame);
+    check_frame(frame, frame_size, 0xDEADBEEF, 0x12345678, 0xFFFFFFFF, args, encoder.size());
+
+    // largest frame: length still fits in 1 byte
+    std::vector<uint8_t> full(MAXLEN_LOG_ARGS, 0xFF);
+    frame_size = log_encode_frame(1, 2, 3, full.data(), full.size(), frame);
+    CHECK_EQ(frame_size, LOG_FRAME_SIZE_MAX);
+    check_frame(frame, frame_size, 1, 2, 3, full.data(), full.size());
+}
+
+int main()
+{
+    RUN_TEST(test_int32);
+    RUN_TEST(test_int64);
+    RUN_TEST(test_double);
+    RUN_TEST(test_string);
+    RUN_TEST(test_pointer);
+    RUN_TEST(test_star);
+    RUN_TEST(test_truncation);
+    RUN_TEST(test_frame);
+
+    return TEST_RESULT();
+}
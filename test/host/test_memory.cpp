@@ -0,0 +1,244 @@
+#include "test_common.h"
+#include "memory.h"
+#include "logger.h"
+#include <stdint.h>
+#include <stdio.h>
+
+constexpr memory_key_t KEY_BYTE = make_memory_key("test_byte");
+constexpr memory_key_t KEY_WORD = make_memory_key("test_word");
+constexpr memory_key_t KEY_ARRAY = make_memory_key("test_array");
+constexpr memory_key_t KEY_STRUCT = make_memory_key("test_struct");
+
+typedef struct test_value_t {
+    uint16_t a;
+    int32_t b;
+    float c;
+    bool operator==(const test_value_t &other) const { return a == other.a && b == other.b && c == other.c; }
+} test_value_t;
+
+/**
+ * @brief ram backend whose write / commit can be failed (nvs full, flash error, ...)
+ */
+class CMemoryBackendFaulty : public CMemoryBackendRam
+{
+public:
+    bool fail_write = false;
+    bool fail_commit = false;
+
+    bool write(const char *key, const void *data, size_t size) override {
+        return fail_write ? false : CMemoryBackendRam::write(key, data, size);
+    }
+    bool commit() override {
+        return fail_commit ? false : CMemoryBackendRam::commit();
+    }
+};
+
+static void test_round_trip()
+{
+    CMemoryBackendRam backend;
+    {
+        CMemory memory;
+        CHECK(memory.initialize(&backend));
+
+        uint8_t byte = 0;
+        CHECK(!memory.load(KEY_BYTE, &byte));   // not stored yet
+
+        test_value_t value = {0xBEEF, -123456, 2.5f};
+        uint8_t array[5] = {1, 2, 3, 4, 5};
+        CHECK(memory.save(KEY_BYTE, (uint8_t)7));
+        CHECK(memory.save(KEY_WORD, (uint32_t)0x12345678));
+        CHECK(memory.save(KEY_ARRAY, array));
+        CHECK(memory.save(KEY_STRUCT, value));
+
+        // write-behind: cache only until flush
+        CHECK_EQ(backend.get_write_count(), 0);
+        CHECK(memory.load(KEY_BYTE, &byte));
+        CHECK_EQ(byte, 7);
+
+        // size mismatch
+        uint16_t word16;
+        CHECK(!memory.load(KEY_WORD, &word16));
+
+        CHECK(memory.flush());
+        CHECK_EQ(backend.get_write_count(), 4);
+        CHECK_EQ(backend.get_commit_count(), 1);
+
+        // same value again: nothing to commit
+        CHECK(memory.save(KEY_BYTE, (uint8_t)7));
+        CHECK(memory.flush());
+        CHECK_EQ(backend.get_write_count(), 4);
+        CHECK_EQ(backend.get_commit_count(), 1);
+    }
+
+    // reboot: values are read from the backend
+    backend.discard_uncommitted();
+    CMemory memory;
+    CHECK(memory.initialize(&backend));
+    uint8_t byte = 0;
+    uint32_t word = 0;
+    uint8_t array[5] = {0, };
+    test_value_t value = {0, 0, 0};
+    CHECK(memory.load(KEY_BYTE, &byte));
+    CHECK(memory.load(KEY_WORD, &word));
+    CHECK(memory.load(KEY_ARRAY, &array));
+    CHECK(memory.load(KEY_STRUCT, &value));
+    CHECK_EQ(byte, 7);
+    CHECK_EQ(word, 0x12345678);
+    CHECK(array[0] == 1 && array[4] == 5);
+    test_value_t expected = {0xBEEF, -123456, 2.5f};
+    CHECK(value == expected);
+
+    uint64_t wrong_size;
+    CHECK(!memory.load(KEY_WORD, &wrong_size));
+}
+
+static void test_batch()
+{
+    CMemoryBackendRam backend;
+    CMemory memory;
+    CHECK(memory.initialize(&backend));
+
+    memory.begin_batch();
+    memory.save(KEY_BYTE, (uint8_t)1);
+    memory.begin_batch();     // nested
+    memory.save(KEY_WORD, (uint32_t)2);
+    memory.end_batch();
+    memory.save(KEY_STRUCT, test_value_t{3, 4, 5.0f});
+
+    // flush task waits for the outermost end_batch()
+    CHECK(memory.flush(false));
+    CHECK_EQ(backend.get_write_count(), 0);
+    CHECK_EQ(backend.get_commit_count(), 0);
+
+    memory.end_batch();
+    CHECK(memory.flush(false));
+    CHECK_EQ(backend.get_write_count(), 3);
+    CHECK_EQ(backend.get_commit_count(), 1);     // every key of the batch in one commit
+
+    // unbalanced end_batch() is ignored
+    memory.end_batch();
+    memory.save(KEY_BYTE, (uint8_t)9);
+    CHECK(memory.flush(false));
+    CHECK_EQ(backend.get_commit_count(), 2);
+
+    // forced flush (shutdown) commits inside a batch
+    memory.begin_batch();
+    memory.save(KEY_BYTE, (uint8_t)10);
+    CHECK(memory.flush(true));
+    CHECK_EQ(backend.get_commit_count(), 3);
+    memory.end_batch();
+}
+
+static void test_failure()
+{
+    CMemoryBackendFaulty backend;
+    {
+        CMemory memory;
+        CHECK(memory.initialize(&backend));
+        memory.save(KEY_BYTE, (uint8_t)1);
+        memory.save(KEY_WORD, (uint32_t)1);
+        CHECK(memory.flush());
+
+        // commit fails: uncommitted writes are lost at power loss, entries stay dirty
+        backend.fail_commit = true;
+        memory.save(KEY_BYTE, (uint8_t)2);
+        memory.save(KEY_WORD, (uint32_t)2);
+        CHECK(!memory.flush());
+        backend.discard_uncommitted();
+
+        // write fails: retried by the next flush
+        backend.fail_commit = false;
+        backend.fail_write = true;
+        CHECK(!memory.flush());
+        CHECK_EQ(backend.get_commit_count(), 1);
+
+        // newer value saved before the retry wins
+        backend.fail_write = false;
+        memory.save(KEY_WORD, (uint32_t)3);
+        CHECK(memory.flush());
+        CHECK_EQ(backend.get_commit_count(), 2);
+        CHECK(memory.flush());
+        CHECK_EQ(backend.get_commit_count(), 2);
+    }
+
+    backend.discard_uncommitted();
+    CMemory memory;
+    CHECK(memory.initialize(&backend));
+    uint8_t byte = 0;
+    uint32_t word = 0;
+    CHECK(memory.load(KEY_BYTE, &byte));
+    CHECK(memory.load(KEY_WORD, &word));
+    CHECK_EQ(byte, 2);
+    CHECK_EQ(word, 3);
+}
+
+static void test_power_loss()
+{
+    CMemoryBackendFaulty backend;
+    CMemory memory;
+    CHECK(memory.initialize(&backend));
+    memory.save(KEY_BYTE, (uint8_t)1);
+    CHECK(memory.flush());
+
+    // power loss after a failed commit: reboot reads the last committed value
+    backend.fail_commit = true;
+    memory.save(KEY_BYTE, (uint8_t)5);
+    CHECK(!memory.flush());
+    backend.discard_uncommitted();
+
+    CMemory reboot;
+    CHECK(reboot.initialize(&backend));
+    uint8_t byte = 0;
+    CHECK(reboot.load(KEY_BYTE, &byte));
+    CHECK_EQ(byte, 1);
+    backend.fail_commit = false;
+}
+
+static void test_light_state()
+{
+    CMemoryBackendRam backend;
+    {
+        // legacy (version 0) blobs
+        backend.open();
+        uint8_t brightness = 80;
+        uint8_t rgb[3] = {10, 20, 30};
+        backend.write(MEMORY_KEY_LEGACY_BRIGHTNESS.name, &brightness, sizeof(brightness));
+        backend.write(MEMORY_KEY_LEGACY_RGB.name, rgb, sizeof(rgb));
+        backend.commit();
+
+        CMemory memory;
+        CHECK(memory.initialize(&backend));
+        light_state_t state;
+        CHECK(memory.load_light_state(&state));
+        CHECK_EQ(state.brightness, 80);
+        CHECK_EQ(state.onoff, 1);
+        CHECK(state.red == 10 && state.green == 20 && state.blue == 30);
+
+        state.color_loop_active = 1;
+        state.color_loop_time = 60;
+        CHECK(memory.save_light_state(&state));
+        CHECK(memory.flush());
+    }
+
+    CMemory memory;
+    CHECK(memory.initialize(&backend));
+    light_state_t state;
+    CHECK(memory.load_light_state(&state));
+    CHECK_EQ(state.version, LIGHT_STATE_VERSION);
+    CHECK_EQ(state.color_loop_active, 1);
+    CHECK_EQ(state.color_loop_time, 60);
+    CHECK_EQ(state.red, 10);
+}
+
+int main()
+{
+    CLogger::Instance()->set_level(eLogType::Exception);
+
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_batch);
+    RUN_TEST(test_failure);
+    RUN_TEST(test_power_loss);
+    RUN_TEST(test_light_state);
+
+    return TEST_RESULT();
+}